@@ -40,7 +40,7 @@
 ///		- more language support (please send mappings).
 ///		- support sticky qualifiers.
 ///		- build a shared library.
-///		- chinese support.
+///		- chinese support: more than pinyin, candidate display.
 ///		- Macro aren't complete supported.
 ///		- Command to record macros.
 ///		- very long term: support multiple instance.
@@ -56,6 +56,8 @@
 #include <sys/types.h>
 
 #include "aohk.h"
+#include "ime.h"
+#include "probe.h"
 
 #ifndef NODEFAULT
 #define NODEFAULT			///< define to exclude default tables
@@ -82,14 +84,26 @@ enum __aohk_states__
     OHMacroSecondKey,			///< macro key, first key ...
     OHMacroQuoteFirstKey,		///< have macro key, ...
     OHMacroQuoteSecondKey,		///< macro key, first key ...
+    OHTrieKey,				///< inside variable length sequence
 
     OHGameMode,				///< game mode: key = game key
     OHNumberMode,			///< number mode: key = number key
+    OHMouseMode,			///< mouse mode: keys move pointer
     OHSpecial,				///< have seen the special key
     OHSoftOff,				///< turned off
     OHHardOff				///< 100% turned off
 };
 
+///
+///	Keyboard layouts of the output, the letters typed by a keycode.
+///
+enum __aohk_layouts__
+{
+    OHLayoutUnknown,			///< letters unknown
+    OHLayoutQwerty,			///< us and alike
+    OHLayoutQwertz			///< de and alike, y and z swapped
+};
+
 ///
 ///	Key mapping typedef
 ///
@@ -105,12 +119,13 @@ typedef struct _oh_key_ OHKey;
 struct _oh_key_
 {
     unsigned char Modifier;		///< modifier flags
-    unsigned char KeyCode;		///< scancode
+    unsigned short KeyCode;		///< scancode, up to KEY_MAX
 };
 
 static char AOHKState;			///< state machine
 
 static char AOHKOnlyMe;			///< enable only my keys
+static char AOHKIme;			///< pinyin input method on
 
 static int AOHKDownKeys;		///< bitmap pressed keys
 static unsigned char AOHKLastKey;	///< last scancode got
@@ -127,9 +142,48 @@ static unsigned char AOHKLastModifier;	///< last key modifiers
 static const OHKey *AOHKLastSequence;	///< last keycode
 
 ///
-///	Table: Maps input keycodes to internal keys.
+///	Output pressed by an internal key.
+///
+///	Each internal key remembers the sequence its press has sent, its
+///	release sends exactly this release.  This allows to start the next
+///	sequence before the last is released (rollover).
+///
+typedef struct _oh_press_
+{
+    unsigned char Modifier;		///< modifiers sent with sequence
+    const OHKey *Sequence;		///< sequence sent, NULL if none
+} OHPress;
+
+static unsigned char AOHKTrieNode;	///< current node of sequence trie
+static OHPress AOHKPressed[AOHK_KEY_NOP];	///< output of pressed keys
+
+///
+///	@name Convert table
 ///
-static unsigned char AOHKConvertTable[256];
+///	Maps input keycodes to internal keys.  Two level table covering all
+///	keycodes up to KEY_MAX: the high bits select a page, the low bits the
+///	entry in the page.  Unused pages share one empty page, the lookup
+///	needs no extra branch.  255 is an unmapped keycode.
+//@{
+#define CONVERT_PAGE_BITS	6	///< keycodes per page as bits
+#define CONVERT_PAGE_SIZE	(1 << CONVERT_PAGE_BITS)	///< page size
+#define CONVERT_PAGES	(KEY_MAX / CONVERT_PAGE_SIZE + 1)	///< pages
+
+    /// Empty page shared by all unused pages.
+static unsigned char AOHKConvertEmpty[CONVERT_PAGE_SIZE] = {
+    [0 ... CONVERT_PAGE_SIZE - 1] = 255
+};
+
+    /// Pages used, allocated on demand.
+static unsigned char AOHKConvertPool[CONVERT_PAGES][CONVERT_PAGE_SIZE];
+
+    /// Page table, keycode >> #CONVERT_PAGE_BITS to page.
+static unsigned char *AOHKConvertTable[CONVERT_PAGES] = {
+    [0 ... CONVERT_PAGES - 1] = AOHKConvertEmpty
+};
+
+static int AOHKConvertPoolN;		///< pages used of pool
+//@}
 
 // ---------------------------------------------------
 
@@ -158,6 +212,7 @@ static unsigned char AOHKConvertTable[256];
 #define TOGAME	132			///< enter game mode
 #define TONUM	133			///< enter number mode
 #define SPECIAL	134			///< enter special mode
+#define TOMOUSE	135			///< enter mouse mode
 
 #define MACRO	0xC0			///< macro index
 
@@ -187,8 +242,61 @@ static unsigned AOHKGameQuotePressed;	///< quoted keys pressed in game mode
 
 #define AOHK_TIMEOUT	(1*1000)	///< default 1s timeout
 static int AOHKTimeBase = AOHK_TIMEOUT;	///< timeout in ms ticks
+static int AOHKLongTimeBase = 10 * AOHK_TIMEOUT;	///< long timeout in ms
+
+unsigned long AOHKLastTick;		///< out: last key ms tick
+static unsigned long AOHKFirstTick;	///< first key of sequence ms tick
+static unsigned long AOHKDownTick;	///< last key press ms tick
+
+///
+///	Streaming histogram of key press gaps.
+///
+///	Linear buckets, the last bucket collects all longer gaps.  Old
+///	samples fade out, all buckets are halved when the histogram is full.
+///
+typedef struct _oh_histogram_
+{
+    unsigned short Width;		///< ms per bucket
+    unsigned short Count;		///< samples in histogram
+    unsigned short Bucket[128];		///< samples per bucket
+} OHHistogram;
+
+static int AOHKAdaptive;		///< percentile for timeouts, 0 off
+static OHHistogram AOHKIntraGaps = { 20, 0, {0} };	///< gaps in sequence
+static OHHistogram AOHKInterGaps = { 100, 0, {0} };	///< gaps between
+
+static int AOHKChordWindow;		///< ms keys are a chord, 0 off
+
+static unsigned char AOHKOutHeld;	///< modifiers pressed at output
+static unsigned char AOHKOutPending;	///< deferred modifier releases
+
+    /// Autorepeat delay and rate per mode, default 500 ms and 30/s
+static struct
+{
+    int Delay;				///< ms before first repeat
+    int Rate;				///< repeats per second, 0 off
+} AOHKRepeat[AOHK_REPEAT_MODES] = {
+    [0 ... AOHK_REPEAT_MODES - 1] = {500, 30}
+};
+
+static int AOHKRepeatSymbol = -1;	///< internal key repeating, -1 none
+unsigned long AOHKRepeatTimeout;	///< out: ms tick of next repeat
 
-static unsigned long AOHKLastTick;	///< last key ms tick
+    /// Mouse keys speed, default 100 px/s, quadratic up to 1200 px/s in 1 s
+static struct
+{
+    int Speed;				///< px/s at start of motion
+    int Max;				///< px/s after ramp
+    int Ramp;				///< ms to reach max speed
+} AOHKMouse = {100, 1200, 1000};
+
+#define AOHK_MOUSE_FRAME	16	///< ms per pointer frame
+#define AOHK_MOUSE_KEYS		0x3DE	///< direction keys 1-4 6-9
+
+static unsigned long AOHKMouseStart;	///< ms tick pointer motion started
+static unsigned long AOHKMouseLast;	///< ms tick of last pointer frame
+static int AOHKMouseFracX;		///< sub pixel x motion in 1/1000 px
+static int AOHKMouseFracY;		///< sub pixel y motion in 1/1000 px
 
 //
 //	LED Macros for more hardware support
@@ -201,166 +309,156 @@ static unsigned long AOHKLastTick;	///< last key ms tick
 //#define GameModeLedOff()		///< led not used, only troubles
 #define NumberModeLedOn()		///< led not used, only troubles
 #define NumberModeLedOff()		///< led not used, only troubles
+#define MouseModeLedOn()		///< led not used, only troubles
+#define MouseModeLedOff()		///< led not used, only troubles
 #define SpecialStateLedOn()		///< led not used, only troubles
 #define SpecialStateLedOff()		///< led not used, only troubles
 
 static void AOHKEnterGameMode(void);	// forward definition
 static void AOHKEnterNumberMode(void);	// forward definition
+static void AOHKEnterMouseMode(void);	// forward definition
+static void AOHKMouseReleaseAll(void);	// forward definition
 static void AOHKEnterSpecialState(void);	// forward definition
+static void AOHKRemapSetup(void);	// forward definition
 
 #define HASH_START	(9 * 10)	///< x# sequences, index into table
 #define STAR_START	(10 * 10)	///< x* sequences, index into table
 #define DOUBLE_QUOTE	(11 * 10)	///< 00 sequence, index into table
 #define USR_START	(11 * 10 + 1)	///< USR sequences, index into table
 
-///
-///	Table sequences to scancodes.
-///		The first value are the flags and modifiers.
-///		The second value is the scancode to send.
-///		Comments are the ascii output of the keyboard driver.
-///
-static OHKey AOHKTable[11 * 10 + 1 + 8];
+#define AOHK_TRIE_KEYS	(AOHK_KEY_STAR + 1)	///< trie keys 0-9 # *
+#define AOHK_TRIE_NODES	256		///< max. trie nodes of table set
 
 ///
-///	Table quoted sequences to scancodes.
-///		The first value are the flags and modifiers.
-///		The second value is the scancode to send.
-//
-static OHKey AOHKQuoteTable[11 * 10 + 1 + 8];
-
+///	Node of the variable length sequence trie.
 ///
-///	Table super quoted sequences to scancodes.
-///	If we need more codes, they can be added here.
-///		The first value are the flags and modifiers.
-///		The second value is the scancode to send.
+///	Nodes are packed into an array, children are indices into it.
+///	Index 0 is the root, as child it means no child.  A node without
+///	children is a leaf and sends its key.  16 bytes, four nodes share
+///	a cache line, each key pressed touches only one line.
 ///
-static OHKey AOHKSuperTable[11 * 10 + 1 + 8];
+typedef struct _oh_trie_node_
+{
+    unsigned char Child[AOHK_TRIE_KEYS];	///< next node of key
+    OHKey Key;				///< output of leaf
+} OHTrieNode;
 
 ///
-///	Game table key to scancodes.
-///		The first value are the flags and modifiers.
-///		The second value is the scancode to send.
+///	Complete table set of one language/layout.
 ///
-static OHKey AOHKGameTable[AOHK_KEY_SPECIAL + 1] = {
-#ifdef DEFAULT
-//	*INDENT-OFF*
-// This can't be used, quote is used insteed.
-/* 0 */ { QUOTE,	KEY_SPACE },	// SPACE
-/* 1 */ { 0,		KEY_Z	},	// y
-/* 2 */ { 0,		KEY_X	},	// x
-/* 3 */ { 0,		KEY_C	},	// c
-
-/* 4 */ { 0,		KEY_A	},	// a
-/* 5 */ { 0,		KEY_S	},	// s
-/* 6 */ { 0,		KEY_D	},	// d
-
-/* 7 */ { 0,		KEY_Q	},	// q
-/* 8 */ { 0,		KEY_W	},	// w
-/* 9 */ { 0,		KEY_E	},	// e
-
-/* # */ { 0,		KEY_LEFTCTRL },	// Ctrl_L
-/* . */ { 0,		KEY_LEFTALT },	// Alt_L
-
-/* % */ { 0,		KEY_2	},	// 2
-/* * */ { 0,		KEY_3	},	// 3
-/* - */ { 0,		KEY_4	},	// 4
-/* + */ { 0,		KEY_R	},	// r
-
-/* ? */ { 0,		KEY_F1	},	// F1
-/* ? */ { 0,		KEY_F2	},	// F2
-/* ? */ { 0,		KEY_F3	},	// F3
-/* ? */ { 0,		KEY_F4	},	// F4
-
-/*NUM*/ { 0,		KEY_1	},	// 1
-//	*INDENT-ON*
-#endif
-};
-
+///	All tables are fully derived, a set can be used without any further
+///	setup.  The shipped sets are generated by aohkmc from the *.default.map
+///	files.
 ///
-///	Game table quoted key to scancodes.
-///
-static OHKey AOHKQuoteGameTable[AOHK_KEY_SPECIAL + 1] = {
-#ifdef DEFAULT
-//	*INDENT-OFF*
-/* 0 */ { 0,		KEY_SPACE },	// SPACE
-/* 1 */ { 0,		KEY_V	},	// v
-/* 2 */ { 0,		KEY_B	},	// b
-/* 3 */ { 0,		KEY_N	},	// n
-
-/* 4 */ { 0,		KEY_F	},	// f
-/* 5 */ { 0,		KEY_G	},	// g
-/* 6 */ { 0,		KEY_H	},	// h
-
-/* 7 */ { 0,		KEY_T	},	// t
-/* 8 */ { 0,		KEY_Y	},	// z
-/* 9 */ { 0,		KEY_U	},	// u
-
-/* # */ { RESET,	KEY_RESERVED },	// Return to normal mode
-/* . */ { 0,		KEY_TAB	},	// TAB
-
-/* % */ { 0,		KEY_6	},	// 6
-/* * */ { 0,		KEY_7	},	// 7
-/* - */ { 0,		KEY_8	},	// 8
-/* + */ { 0,		KEY_I	},	// i
-
-/* ? */ { 0,		KEY_F5	},	// F5
-/* ? */ { 0,		KEY_F6	},	// F6
-/* ? */ { 0,		KEY_F7	},	// F7
-/* ? */ { 0,		KEY_F8	},	// F8
+typedef struct _oh_table_set_
+{
+    const char *Name;			///< language name
+    int Layout;				///< output layout, #OHLayoutQwerty ...
+
+    ///
+    ///	Table sequences to scancodes.
+    ///		The first value are the flags and modifiers.
+    ///		The second value is the scancode to send.
+    ///
+    OHKey Table[11 * 10 + 1 + 8];
+
+    ///
+    ///	Table quoted sequences to scancodes.
+    ///
+    OHKey QuoteTable[11 * 10 + 1 + 8];
+
+    ///
+    ///	Table super quoted sequences to scancodes.
+    ///	If we need more codes, they can be added here.
+    ///
+    OHKey SuperTable[11 * 10 + 1 + 8];
+
+    ///
+    ///	Game table key to scancodes.
+    ///
+    OHKey GameTable[AOHK_KEY_SPECIAL + 1];
+
+    ///
+    ///	Game table quoted key to scancodes.
+    ///
+    OHKey QuoteGameTable[AOHK_KEY_SPECIAL + 1];
+
+    ///
+    ///	Number table key to scancodes.
+    ///
+    OHKey NumberTable[AOHK_KEY_SPECIAL + 1];
+
+    ///
+    ///	Macro table sequences to scancodes.
+    ///
+    OHKey MacroTable[11 * 10 + 1 + 8];
+
+    ///
+    ///	Macro table quoted sequences to scancodes.
+    ///
+    OHKey MacroQuoteTable[11 * 10 + 1 + 8];
+
+    ///
+    ///	Chord table keys pressed together to scancodes.
+    ///	Index is (lower key - 1) * 9 + higher key - 1.
+    ///
+    OHKey ChordTable[9 * 9];
+
+    ///
+    ///	Sequences of any length (sequence: section), prefix free.
+    ///	A first key with a trie path doesn't use the two key tables.
+    ///
+    int TrieN;				///< trie nodes used, 0 no trie
+    OHTrieNode Trie[AOHK_TRIE_NODES] __attribute__((aligned(64)));
+} OHTableSet;
 
-/*NUM*/ { 0,		KEY_5	},	// 5
-//	*INDENT-ON*
+#ifdef DEFAULT
+#include "aohk-lang.h"			// generated by aohkmc
+#else
+    /// No compiled table sets.
+static const OHTableSet *const AOHKLanguages[] = { NULL };
 #endif
-};
 
 ///
-///	Number table key to scancodes.
-///		The first value are the flags and modifiers.
-///		The second value is the scancode to send.
+///	Table set filled by AOHKLoadTable().
 ///
-static OHKey AOHKNumberTable[AOHK_KEY_SPECIAL + 1] = {
-#ifdef DEFAULT
-//	*INDENT-OFF*
-/* * */ { 0,		KEY_KPENTER },	// ENTER
-/* 1 */ { 0,		KEY_KP1	},	// 1
-/* 2 */ { 0,		KEY_KP2	},	// 2
-/* 3 */ { 0,		KEY_KP3	},	// 3
-
-/* 4 */ { 0,		KEY_KP4	},	// 4
-/* 5 */ { 0,		KEY_KP5	},	// 5
-/* 6 */ { 0,		KEY_KP6	},	// 6
-
-/* 7 */ { 0,		KEY_KP7	},	// 7
-/* 8 */ { 0,		KEY_KP8	},	// 8
-/* 9 */ { 0,		KEY_KP9	},	// 9
-
-/* # */ { 0,		KEY_KP0},	// 0
-/* . */ { 0,		KEY_KPDOT },	// .
+static OHTableSet AOHKUserSet = {
+    .Name = "user",
+    .Layout = OHLayoutQwerty,
+    .ChordTable = {[0 ... 9 * 9 - 1] = {RESET, KEY_RESERVED}}
+};
 
-/* % */ { 0,		KEY_KPSLASH },	// %
-/* * */ { 0,		KEY_KPASTERISK},// *
-/* - */ { 0,		KEY_KPMINUS },	// -
-/* + */ { 0,		KEY_KPPLUS },	// +
+    /// Active table set.
+static const OHTableSet *AOHKSet = &AOHKUserSet;
 
-/* ? */ { 0,		KEY_ESC	},	// ESC
-/* ? */ { 0,		KEY_LEFTCTRL },	// CTRL
-/* ? */ { 0,		KEY_LEFTALT },	// ALT
-/* ? */ { 0,		KEY_BACKSPACE },// BSP
+#define AOHK_RESIDENT	8		///< max. resident table sets
 
-/*NUM*/ { RESET,	KEY_RESERVED },	// Return to normal mode
-//	*INDENT-ON*
-#endif
-};
+    /// Resident table sets, switched with SPECIAL *.
+static const OHTableSet *AOHKResident[AOHK_RESIDENT];
+static int AOHKResidentN;		///< number of resident table sets
+static int AOHKResidentIdx;		///< index of active table set
 
 ///
-///	Macro table sequences to scancodes.
-///
-static OHKey AOHKMacroTable[11 * 10 + 1 + 8];
-
+///	Precomputed game mode key.
 ///
-///	Macro table quoted sequences to scancodes.
+///	Output events of a plain game table entry, sent without the state
+///	machine.  Only for keys with a key code no other game key sends, no
+///	rollover release is needed.
 ///
-static OHKey AOHKMacroQuoteTable[11 * 10 + 1 + 8];
+typedef struct _oh_game_fast_
+{
+    const OHKey *Sequence;		///< game table entry, NULL slow path
+    unsigned char PressN;		///< number of press events
+    unsigned char ReleaseN;		///< number of release events
+    unsigned short Press[5];		///< press keycodes, qualifiers first
+    unsigned short Release[5];		///< release keycodes, keycode first
+} OHGameFast;
+
+static OHGameFast AOHKGameFast[AOHK_KEY_SPECIAL + 1];	///< game fast path
+static const OHTableSet *AOHKGameFastSet;	///< set of #AOHKGameFast
+
+static const OHKey *AOHKRemapModeTable;	///< mode table, if a pure remap
+static const OHTableSet *AOHKRemapSet;	///< set of #AOHKRemapModeTable
 
 ///
 ///	Macro storage table.
@@ -391,6 +489,218 @@ extern int DebugLevel;			///< in: debug level
 #define Debug(level, fmt...) \
     do { if (level<DebugLevel) { printf(fmt); } } while (0)
 
+//----------------------------------------------------------------------------
+//	Output
+//----------------------------------------------------------------------------
+
+static AOHKEvent *AOHKBatchOut;		///< batch output buffer, NULL none
+static int AOHKBatchMax;		///< size of batch output buffer
+static int AOHKBatchN;			///< batch output events
+static unsigned long AOHKBatchTime;	///< timestamp of batch input event
+
+///
+///	Store output event into batch buffer.
+///
+///	Counts also events which don't fit.
+///
+///	@param type	#AOHK_EVENT_KEY, #AOHK_EVENT_LED or #AOHK_EVENT_POINTER
+///	@param code	keycode, led number or axis
+///	@param value	press/release/repeat, led on/off or motion
+///
+static void AOHKBatchStore(int type, int code, int value)
+{
+    if (AOHKBatchN < AOHKBatchMax) {
+	AOHKEvent *ev;
+
+	ev = AOHKBatchOut + AOHKBatchN;
+	ev->Timestamp = AOHKBatchTime;
+	ev->Type = type;
+	ev->Code = code;
+	ev->Value = value;
+    }
+    AOHKBatchN++;
+}
+
+///
+///	Emit key, to batch buffer or AOHKKeyOut().
+///
+///	@param key	output keycode
+///	@param pressed	1 key press, 0 key release, 2 repeat
+///
+static inline void AOHKEmitKey(int key, int pressed)
+{
+    if (AOHKBatchOut) {
+	AOHKBatchStore(AOHK_EVENT_KEY, key, pressed);
+	return;
+    }
+    AOHKKeyOut(key, pressed);
+}
+
+///
+///	Emit led, to batch buffer or AOHKShowLED().
+///
+///	@param num	led number
+///	@param state	true led on, false led off
+///
+static inline void AOHKEmitLED(int num, int state)
+{
+    if (AOHKBatchOut) {
+	AOHKBatchStore(AOHK_EVENT_LED, num, state);
+	return;
+    }
+    AOHKShowLED(num, state);
+}
+
+///
+///	Emit pointer motion, to batch buffer or AOHKPointerOut().
+///
+///	@param dx	relative x motion
+///	@param dy	relative y motion
+///
+static inline void AOHKEmitPointer(int dx, int dy)
+{
+    if (AOHKBatchOut) {
+	if (dx) {
+	    AOHKBatchStore(AOHK_EVENT_POINTER, 0, dx);
+	}
+	if (dy) {
+	    AOHKBatchStore(AOHK_EVENT_POINTER, 1, dy);
+	}
+	return;
+    }
+    AOHKPointerOut(dx, dy);
+}
+
+///
+///	Modifier bit of keycode.
+///
+///	@param key	output keycode
+///
+///	@returns #Q_SHFT_L ... #Q_GUI_R bit or 0 if @a key isn't a modifier.
+///
+static int AOHKModifierBit(int key)
+{
+    switch (key) {
+	case KEY_LEFTSHIFT:
+	    return Q_SHFT_L;
+	case KEY_LEFTCTRL:
+	    return Q_CTRL_L;
+	case KEY_LEFTALT:
+	    return Q_ALT_L;
+	case KEY_LEFTMETA:
+	    return Q_GUI_L;
+	case KEY_RIGHTSHIFT:
+	    return Q_SHFT_R;
+	case KEY_RIGHTCTRL:
+	    return Q_CTRL_R;
+	case KEY_RIGHTALT:
+	    return Q_ALT_R;
+	case KEY_RIGHTMETA:
+	    return Q_GUI_R;
+    }
+    return 0;
+}
+
+///
+///	Modifiers needed by the sequences still pressed.
+///
+///	@returns bitfield of modifier (#Q_SHFT_L, ...).
+///
+static int AOHKPressedModifier(void)
+{
+    const OHKey *sequence;
+    int modifier;
+    int i;
+
+    modifier = 0;
+    for (i = 0; i < AOHK_KEY_NOP; ++i) {
+	if (!(sequence = AOHKPressed[i].Sequence)) {
+	    continue;
+	}
+	modifier |= AOHKPressed[i].Modifier;
+	modifier |= AOHKModifierBit(sequence->KeyCode);
+	if (sequence->Modifier && sequence->Modifier ^ 0x80) {
+	    if (sequence->Modifier & SHIFT) {
+		modifier |= Q_SHFT_L;
+	    }
+	    if (sequence->Modifier & CTL) {
+		modifier |= Q_CTRL_L;
+	    }
+	    if (sequence->Modifier & ALT) {
+		modifier |= Q_ALT_L;
+	    }
+	    if (sequence->Modifier & ALTGR) {
+		modifier |= Q_ALT_R;
+	    }
+	}
+    }
+    return modifier;
+}
+
+///
+///	Send deferred modifier releases. (reverse press order)
+///
+static void AOHKOutFlush(void)
+{
+    static const unsigned char keys[8] = {
+	KEY_RIGHTMETA, KEY_LEFTMETA, KEY_RIGHTALT, KEY_LEFTALT,
+	KEY_RIGHTCTRL, KEY_LEFTCTRL, KEY_RIGHTSHIFT, KEY_LEFTSHIFT
+    };
+    int i;
+
+    for (i = 0; AOHKOutPending && i < 8; ++i) {
+	int bit;
+
+	bit = AOHKModifierBit(keys[i]);
+	if (AOHKOutPending & bit) {
+	    AOHKOutPending &= ~bit;
+	    AOHKOutHeld &= ~bit;
+	    AOHKEmitKey(keys[i], 0);
+	}
+    }
+}
+
+///
+///	Output optimizer, between state machine and AOHKKeyOut().
+///
+///	Modifier releases are deferred.  A modifier pressed again before
+///	the next key press stays held, the release/press pair is dropped.
+///	Any other key press sends the deferred releases first, so each key
+///	gets exactly its modifiers.  AOHKFeedSymbol() and AOHKFeedTimeout()
+///	flush at their end, the final modifier state is unchanged.
+///
+///	Overlapping sequences share a held modifier, it is pressed once and
+///	released with the last pressed sequence needing it.
+///
+///	@param key	output keycode
+///	@param pressed	true key press, false key release
+///
+static void AOHKOutKey(int key, int pressed)
+{
+    int bit;
+
+    if ((bit = AOHKModifierBit(key))) {
+	if (pressed) {
+	    if (AOHKOutPending & bit) {	// still held, drop pair
+		AOHKOutPending &= ~bit;
+		return;
+	    }
+	    if (AOHKOutHeld & bit) {	// held for another sequence
+		return;
+	    }
+	    AOHKOutHeld |= bit;
+	} else if (AOHKOutHeld & bit) {
+	    if (!(AOHKPressedModifier() & bit)) {
+		AOHKOutPending |= bit;
+	    }
+	    return;
+	}
+    } else if (pressed) {
+	AOHKOutFlush();
+    }
+    AOHKEmitKey(key, pressed);
+}
+
 //----------------------------------------------------------------------------
 //	Send
 //----------------------------------------------------------------------------
@@ -406,39 +716,63 @@ extern int DebugLevel;			///< in: debug level
 static void AOHKSendPressModifier(int modifier)
 {
     if (modifier & Q_SHFT_L) {
-	AOHKKeyOut(KEY_LEFTSHIFT, 1);
+	AOHKOutKey(KEY_LEFTSHIFT, 1);
     }
     if (modifier & Q_SHFT_R) {
-	AOHKKeyOut(KEY_RIGHTSHIFT, 1);
+	AOHKOutKey(KEY_RIGHTSHIFT, 1);
     }
     if (modifier & Q_CTRL_L) {
-	AOHKKeyOut(KEY_LEFTCTRL, 1);
+	AOHKOutKey(KEY_LEFTCTRL, 1);
     }
     if (modifier & Q_CTRL_R) {
-	AOHKKeyOut(KEY_RIGHTCTRL, 1);
+	AOHKOutKey(KEY_RIGHTCTRL, 1);
     }
     if (modifier & Q_ALT_L) {
-	AOHKKeyOut(KEY_LEFTALT, 1);
+	AOHKOutKey(KEY_LEFTALT, 1);
     }
     if (modifier & Q_ALT_R) {
-	AOHKKeyOut(KEY_RIGHTALT, 1);
+	AOHKOutKey(KEY_RIGHTALT, 1);
     }
     if (modifier & Q_GUI_L) {
-	AOHKKeyOut(KEY_LEFTMETA, 1);
+	AOHKOutKey(KEY_LEFTMETA, 1);
     }
     if (modifier & Q_GUI_R) {
-	AOHKKeyOut(KEY_RIGHTMETA, 1);
+	AOHKOutKey(KEY_RIGHTMETA, 1);
     }
 }
 
+static void AOHKSendReleaseSequence(int, const OHKey *);
+
 ///
 ///	Send an internal sequence as press events to input emulation.
 ///
+///	The sequence is remembered as pressed by the internal key @p key.
+///	A scancode still pressed by another internal key is released first,
+///	it can't be pressed twice.
+///
+///	@param key	internal key pressing the sequence (#AOHK_KEY_0, ...),
+///			-1 if the caller releases the sequence itself
 ///	@param modifier is a bitfield of modifier
 ///	@param sequence output key definition
 ///
-static void AOHKSendPressSequence(int modifier, const OHKey * sequence)
+static void AOHKSendPressSequence(int key, int modifier,
+    const OHKey * sequence)
 {
+    int i;
+
+    for (i = 0; i < AOHK_KEY_NOP; ++i) {
+	if (i != key && AOHKPressed[i].Sequence
+	    && AOHKPressed[i].Sequence->KeyCode == sequence->KeyCode) {
+	    Debug(4, "Rollover release %d\n", i);
+	    AOHKSendReleaseSequence(AOHKPressed[i].Modifier,
+		AOHKPressed[i].Sequence);
+	}
+    }
+    if (key >= 0) {
+	AOHKPressed[key].Modifier = modifier;
+	AOHKPressed[key].Sequence = sequence;
+    }
+
     // First all modifieres
     if (modifier) {
 	AOHKSendPressModifier(modifier);
@@ -446,20 +780,20 @@ static void AOHKSendPressSequence(int modifier, const OHKey * sequence)
     // This are special qualifiers
     if (sequence->Modifier && sequence->Modifier ^ 0x80) {
 	if (sequence->Modifier & ALTGR && !(modifier & Q_ALT_R)) {
-	    AOHKKeyOut(KEY_RIGHTALT, 1);
+	    AOHKOutKey(KEY_RIGHTALT, 1);
 	}
 	if (sequence->Modifier & ALT && !(modifier & Q_ALT_L)) {
-	    AOHKKeyOut(KEY_LEFTALT, 1);
+	    AOHKOutKey(KEY_LEFTALT, 1);
 	}
 	if (sequence->Modifier & CTL && !(modifier & Q_CTRL_L)) {
-	    AOHKKeyOut(KEY_LEFTCTRL, 1);
+	    AOHKOutKey(KEY_LEFTCTRL, 1);
 	}
 	if (sequence->Modifier & SHIFT && !(modifier & Q_SHFT_L)) {
-	    AOHKKeyOut(KEY_LEFTSHIFT, 1);
+	    AOHKOutKey(KEY_LEFTSHIFT, 1);
 	}
     }
     // Now the scan code
-    AOHKKeyOut(sequence->KeyCode, 1);
+    AOHKOutKey(sequence->KeyCode, 1);
 
     AOHKRelease = 1;			// Set flag release send needed
 }
@@ -475,28 +809,28 @@ static void AOHKSendPressSequence(int modifier, const OHKey * sequence)
 static void AOHKSendReleaseModifier(int modifier)
 {
     if (modifier & Q_GUI_R) {
-	AOHKKeyOut(KEY_RIGHTMETA, 0);
+	AOHKOutKey(KEY_RIGHTMETA, 0);
     }
     if (modifier & Q_GUI_L) {
-	AOHKKeyOut(KEY_LEFTMETA, 0);
+	AOHKOutKey(KEY_LEFTMETA, 0);
     }
     if (modifier & Q_ALT_R) {
-	AOHKKeyOut(KEY_RIGHTALT, 0);
+	AOHKOutKey(KEY_RIGHTALT, 0);
     }
     if (modifier & Q_ALT_L) {
-	AOHKKeyOut(KEY_LEFTALT, 0);
+	AOHKOutKey(KEY_LEFTALT, 0);
     }
     if (modifier & Q_CTRL_R) {
-	AOHKKeyOut(KEY_RIGHTCTRL, 0);
+	AOHKOutKey(KEY_RIGHTCTRL, 0);
     }
     if (modifier & Q_CTRL_L) {
-	AOHKKeyOut(KEY_LEFTCTRL, 0);
+	AOHKOutKey(KEY_LEFTCTRL, 0);
     }
     if (modifier & Q_SHFT_R) {
-	AOHKKeyOut(KEY_RIGHTSHIFT, 0);
+	AOHKOutKey(KEY_RIGHTSHIFT, 0);
     }
     if (modifier & Q_SHFT_L) {
-	AOHKKeyOut(KEY_LEFTSHIFT, 0);
+	AOHKOutKey(KEY_LEFTSHIFT, 0);
     }
 }
 
@@ -508,22 +842,30 @@ static void AOHKSendReleaseModifier(int modifier)
 ///
 static void AOHKSendReleaseSequence(int modifier, const OHKey * sequence)
 {
+    int i;
+
+    for (i = 0; i < AOHK_KEY_NOP; ++i) {	// no longer pressed
+	if (AOHKPressed[i].Sequence == sequence) {
+	    AOHKPressed[i].Sequence = NULL;
+	}
+    }
+
     // First the scan code
-    AOHKKeyOut(sequence->KeyCode, 0);
+    AOHKOutKey(sequence->KeyCode, 0);
 
     // This are special qualifiers
     if (sequence->Modifier && sequence->Modifier ^ 0x80) {
 	if (sequence->Modifier & SHIFT && !(modifier & Q_SHFT_L)) {
-	    AOHKKeyOut(KEY_LEFTSHIFT, 0);
+	    AOHKOutKey(KEY_LEFTSHIFT, 0);
 	}
 	if (sequence->Modifier & CTL && !(modifier & Q_CTRL_L)) {
-	    AOHKKeyOut(KEY_LEFTCTRL, 0);
+	    AOHKOutKey(KEY_LEFTCTRL, 0);
 	}
 	if (sequence->Modifier & ALT && !(modifier & Q_ALT_L)) {
-	    AOHKKeyOut(KEY_LEFTALT, 0);
+	    AOHKOutKey(KEY_LEFTALT, 0);
 	}
 	if (sequence->Modifier & ALTGR && !(modifier & Q_ALT_R)) {
-	    AOHKKeyOut(KEY_RIGHTALT, 0);
+	    AOHKOutKey(KEY_RIGHTALT, 0);
 	}
     }
     // Last all modifieres
@@ -534,6 +876,21 @@ static void AOHKSendReleaseSequence(int modifier, const OHKey * sequence)
     AOHKRelease = 0;			// release is done
 }
 
+///
+///	Release all sequences still pressed by internal keys.
+///
+static void AOHKReleaseAll(void)
+{
+    int i;
+
+    for (i = 0; i < AOHK_KEY_NOP; ++i) {
+	if (AOHKPressed[i].Sequence) {
+	    AOHKSendReleaseSequence(AOHKPressed[i].Modifier,
+		AOHKPressed[i].Sequence);
+	}
+    }
+}
+
 ///
 ///	Game mode release key.
 ///
@@ -544,7 +901,7 @@ static void AOHKGameModeRelease(int key)
     const OHKey *sequence;
 
     if (AOHKGamePressed & (1 << key)) {
-	sequence = &AOHKGameTable[key];
+	sequence = &AOHKSet->GameTable[key];
 	if (sequence->Modifier == QUOTE) {
 	    AOHKLastKey = 0;
 	} else {
@@ -553,7 +910,7 @@ static void AOHKGameModeRelease(int key)
 	AOHKGamePressed &= ~(1 << key);
     }
     if (AOHKGameQuotePressed & (1 << key)) {
-	sequence = &AOHKQuoteGameTable[key];
+	sequence = &AOHKSet->QuoteGameTable[key];
 	AOHKSendReleaseSequence(0, sequence);
 	AOHKGameQuotePressed &= ~(1 << key);
     }
@@ -580,7 +937,7 @@ static void AOHKGameModeReleaseAll(void)
 ///
 static void QuoteStateLedOn(void)
 {
-    AOHKShowLED(0, 1);
+    AOHKEmitLED(0, 1);
 }
 
 ///
@@ -588,7 +945,7 @@ static void QuoteStateLedOn(void)
 ///
 static void QuoteStateLedOff(void)
 {
-    AOHKShowLED(0, 0);
+    AOHKEmitLED(0, 0);
 }
 
 ///
@@ -596,7 +953,7 @@ static void QuoteStateLedOff(void)
 ///
 static void SecondStateLedOn(void)
 {
-    AOHKShowLED(1, 1);
+    AOHKEmitLED(1, 1);
 }
 
 ///
@@ -604,7 +961,7 @@ static void SecondStateLedOn(void)
 ///
 static void SecondStateLedOff(void)
 {
-    AOHKShowLED(1, 0);
+    AOHKEmitLED(1, 0);
 }
 
 ///
@@ -612,7 +969,7 @@ static void SecondStateLedOff(void)
 ///
 static void GameModeLedOn(void)
 {
-    AOHKShowLED(2, 1);
+    AOHKEmitLED(2, 1);
 }
 
 ///
@@ -620,7 +977,15 @@ static void GameModeLedOn(void)
 ///
 static void GameModeLedOff(void)
 {
-    AOHKShowLED(2, 0);
+    AOHKEmitLED(2, 0);
+}
+
+///
+///	Language led, on if not the first resident table set is active.
+///
+static void LanguageLed(void)
+{
+    AOHKEmitLED(3, AOHKResidentIdx != 0);
 }
 
 //----------------------------------------------------------------------------
@@ -638,13 +1003,17 @@ static void AOHKReset(void)
 	AOHKGameModeReleaseAll();
 	AOHKRelease = 0;
 	AOHKGameSendQuote = 0;
-    } else if (AOHKRelease) {		// Release old keys pressed
-	if (AOHKLastSequence) {
-	    AOHKSendReleaseSequence(AOHKLastModifier, AOHKLastSequence);
-	} else if (AOHKLastModifier) {
-	    AOHKSendReleaseModifier(AOHKLastModifier);
-	} else {
-	    Debug(0, "FIXME: release lost\n");
+    } else if (AOHKState == OHMouseMode) {
+	AOHKMouseReleaseAll();
+	AOHKRelease = 0;
+    } else {				// Release old keys pressed
+	AOHKReleaseAll();
+	if (AOHKRelease && !AOHKLastSequence) {
+	    if (AOHKLastModifier) {
+		AOHKSendReleaseModifier(AOHKLastModifier);
+	    } else {
+		Debug(0, "FIXME: release lost\n");
+	    }
 	}
 	AOHKRelease = 0;
     }
@@ -653,91 +1022,280 @@ static void AOHKReset(void)
     AOHKStickyModifier = 0;
     AOHKLastKey = 0;
     AOHKState = OHFirstKey;
+    AOHKRepeatSymbol = -1;
+    AOHKRepeatTimeout = 0;
 
     // FIXME: Check if leds are on!
     SecondStateLedOff();
     QuoteStateLedOff();
     GameModeLedOff();
     SpecialStateLedOff();
+    ImeReset();
 }
 
 //----------------------------------------------------------------------------
-//	Helper functions
+//	Input method
 //----------------------------------------------------------------------------
 
 ///
-///	Handle modifier key sequence.
+///	Letters of the qwerty layout, by keycode.
 ///
-///	First press sends press, second press sends release.
-///	Next key also releases the modifier.
+///	The qwertz layout swaps y and z, see AOHKImeLetter().
 ///
-///	@param modifier is a bitfield of modifier
+static const char AOHKImeLetters[KEY_M + 1] = {
+    [KEY_Q] = 'q', [KEY_W] = 'w', [KEY_E] = 'e', [KEY_R] = 'r',
+    [KEY_T] = 't', [KEY_Y] = 'y', [KEY_U] = 'u', [KEY_I] = 'i',
+    [KEY_O] = 'o', [KEY_P] = 'p', [KEY_A] = 'a', [KEY_S] = 's',
+    [KEY_D] = 'd', [KEY_F] = 'f', [KEY_G] = 'g', [KEY_H] = 'h',
+    [KEY_J] = 'j', [KEY_K] = 'k', [KEY_L] = 'l', [KEY_Z] = 'z',
+    [KEY_X] = 'x', [KEY_C] = 'c', [KEY_V] = 'v', [KEY_B] = 'b',
+    [KEY_N] = 'n', [KEY_M] = 'm',
+};
+
 ///
-static void AOHKDoModifier(int modifier)
+///	Input method usable with the active table set.
+///
+///	@returns true if the dictionary is loaded and the layout is known.
+///
+static int AOHKImeReady(void)
 {
-    if (AOHKModifier & modifier) {	// release it
-	AOHKSendReleaseModifier(modifier);
-    } else {				// press it
-	AOHKSendPressModifier(modifier);
+    if (AOHKSet->Layout == OHLayoutUnknown) {
+	Debug(1, "Input method needs the layout: of table set '%s'\n",
+	    AOHKSet->Name);
+	return 0;
     }
-    AOHKModifier ^= modifier;
-
-    AOHKLastModifier = AOHKModifier;
-    AOHKLastSequence = NULL;
-    AOHKRelease = AOHKModifier != 0;	// release required
+    return ImeReady();
 }
 
 ///
-///	Handle key sequence.
+///	Letter of output keycode in the layout of the active table set.
 ///
-///	@param sequence output key definition
+///	@param key	output keycode
 ///
-///	@see RESET QUAL STICKY TOGAME TONUM SPECIAL MACRO
+///	@returns lower case letter, 0 if @a key isn't a letter.
 ///
-static void AOHKDoSequence(const OHKey * sequence)
+static int AOHKImeLetter(int key)
 {
-    switch (sequence->Modifier) {
-	case RESET:
-	    Debug(2, "Soft reset\n");
-	    AOHKReset();
-	    break;
-	case QUAL:
-	    AOHKDoModifier(sequence->KeyCode);
-	    break;
-	case STICKY:
-	    // FIXME: sticky qualifier
-	    break;
-	case TOGAME:
-	    if (sequence->KeyCode != KEY_RESERVED) {
-		AOHKSendPressSequence(AOHKLastModifier =
-		    AOHKModifier, AOHKLastSequence = sequence);
-		AOHKModifier = AOHKStickyModifier;
-	    }
-	    AOHKEnterGameMode();
-	    break;
-	case TONUM:
-	    if (sequence->KeyCode != KEY_RESERVED) {
-		AOHKSendPressSequence(AOHKLastModifier =
-		    AOHKModifier, AOHKLastSequence = sequence);
-		AOHKModifier = AOHKStickyModifier;
-	    }
-	    AOHKEnterNumberMode();
-	    break;
-	case SPECIAL:
-	    AOHKEnterSpecialState();
-	    break;
+    if (key > KEY_M || !AOHKImeLetters[key]) {
+	return 0;
+    }
+    if (AOHKSet->Layout == OHLayoutQwertz) {
+	if (key == KEY_Y) {
+	    return 'z';
+	}
+	if (key == KEY_Z) {
+	    return 'y';
+	}
+    }
+    return AOHKImeLetters[key];
+}
 
-	case MACRO:
-	    Debug(0, "Macro %d\n", sequence->KeyCode);
-	    if (1) {
+///
+///	Press and release key.
+///
+///	@param key	output keycode
+///
+static void AOHKTapKey(int key)
+{
+    AOHKOutKey(key, 1);
+    AOHKOutKey(key, 0);
+}
+
+///
+///	Send code point with the unicode entry of GTK and IBus.
+///
+///	Ctrl+Shift+U, the hex digits and space.
+///
+///	@param c	unicode code point
+///
+static void AOHKSendUnicode(unsigned c)
+{
+    static const unsigned short hex[16] = {
+	KEY_0, KEY_1, KEY_2, KEY_3, KEY_4, KEY_5, KEY_6, KEY_7,
+	KEY_8, KEY_9, KEY_A, KEY_B, KEY_C, KEY_D, KEY_E, KEY_F
+    };
+    int shift;
+
+    AOHKOutKey(KEY_LEFTCTRL, 1);
+    AOHKOutKey(KEY_LEFTSHIFT, 1);
+    AOHKTapKey(KEY_U);
+    AOHKOutKey(KEY_LEFTSHIFT, 0);
+    AOHKOutKey(KEY_LEFTCTRL, 0);
+    for (shift = 28; shift && !(c >> shift); shift -= 4) {
+    }
+    for (; shift >= 0; shift -= 4) {
+	AOHKTapKey(hex[(c >> shift) & 0xF]);
+    }
+    AOHKTapKey(KEY_SPACE);
+}
+
+///
+///	Select input method candidate.
+///
+///	The typed letters are deleted and replaced by the candidate.
+///
+///	@param n	rank of candidate, 0 best
+///
+///	@returns true if selected, false no such candidate.
+///
+static int AOHKImeSelect(int n)
+{
+    const char *text;
+    unsigned c;
+    int i;
+
+    if (!(text = ImeCandidate(n))) {
+	return 0;
+    }
+    Debug(3, "Input method %s -> %s\n", ImeInput(), text);
+    for (i = strlen(ImeInput()); i; --i) {
+	AOHKTapKey(KEY_BACKSPACE);
+    }
+    while ((c = ImeUtf8(&text))) {
+	AOHKSendUnicode(c);
+    }
+    ImeReset();
+    return 1;
+}
+
+///
+///	Input method, sequence sent.
+///
+///	Plain letters are sent and collected as pinyin, the typed letters
+///	stay visible.  With collected letters: space takes the best
+///	candidate, enter and escape keep the letters, backspace deletes one.
+///	Any other key ends the input.  Only the typing states take part,
+///	game, number and mouse mode keys go out unchanged.
+///
+///	@param sequence output key definition
+///
+///	@returns true if the sequence is consumed.
+///
+static int AOHKImeSequence(const OHKey * sequence)
+{
+    int key;
+    int c;
+
+    if (AOHKState > OHTrieKey) {
+	ImeReset();
+	return 0;
+    }
+    key = sequence->KeyCode;
+    if (sequence->Modifier || AOHKModifier) {
+	key = KEY_RESERVED;
+    }
+    if ((c = AOHKImeLetter(key))) {
+	if (!ImeAdd(c)) {
+	    ImeReset();
+	}
+	return 0;
+    }
+    if (!*ImeInput()) {
+	return 0;
+    }
+    switch (key) {
+	case KEY_SPACE:
+	    if (AOHKImeSelect(0)) {
+		return 1;
+	    }
+	    break;
+	case KEY_BACKSPACE:
+	    ImeDelete();
+	    return 0;
+	case KEY_ENTER:
+	case KEY_ESC:
+	    ImeReset();
+	    return 1;
+    }
+    ImeReset();
+    return 0;
+}
+
+//----------------------------------------------------------------------------
+//	Helper functions
+//----------------------------------------------------------------------------
+
+///
+///	Handle modifier key sequence.
+///
+///	First press sends press, second press sends release.
+///	Next key also releases the modifier.
+///
+///	@param modifier is a bitfield of modifier
+///
+static void AOHKDoModifier(int modifier)
+{
+    if (AOHKModifier & modifier) {	// release it
+	AOHKSendReleaseModifier(modifier);
+    } else {				// press it
+	AOHKSendPressModifier(modifier);
+    }
+    AOHKModifier ^= modifier;
+
+    AOHKLastModifier = AOHKModifier;
+    AOHKLastSequence = NULL;
+    AOHKRelease = AOHKModifier != 0;	// release required
+}
+
+///
+///	Handle key sequence.
+///
+///	@param key	internal key completing the sequence (#AOHK_KEY_0, ...)
+///	@param sequence output key definition
+///
+///	@see RESET QUAL STICKY TOGAME TONUM TOMOUSE SPECIAL MACRO
+///
+static void AOHKDoSequence(int key, const OHKey * sequence)
+{
+    AOHK_PROBE2(sequence, sequence->Modifier, sequence->KeyCode);
+
+    switch (sequence->Modifier) {
+	case RESET:
+	    Debug(2, "Soft reset\n");
+	    AOHKReset();
+	    break;
+	case QUAL:
+	    AOHKDoModifier(sequence->KeyCode);
+	    break;
+	case STICKY:
+	    // FIXME: sticky qualifier
+	    break;
+	case TOGAME:
+	    if (sequence->KeyCode != KEY_RESERVED) {
+		AOHKSendPressSequence(key, AOHKLastModifier =
+		    AOHKModifier, AOHKLastSequence = sequence);
+		AOHKModifier = AOHKStickyModifier;
+	    }
+	    AOHKEnterGameMode();
+	    break;
+	case TONUM:
+	    if (sequence->KeyCode != KEY_RESERVED) {
+		AOHKSendPressSequence(key, AOHKLastModifier =
+		    AOHKModifier, AOHKLastSequence = sequence);
+		AOHKModifier = AOHKStickyModifier;
+	    }
+	    AOHKEnterNumberMode();
+	    break;
+	case TOMOUSE:
+	    AOHKEnterMouseMode();
+	    break;
+	case SPECIAL:
+	    AOHKEnterSpecialState();
+	    break;
+
+	case MACRO:
+	    Debug(0, "Macro %d\n", sequence->KeyCode);
+	    AOHK_PROBE1(macro_start, sequence->KeyCode);
+	    if (1) {
 		int i;
 		const OHKey *macro;
 
 		macro = AOHKMacros[sequence->KeyCode];
 		for (i = 0; macro[i].KeyCode != KEY_RESERVED; ++i) {
-		    AOHKSendPressSequence(AOHKModifier, macro + i);
+		    AOHKSendPressSequence(-1, AOHKModifier, macro + i);
 		    AOHKSendReleaseSequence(AOHKModifier, macro + i);
 		}
+		AOHK_PROBE2(macro_end, sequence->KeyCode, i);
 	    }
 	    AOHKLastModifier = AOHKModifier;
 	    AOHKLastSequence = sequence;
@@ -745,7 +1303,10 @@ static void AOHKDoSequence(const OHKey * sequence)
 	    break;
 
 	default:			// QUOTE or nothing
-	    AOHKSendPressSequence(AOHKLastModifier =
+	    if (AOHKIme && AOHKImeSequence(sequence)) {
+		break;
+	    }
+	    AOHKSendPressSequence(key, AOHKLastModifier =
 		AOHKModifier, AOHKLastSequence = sequence);
 	    AOHKModifier = AOHKStickyModifier;
 	    break;
@@ -759,7 +1320,7 @@ static void AOHKDoSequence(const OHKey * sequence)
 ///
 ///	Map to internal key symbols.
 ///
-///	Lookup @a key in #AOHKConvertTable and return its mapping.
+///	Lookup @a key in the convert table and return its mapping.
 ///	#AOHK_KEY_0, ... or -1 if not mapable.
 ///
 ///	@param key	input key scan code
@@ -771,10 +1332,86 @@ static void AOHKDoSequence(const OHKey * sequence)
 ///
 static int AOHKMapToInternal(int key, int __attribute__((unused)) down)
 {
-    if (key < 0 || (unsigned)key >= sizeof(AOHKConvertTable)) {
+    int internal;
+
+    if ((unsigned)key > KEY_MAX) {
 	return -1;
     }
-    return AOHKConvertTable[key] == 255 ? -1 : AOHKConvertTable[key];
+    internal = AOHKConvertTable[key >> CONVERT_PAGE_BITS][key
+	& (CONVERT_PAGE_SIZE - 1)];
+    AOHK_PROBE2(map, key, internal);
+    return internal == 255 ? -1 : internal;
+}
+
+///
+///	Build game mode fast path of active table set.
+///
+///	Same events as AOHKSendPressSequence() and
+///	AOHKSendReleaseSequence() without modifiers.
+///
+static void AOHKGameFastSetup(void)
+{
+    const OHKey *sequence;
+    const OHKey *other;
+    OHGameFast *fast;
+    int i;
+    int j;
+    int n;
+
+    for (i = 0; i <= AOHK_KEY_SPECIAL; ++i) {
+	fast = &AOHKGameFast[i];
+	sequence = &AOHKSet->GameTable[i];
+	fast->Sequence = NULL;
+	if (sequence->Modifier >= QUAL || sequence->KeyCode == KEY_RESERVED) {
+	    continue;
+	}
+	// key code must be unique, no rollover release
+	n = 0;
+	for (j = 0; j < 2 * (AOHK_KEY_SPECIAL + 1); ++j) {
+	    other = j <= AOHK_KEY_SPECIAL ? &AOHKSet->GameTable[j]
+		: &AOHKSet->QuoteGameTable[j - AOHK_KEY_SPECIAL - 1];
+	    if ((other->Modifier < QUAL || other->Modifier == TOGAME
+		    || other->Modifier == TONUM)
+		&& other->KeyCode == sequence->KeyCode) {
+		++n;
+	    }
+	}
+	if (n != 1) {
+	    continue;
+	}
+	n = 0;
+	if (sequence->Modifier & ALTGR) {
+	    fast->Press[n++] = KEY_RIGHTALT;
+	}
+	if (sequence->Modifier & ALT) {
+	    fast->Press[n++] = KEY_LEFTALT;
+	}
+	if (sequence->Modifier & CTL) {
+	    fast->Press[n++] = KEY_LEFTCTRL;
+	}
+	if (sequence->Modifier & SHIFT) {
+	    fast->Press[n++] = KEY_LEFTSHIFT;
+	}
+	fast->Press[n++] = sequence->KeyCode;
+	fast->PressN = n;
+	n = 0;
+	fast->Release[n++] = sequence->KeyCode;
+	if (sequence->Modifier & SHIFT) {
+	    fast->Release[n++] = KEY_LEFTSHIFT;
+	}
+	if (sequence->Modifier & CTL) {
+	    fast->Release[n++] = KEY_LEFTCTRL;
+	}
+	if (sequence->Modifier & ALT) {
+	    fast->Release[n++] = KEY_LEFTALT;
+	}
+	if (sequence->Modifier & ALTGR) {
+	    fast->Release[n++] = KEY_RIGHTALT;
+	}
+	fast->ReleaseN = n;
+	fast->Sequence = sequence;
+    }
+    AOHKGameFastSet = AOHKSet;
 }
 
 ///
@@ -785,6 +1422,8 @@ static void AOHKEnterGameMode(void)
     Debug(2, "Game mode on.\n");
     AOHKReset();			// release keys, ...
     AOHKState = OHGameMode;
+    AOHKGameFastSetup();
+    AOHKRemapSetup();
     GameModeLedOn();
 }
 
@@ -796,9 +1435,21 @@ static void AOHKEnterNumberMode(void)
     Debug(2, "Number mode on.\n");
     AOHKReset();			// release keys, ...
     AOHKState = OHNumberMode;
+    AOHKRemapSetup();
     NumberModeLedOn();
 }
 
+///
+///	Enter mouse mode
+///
+static void AOHKEnterMouseMode(void)
+{
+    Debug(2, "Mouse mode on.\n");
+    AOHKReset();			// release keys, ...
+    AOHKState = OHMouseMode;
+    MouseModeLedOn();
+}
+
 ///
 ///	Enter special state
 ///
@@ -835,7 +1486,55 @@ static void AOHKSendSequence(int key, const OHKey * sequence)
     }
     SecondStateLedOff();
 
-    AOHKDoSequence(sequence);
+    AOHKDoSequence(key, sequence);
+}
+
+///
+///	Check if trie node is a leaf.
+///
+///	@param node	trie node
+///
+static int AOHKTrieLeaf(const OHTrieNode * node)
+{
+    int i;
+
+    for (i = 0; i < AOHK_TRIE_KEYS; ++i) {
+	if (node->Child[i]) {
+	    return 0;
+	}
+    }
+    return 1;
+}
+
+///
+///	Handle the variable length sequence state.
+///
+///	Walks one step down the trie, a leaf sends its key.
+///
+///	@param key	internal key pressed (#AOHK_KEY_0, ...)
+///
+///	@see OHTrieKey
+///
+static void AOHKTrieKey(int key)
+{
+    const OHTrieNode *node;
+    int child;
+
+    if (key >= AOHK_TRIE_KEYS
+	|| !(child = AOHKSet->Trie[AOHKTrieNode].Child[key])) {
+	Debug(3, "Sequence not mapped\n");
+	AOHKReset();
+	return;
+    }
+    node = &AOHKSet->Trie[child];
+    if (AOHKTrieLeaf(node)) {
+	AOHKSendSequence(key, &node->Key);
+	return;
+    }
+    AOHKTrieNode = child;
+    AOHKState = OHTrieKey;
+    SecondStateLedOn();
+    AOHKTimeout = AOHKTimeBase;
 }
 
 ///
@@ -894,7 +1593,8 @@ static void AOHKFirstKey(int key)
 		break;
 	    }
 	    if (AOHKLastSequence) {	// repeat full sequence
-		AOHKSendPressSequence(AOHKLastModifier, AOHKLastSequence);
+		AOHKSendPressSequence(key, AOHKLastModifier,
+		    AOHKLastSequence);
 	    } else if (AOHKLastModifier) {	// or only modifier
 		AOHKDoModifier(AOHKLastModifier);
 	    }
@@ -909,7 +1609,7 @@ static void AOHKFirstKey(int key)
 	case AOHK_KEY_USR_7:
 	case AOHK_KEY_USR_8:
 	    AOHKSendSequence(key,
-		&AOHKTable[USR_START + key - AOHK_KEY_USR_1]);
+		&AOHKSet->Table[USR_START + key - AOHK_KEY_USR_1]);
 	    return;
 
 	default:
@@ -917,10 +1617,16 @@ static void AOHKFirstKey(int key)
 	    if (AOHKDownKeys & (1 << AOHK_KEY_HASH)) {	// cursor mode?
 		Debug(1, "cursor mode.\n");
 		AOHKSendSequence(key,
-		    &AOHKTable[HASH_START + key - AOHK_KEY_0]);
+		    &AOHKSet->Table[HASH_START + key - AOHK_KEY_0]);
 		return;
 	    }
 	    AOHKLastKey = key;
+	    AOHKFirstTick = AOHKLastTick;
+	    if (AOHKState == OHFirstKey && AOHKSet->Trie[0].Child[key]) {
+		AOHKTrieNode = 0;
+		AOHKTrieKey(key);
+		break;
+	    }
 	    if (AOHKState == OHMacroFirstKey) {
 		AOHKState = OHMacroSecondKey;
 	    } else {
@@ -956,26 +1662,26 @@ static void AOHKQuoteFirstKey(int key)
 	    }
 	    if (AOHKState == OHSuperFirstKey) {
 		// super quote macro
-		AOHKSendSequence(key, &AOHKSuperTable[STAR_START]);
+		AOHKSendSequence(key, &AOHKSet->SuperTable[STAR_START]);
 	    } else if (AOHKState == OHMacroQuoteFirstKey) {
 		// macro quote macro
-		AOHKSendSequence(key, &AOHKMacroTable[STAR_START]);
+		AOHKSendSequence(key, &AOHKSet->MacroTable[STAR_START]);
 	    } else {
 		// quote macro
-		AOHKSendSequence(key, &AOHKTable[STAR_START]);
+		AOHKSendSequence(key, &AOHKSet->Table[STAR_START]);
 	    }
 	    break;
 
 	case AOHK_KEY_0:		// double quote extra key
 	    if (AOHKState == OHSuperFirstKey) {
 		// super quote quote
-		AOHKSendSequence(key, &AOHKSuperTable[DOUBLE_QUOTE]);
+		AOHKSendSequence(key, &AOHKSet->SuperTable[DOUBLE_QUOTE]);
 	    } else if (AOHKState == OHMacroQuoteFirstKey) {
 		// macro quote quote
-		AOHKSendSequence(key, &AOHKMacroTable[DOUBLE_QUOTE]);
+		AOHKSendSequence(key, &AOHKSet->MacroTable[DOUBLE_QUOTE]);
 	    } else {
 		// quote quote
-		AOHKSendSequence(key, &AOHKTable[DOUBLE_QUOTE]);
+		AOHKSendSequence(key, &AOHKSet->Table[DOUBLE_QUOTE]);
 	    }
 	    break;
 
@@ -993,13 +1699,13 @@ static void AOHKQuoteFirstKey(int key)
 	    }
 	    if (AOHKState == OHSuperFirstKey) {
 		// super quote repeat
-		AOHKSendSequence(key, &AOHKSuperTable[HASH_START]);
+		AOHKSendSequence(key, &AOHKSet->SuperTable[HASH_START]);
 	    } else if (AOHKState == OHMacroQuoteFirstKey) {
 		// macro quote repeat
-		AOHKSendSequence(key, &AOHKMacroTable[HASH_START]);
+		AOHKSendSequence(key, &AOHKSet->MacroTable[HASH_START]);
 	    } else {
 		// quote repeat
-		AOHKSendSequence(key, &AOHKTable[HASH_START]);
+		AOHKSendSequence(key, &AOHKSet->Table[HASH_START]);
 	    }
 	    break;
 
@@ -1014,15 +1720,15 @@ static void AOHKQuoteFirstKey(int key)
 	    if (AOHKState == OHSuperFirstKey) {
 		// super quote
 		AOHKSendSequence(key,
-		    &AOHKSuperTable[USR_START + key - AOHK_KEY_USR_1]);
+		    &AOHKSet->SuperTable[USR_START + key - AOHK_KEY_USR_1]);
 	    } else if (AOHKState == OHMacroQuoteFirstKey) {
 		// macro quote
-		AOHKSendSequence(key,
-		    &AOHKMacroQuoteTable[USR_START + key - AOHK_KEY_USR_1]);
+		AOHKSendSequence(key, &AOHKSet->MacroQuoteTable[USR_START
+			+ key - AOHK_KEY_USR_1]);
 	    } else {
 		// quote
 		AOHKSendSequence(key,
-		    &AOHKQuoteTable[USR_START + key - AOHK_KEY_USR_1]);
+		    &AOHKSet->QuoteTable[USR_START + key - AOHK_KEY_USR_1]);
 	    }
 	    break;
 
@@ -1055,6 +1761,27 @@ static void AOHKSecondKey(int key)
     }
     // AOHK_KEY_0 ok
 
+    //
+    //	Second key pressed while first is still held, inside the chord
+    //	window: lookup chord table, sequential if no chord defined.
+    //
+    if (AOHKChordWindow && AOHKState == OHSecondKey && AOHK_KEY_1 <= key
+	&& key <= AOHK_KEY_9 && key != AOHKLastKey
+	&& (AOHKDownKeys & (1 << AOHKLastKey))
+	&& AOHKLastTick - AOHKFirstTick <= (unsigned)AOHKChordWindow) {
+	if (key < AOHKLastKey) {
+	    n = (key - AOHK_KEY_1) * 9 + AOHKLastKey - AOHK_KEY_1;
+	} else {
+	    n = (AOHKLastKey - AOHK_KEY_1) * 9 + key - AOHK_KEY_1;
+	}
+	sequence = &AOHKSet->ChordTable[n];
+	if (sequence->Modifier != RESET) {
+	    Debug(3, "Chord %d+%d\n", AOHKLastKey, key);
+	    AOHKSendSequence(key, sequence);
+	    return;
+	}
+    }
+
     if (key == AOHK_KEY_HASH) {		// second repeat 9 extra keys
 	n = HASH_START + AOHKLastKey - AOHK_KEY_0;
     } else if (key == AOHK_KEY_STAR) {	// second macro 9 extra keys
@@ -1065,20 +1792,20 @@ static void AOHKSecondKey(int key)
 
     switch (AOHKState) {
 	case OHSecondKey:
-	    sequence = &AOHKTable[n];
+	    sequence = &AOHKSet->Table[n];
 	    break;
 	case OHQuoteSecondKey:
-	    sequence = &AOHKQuoteTable[n];
+	    sequence = &AOHKSet->QuoteTable[n];
 	    break;
 	case OHMacroSecondKey:
-	    sequence = &AOHKMacroTable[n];
+	    sequence = &AOHKSet->MacroTable[n];
 	    break;
 	case OHMacroQuoteSecondKey:
-	    sequence = &AOHKMacroQuoteTable[n];
+	    sequence = &AOHKSet->MacroQuoteTable[n];
 	    break;
 	case OHSuperSecondKey:
 	default:
-	    sequence = &AOHKSuperTable[n];
+	    sequence = &AOHKSet->SuperTable[n];
 	    break;
     }
 
@@ -1111,7 +1838,8 @@ static void AOHKGameMode(int key)
     // FIXME: QUAL shouldn't work correct
 
     AOHKGameSendQuote = 0;
-    sequence = AOHKLastKey ? &AOHKQuoteGameTable[key] : &AOHKGameTable[key];
+    sequence = AOHKLastKey ? &AOHKSet->QuoteGameTable[key]
+	: &AOHKSet->GameTable[key];
 
     //
     //	Reset is used to return to normal mode.
@@ -1131,11 +1859,11 @@ static void AOHKGameMode(int key)
 	AOHKLastKey = 1;
 	AOHKGameSendQuote = 1;
 	AOHKLastModifier = AOHKModifier;
-	AOHKLastSequence = &AOHKQuoteGameTable[key];
+	AOHKLastSequence = &AOHKSet->QuoteGameTable[key];
 	AOHKModifier = AOHKStickyModifier;
 	AOHKGamePressed |= (1 << key);
     } else {
-	AOHKDoSequence(sequence);
+	AOHKDoSequence(key, sequence);
 	if (AOHKLastKey) {
 	    AOHKGameQuotePressed |= (1 << key);
 	} else {
@@ -1159,7 +1887,7 @@ static void AOHKNumberMode(int key)
 
     Debug(3, "Numbermode key %d.\n", key);
 
-    sequence = &AOHKNumberTable[key];
+    sequence = &AOHKSet->NumberTable[key];
 
     //
     //	Reset is used to return to normal mode.
@@ -1169,7 +1897,7 @@ static void AOHKNumberMode(int key)
 	// Release all still pressed keys.
 	for (key = 0; key <= AOHK_KEY_SPECIAL; ++key) {
 	    if (AOHKGamePressed & (1 << key)) {
-		sequence = &AOHKNumberTable[key];
+		sequence = &AOHKSet->NumberTable[key];
 		AOHKSendReleaseSequence(0, sequence);
 	    }
 	}
@@ -1179,60 +1907,235 @@ static void AOHKNumberMode(int key)
 	return;
     }
 
-    AOHKDoSequence(sequence);
+    AOHKDoSequence(key, sequence);
     AOHKGamePressed |= (1 << key);
 }
 
+//----------------------------------------------------------------------------
+//	Mouse Mode
+//----------------------------------------------------------------------------
+
 ///
-///	Handle the special state.
+///	Mouse button of internal key in mouse mode, 0 none.
 ///
-///	The special state, is our command mode.
+static const unsigned short AOHKMouseButton[AOHK_KEY_NOP] = {
+    [AOHK_KEY_0] = BTN_RIGHT,
+    [AOHK_KEY_5] = BTN_LEFT,
+    [AOHK_KEY_STAR] = BTN_MIDDLE,
+    [AOHK_KEY_USR_1] = BTN_LEFT,
+    [AOHK_KEY_USR_2] = BTN_RIGHT,
+    [AOHK_KEY_USR_3] = BTN_MIDDLE,
+};
+
 ///
-///	@param key	internal key pressed (#AOHK_KEY_0, ...)
+///	Pointer direction of internal keys 1-9 in mouse mode (keypad layout).
 ///
-///	@see enum __aohk_internal_keys__
+static const signed char AOHKMouseDir[AOHK_KEY_9 + 1][2] = {
+    {0, 0}, {-1, 1}, {0, 1}, {1, 1}, {-1, 0},
+    {0, 0}, {1, 0}, {-1, -1}, {0, -1}, {1, -1}
+};
+
 ///
-static void AOHKSpecialMode(int key)
+///	Mouse mode release button of key.
+///
+///	@param key	internal key released
+///
+static void AOHKMouseRelease(int key)
 {
-    SpecialStateLedOff();
-    AOHKReset();
+    if (AOHKGamePressed & (1 << key)) {
+	AOHKEmitKey(AOHKMouseButton[key], 0);
+	AOHKGamePressed &= ~(1 << key);
+    }
+}
 
-    Debug(3, "Special Key %d.\n", key);
-    switch (key) {
-	case AOHK_KEY_0:		// reset to known state
-	    Debug(2, "Reset\n");
-	    return;
+///
+///	Mouse mode release all buttons and stop pointer motion.
+///
+static void AOHKMouseReleaseAll(void)
+{
+    int i;
 
-	case AOHK_KEY_1:		// enable only me mode
-	    AOHKOnlyMe ^= 1;
-	    Debug(2, "Toggle only me mode %s.\n", AOHKOnlyMe ? "on" : "off");
-	    return;
+    for (i = 0; i <= AOHK_KEY_SPECIAL; ++i) {
+	AOHKMouseRelease(i);
+    }
+    AOHKRepeatTimeout = 0;
+}
 
-	case AOHK_KEY_2:		// double timeout
-	    AOHKTimeBase <<= 1;
-	    AOHKTimeBase |= 1;
-	    AOHKTimeout = AOHKTimeBase;
-	    Debug(2, "Double timeout %d.\n", AOHKTimeBase);
-	    return;
+///
+///	Mouse mode pointer frame.
+///
+///	Moves the pointer with the speed reached since the start of the
+///	motion, all held direction keys are combined into a single motion.
+///	Speed rises quadratic from AOHKMouse.Speed to AOHKMouse.Max, the
+///	fractional pixels are kept for the next frame.
+///
+///	@param timestamp	ms timestamp now
+///
+static void AOHKMouseFrame(unsigned long timestamp)
+{
+    unsigned long t;
+    int speed;
+    int dt;
+    int dx;
+    int dy;
+    int i;
 
-	case AOHK_KEY_3:		// half timeout
-	    AOHKTimeBase >>= 1;
-	    AOHKTimeBase |= 1;
-	    AOHKTimeout = AOHKTimeBase;
-	    Debug(2, "Half timeout %d.\n", AOHKTimeBase);
-	    return;
+    dx = 0;
+    dy = 0;
+    for (i = AOHK_KEY_1; i <= AOHK_KEY_9; ++i) {
+	if (AOHKDownKeys & (1 << i)) {
+	    dx += AOHKMouseDir[i][0];
+	    dy += AOHKMouseDir[i][1];
+	}
+    }
+    dx = dx < 0 ? -1 : dx > 0;
+    dy = dy < 0 ? -1 : dy > 0;
+    if (!dx && !dy) {			// stopped or opposite keys
+	AOHKRepeatTimeout = 0;
+	return;
+    }
 
-	case AOHK_KEY_4:		// Version
-	    if (1) {
-		int i;
+    t = timestamp - AOHKMouseStart;
+    speed = AOHKMouse.Max;
+    if (t < (unsigned long)AOHKMouse.Ramp) {
+	speed = AOHKMouse.Speed + (AOHKMouse.Max - AOHKMouse.Speed)
+	    * (long)t / AOHKMouse.Ramp * (long)t / AOHKMouse.Ramp;
+    }
+    dt = timestamp - AOHKMouseLast;
+    if (dt > 4 * AOHK_MOUSE_FRAME) {	// late, don't jump
+	dt = 4 * AOHK_MOUSE_FRAME;
+    }
+    AOHKMouseLast = timestamp;
+
+    AOHKMouseFracX += dx * speed * dt;	// px/s * ms = 1/1000 px
+    AOHKMouseFracY += dy * speed * dt;
+    dx = AOHKMouseFracX / 1000;
+    dy = AOHKMouseFracY / 1000;
+    AOHKMouseFracX -= dx * 1000;
+    AOHKMouseFracY -= dy * 1000;
+    if (dx || dy) {
+	AOHKEmitPointer(dx, dy);
+    }
 
-		char version[] = {
-		    KEY_A, KEY_O, KEY_H, KEY_K, KEY_SPACE,
-		    KEY_V, KEY_0, KEY_DOT, KEY_9, KEY_0, KEY_RESERVED
+    AOHKRepeatTimeout = timestamp + AOHK_MOUSE_FRAME;
+}
+
+///
+///	Handle the mouse mode.
+///
+///	Mouse mode: Keys 1-9 move the pointer, other keys are buttons.
+///	REPEAT and SPECIAL leave the mouse mode.
+///
+///	@param key	internal key pressed (#AOHK_KEY_0, ...)
+///
+///	@see enum __aohk_internal_keys__
+///
+static void AOHKMouseMode(int key)
+{
+    Debug(3, "Mousemode key %d.\n", key);
+
+    if (key == AOHK_KEY_HASH || key == AOHK_KEY_SPECIAL) {
+	Debug(2, "Mouse mode off.\n");
+	AOHKMouseReleaseAll();
+	AOHKState = OHFirstKey;
+	MouseModeLedOff();
+	if (key == AOHK_KEY_SPECIAL) {
+	    AOHKEnterSpecialState();
+	}
+	return;
+    }
+    if (AOHKMouseButton[key]) {
+	AOHKEmitKey(AOHKMouseButton[key], 1);
+	AOHKGamePressed |= (1 << key);
+	return;
+    }
+    if (!(AOHK_MOUSE_KEYS & (1 << key))) {
+	return;
+    }
+    if (!AOHKRepeatTimeout) {		// start of motion
+	AOHKMouseStart = AOHKLastTick;
+	AOHKMouseLast = AOHKLastTick - AOHK_MOUSE_FRAME;
+	AOHKMouseFracX = 0;
+	AOHKMouseFracY = 0;
+    }
+    AOHKMouseFrame(AOHKLastTick);	// first step without delay
+}
+
+///
+///	Set mouse keys pointer speed.
+///
+///	@param speed	px/s at start of motion
+///	@param max	px/s after @a ramp
+///	@param ramp	ms to reach @a max
+///
+void AOHKSetMouse(int speed, int max, int ramp)
+{
+    Debug(2, "Mouse %d px/s, %d px/s after %d ms\n", speed, max, ramp);
+    AOHKMouse.Speed = speed < 1 ? 1 : speed;
+    AOHKMouse.Max = max < AOHKMouse.Speed ? AOHKMouse.Speed : max;
+    AOHKMouse.Ramp = ramp < 1 ? 1 : ramp;
+}
+
+///
+///	Set fixed timeouts, adaptive timeouts are turned off.
+///
+///	@param ms	short timeout in ms, resets the sequence
+///	@param long_ms	long timeout in ms, resets modifiers, 0 10 * @a ms
+///
+static void AOHKSetTimeouts(int ms, int long_ms)
+{
+    AOHKTimeBase = ms;
+    AOHKLongTimeBase = long_ms ? long_ms : 10 * ms;
+    AOHKTimeout = AOHKTimeBase;
+    AOHKAdaptive = 0;
+}
+
+///
+///	Handle the special state.
+///
+///	The special state, is our command mode.
+///
+///	@param key	internal key pressed (#AOHK_KEY_0, ...)
+///
+///	@see enum __aohk_internal_keys__
+///
+static void AOHKSpecialMode(int key)
+{
+    SpecialStateLedOff();
+    AOHKReset();
+
+    Debug(3, "Special Key %d.\n", key);
+    switch (key) {
+	case AOHK_KEY_0:		// reset to known state
+	    Debug(2, "Reset\n");
+	    return;
+
+	case AOHK_KEY_1:		// enable only me mode
+	    AOHKOnlyMe ^= 1;
+	    Debug(2, "Toggle only me mode %s.\n", AOHKOnlyMe ? "on" : "off");
+	    return;
+
+	case AOHK_KEY_2:		// double timeout
+	    AOHKSetTimeouts((AOHKTimeBase << 1) | 1, 0);
+	    Debug(2, "Double timeout %d.\n", AOHKTimeBase);
+	    return;
+
+	case AOHK_KEY_3:		// half timeout
+	    AOHKSetTimeouts((AOHKTimeBase >> 1) | 1, 0);
+	    Debug(2, "Half timeout %d.\n", AOHKTimeBase);
+	    return;
+
+	case AOHK_KEY_4:		// Version
+	    if (1) {
+		int i;
+
+		char version[] = {
+		    KEY_A, KEY_O, KEY_H, KEY_K, KEY_SPACE,
+		    KEY_V, KEY_0, KEY_DOT, KEY_9, KEY_0, KEY_RESERVED
 		};
 		for (i = 0; version[i]; ++i) {
-		    AOHKKeyOut(version[i], 1);
-		    AOHKKeyOut(version[i], 0);
+		    AOHKOutKey(version[i], 1);
+		    AOHKOutKey(version[i], 0);
 		}
 	    }
 	    return;
@@ -1252,6 +2155,10 @@ static void AOHKSpecialMode(int key)
 	    AOHKEnterNumberMode();
 	    return;
 
+	case AOHK_KEY_HASH:		// mouse mode
+	    AOHKEnterMouseMode();
+	    return;
+
 	case AOHK_KEY_8:		// debug
 	    Debug(2, "Debug now %d.\n", ++DebugLevel);
 	    return;
@@ -1261,14 +2168,265 @@ static void AOHKSpecialMode(int key)
 	    Debug(2, "Turned off.\n");
 	    return;
 
+	case AOHK_KEY_STAR:		// next language
+	    AOHKSwitchLanguage(NULL);
+	    return;
+
 	case AOHK_KEY_SPECIAL:		// turn it off soft
 	    AOHKState = OHSoftOff;
 	    Debug(2, "Soft turned off.\n");
 	    return;
+
+	case AOHK_KEY_USR_1:		// pinyin input method
+	    AOHKIme = !AOHKIme && AOHKImeReady();
+	    Debug(2, "Input method %s.\n", AOHKIme ? "on" : "off");
+	    return;
     }
     Debug(1, "unsupported special %d.\n", key);
 }
 
+///
+///	Add sample to histogram.
+///
+///	@param hist	histogram
+///	@param gap	ms between two key presses
+///
+static void AOHKHistogramAdd(OHHistogram * hist, unsigned long gap)
+{
+    unsigned i;
+
+    i = gap / hist->Width;
+    if (i >= sizeof(hist->Bucket) / sizeof(*hist->Bucket)) {
+	i = sizeof(hist->Bucket) / sizeof(*hist->Bucket) - 1;
+    }
+    hist->Bucket[i]++;
+    if (++hist->Count >= 512) {		// fade out old samples
+	hist->Count = 0;
+	for (i = 0; i < sizeof(hist->Bucket) / sizeof(*hist->Bucket); ++i) {
+	    hist->Bucket[i] >>= 1;
+	    hist->Count += hist->Bucket[i];
+	}
+    }
+}
+
+///
+///	Get percentile of histogram.
+///
+///	@param hist		histogram
+///	@param percentile	wanted percentile 1 - 100
+///
+///	@returns ms gap, which isn't exceeded by percentile % of the samples.
+///
+static int AOHKHistogramPercentile(const OHHistogram * hist, int percentile)
+{
+    unsigned i;
+    unsigned n;
+    unsigned sum;
+
+    n = (hist->Count * percentile + 99) / 100;
+    sum = 0;
+    for (i = 0; i < sizeof(hist->Bucket) / sizeof(*hist->Bucket) - 1; ++i) {
+	sum += hist->Bucket[i];
+	if (sum >= n) {
+	    break;
+	}
+    }
+    return (i + 1) * hist->Width;
+}
+
+///
+///	Learn typing speed and adapt the timeouts.
+///
+///	The gap to the last key press is a gap inside a sequence or between
+///	two sequences, depending on the state before the key is handled.
+///	The timeouts are twice the choosen percentile of the gaps.
+///
+///	@param timestamp	ms timestamp of key press
+///
+static void AOHKLearnTiming(unsigned long timestamp)
+{
+    unsigned long gap;
+    int t;
+
+    gap = timestamp - AOHKDownTick;
+    AOHKDownTick = timestamp;
+    if (gap >= (unsigned)AOHKLongTimeBase) {	// pause, not typing
+	return;
+    }
+    switch (AOHKState) {
+	case OHFirstKey:
+	    AOHKHistogramAdd(&AOHKInterGaps, gap);
+	    break;
+	case OHSecondKey:
+	case OHQuoteFirstKey:
+	case OHQuoteSecondKey:
+	case OHSuperFirstKey:
+	case OHSuperSecondKey:
+	case OHMacroFirstKey:
+	case OHMacroSecondKey:
+	case OHMacroQuoteFirstKey:
+	case OHMacroQuoteSecondKey:
+	case OHTrieKey:
+	    AOHKHistogramAdd(&AOHKIntraGaps, gap);
+	    break;
+	default:			// modes aren't typing
+	    return;
+    }
+
+    if (AOHKIntraGaps.Count < 16) {	// not enough samples
+	return;
+    }
+    t = 2 * AOHKHistogramPercentile(&AOHKIntraGaps, AOHKAdaptive);
+    if (t < 150) {
+	t = 150;
+    } else if (t > 5000) {
+	t = 5000;
+    }
+    if (t != AOHKTimeBase) {
+	Debug(3, "Adaptive timeout %d.\n", t);
+	AOHKTimeBase = t;
+    }
+    t = 10 * AOHKTimeBase;
+    if (AOHKInterGaps.Count >= 16) {
+	t = 2 * AOHKHistogramPercentile(&AOHKInterGaps, AOHKAdaptive);
+	if (t < 4 * AOHKTimeBase) {
+	    t = 4 * AOHKTimeBase;
+	} else if (t > 60 * 1000) {
+	    t = 60 * 1000;
+	}
+    }
+    if (t != AOHKLongTimeBase) {
+	Debug(3, "Adaptive long timeout %d.\n", t);
+	AOHKLongTimeBase = t;
+    }
+}
+
+///
+///	Set adaptive timeouts.
+///
+///	The short and long timeout follow the observed gaps between key
+///	presses inside and between sequences.
+///
+///	@param percentile	percentile of gaps used, 0 fixed timeouts
+///
+void AOHKSetAdaptiveTimeout(int percentile)
+{
+    if (percentile > 100) {
+	percentile = 100;
+    }
+    Debug(2, "Adaptive timeout %d%%\n", percentile);
+    AOHKAdaptive = percentile < 0 ? 0 : percentile;
+}
+
+///
+///	Check if the mode table of current state can be a kernel keymap.
+///
+///	A game or number mode table, where each key sends a single plain
+///	key and at least one key returns to normal mode, is a 1:1 remap.
+///	#KEY_UNKNOWN is kept for the keys leaving the mode.  Called when
+///	the mode is entered, the result is kept in #AOHKRemapModeTable.
+///
+static void AOHKRemapSetup(void)
+{
+    const OHKey *table;
+    int exit;
+    int inkey;
+    int symbol;
+
+    AOHKRemapModeTable = NULL;
+    AOHKRemapSet = AOHKSet;
+    switch (AOHKState) {
+	case OHGameMode:
+	    table = AOHKSet->GameTable;
+	    break;
+	case OHNumberMode:
+	    table = AOHKSet->NumberTable;
+	    break;
+	default:
+	    return;
+    }
+    exit = 0;
+    for (inkey = 0; inkey <= KEY_MAX; ++inkey) {
+	symbol = AOHKMapToInternal(inkey, 1);
+	if (symbol < 0 || symbol == AOHK_KEY_NOP) {
+	    continue;
+	}
+	if (table[symbol].Modifier == RESET) {
+	    exit = 1;
+	} else if (table[symbol].Modifier
+	    || table[symbol].KeyCode == KEY_RESERVED
+	    || table[symbol].KeyCode == KEY_UNKNOWN) {
+	    return;
+	}
+    }
+    if (exit) {
+	AOHKRemapModeTable = table;
+    }
+}
+
+///
+///	Mode table of current state, if it can be a kernel keymap.
+///
+///	@returns mode table, NULL if no pure remap.
+///
+static const OHKey *AOHKRemapTable(void)
+{
+    if ((AOHKState != OHGameMode && AOHKState != OHNumberMode)
+	|| AOHKRemapSet != AOHKSet) {	// other table set loaded
+	return NULL;
+    }
+    return AOHKRemapModeTable;
+}
+
+///
+///	Check if current mode is a pure key remap.
+///
+///	The off states are remaps too, all keys are passed through.
+///	Soft off is left with the special key, hard off never.
+///
+///	@returns true if AOHKRemapKey() describes the current mode.
+///
+int AOHKRemapMode(void)
+{
+    return AOHKState == OHSoftOff || AOHKState == OHHardOff
+	|| AOHKRemapTable() != NULL;
+}
+
+///
+///	Key remap of current mode.
+///
+///	@param inkey	input key scan code
+///
+///	@returns output key code of @a inkey, #KEY_RESERVED if the key is
+///	ignored, -1 if the key leaves the mode.
+///
+int AOHKRemapKey(int inkey)
+{
+    const OHKey *table;
+    int symbol;
+
+    if (AOHKState == OHHardOff) {
+	return inkey;
+    }
+    if (AOHKState == OHSoftOff) {
+	return AOHKMapToInternal(inkey, 1) == AOHK_KEY_SPECIAL ? -1 : inkey;
+    }
+    if (!(table = AOHKRemapTable())) {
+	return -1;
+    }
+    symbol = AOHKMapToInternal(inkey, 1);
+    if (symbol < 0) {			// passed through
+	return inkey;
+    }
+    if (symbol == AOHK_KEY_NOP) {
+	return KEY_RESERVED;
+    }
+    if (table[symbol].Modifier == RESET) {
+	return -1;
+    }
+    return table[symbol].KeyCode;
+}
+
 ///
 ///	Check current off state.
 ///
@@ -1285,6 +2443,118 @@ int AOHKCheckOffState(void)
     return 0;
 }
 
+///
+///	Start autorepeat of internal key.
+///
+///	The last pressed key repeats, if its press has sent a plain key
+///	(no command) in normal, game or number mode.
+///	(note: 1 repeated does nothing. 11 repeated does someting!)
+///
+///	@param timestamp	ms timestamp of key press
+///	@param symbol		internal key pressed
+///
+static void AOHKStartRepeat(unsigned long timestamp, int symbol)
+{
+    const OHKey *sequence;
+    int mode;
+
+    if (AOHKState == OHMouseMode) {	// pointer frames use the timer
+	return;
+    }
+    AOHKRepeatSymbol = -1;
+    AOHKRepeatTimeout = 0;
+
+    switch (AOHKState) {
+	case OHFirstKey:
+	    mode = AOHK_REPEAT_NORMAL;
+	    break;
+	case OHGameMode:
+	    mode = AOHK_REPEAT_GAME;
+	    break;
+	case OHNumberMode:
+	    mode = AOHK_REPEAT_NUMBER;
+	    break;
+	default:
+	    return;
+    }
+    sequence = AOHKPressed[symbol].Sequence;
+    if (!AOHKRepeat[mode].Rate || !sequence || sequence->Modifier >= QUAL
+	|| sequence->KeyCode == KEY_RESERVED) {
+	return;
+    }
+    AOHKRepeatSymbol = symbol;
+    AOHKRepeatTimeout = timestamp + AOHKRepeat[mode].Delay;
+    if (!AOHKRepeatTimeout) {		// 0 is no repeat
+	AOHKRepeatTimeout = 1;
+    }
+}
+
+///
+///	Feed autorepeat.
+///
+///	Call when #AOHKRepeatTimeout is reached.  Sends only a repeat of the
+///	key, its modifiers stay pressed.
+///
+///	@param timestamp	ms timestamp now
+///
+void AOHKFeedRepeat(unsigned long timestamp)
+{
+    const OHKey *sequence;
+    int mode;
+    int period;
+
+    if (AOHKState == OHMouseMode) {
+	if (AOHKRepeatTimeout && timestamp >= AOHKRepeatTimeout) {
+	    AOHKMouseFrame(timestamp);
+	}
+	return;
+    }
+    if (AOHKRepeatSymbol < 0 || !AOHKRepeatTimeout
+	|| timestamp < AOHKRepeatTimeout) {
+	return;
+    }
+    sequence = AOHKPressed[AOHKRepeatSymbol].Sequence;
+    if (!sequence) {			// released by rollover
+	AOHKRepeatSymbol = -1;
+	AOHKRepeatTimeout = 0;
+	return;
+    }
+    mode = AOHKState == OHGameMode ? AOHK_REPEAT_GAME
+	: AOHKState == OHNumberMode ? AOHK_REPEAT_NUMBER : AOHK_REPEAT_NORMAL;
+    if (!AOHKRepeat[mode].Rate) {
+	AOHKRepeatSymbol = -1;
+	AOHKRepeatTimeout = 0;
+	return;
+    }
+    AOHKEmitKey(sequence->KeyCode, 2);
+
+    period = 1000 / AOHKRepeat[mode].Rate;
+    AOHKRepeatTimeout += period;
+    if (AOHKRepeatTimeout <= timestamp) {	// too late, don't catch up
+	AOHKRepeatTimeout = timestamp + period;
+    }
+}
+
+///
+///	Set autorepeat.
+///
+///	@param mode	#AOHK_REPEAT_NORMAL, #AOHK_REPEAT_GAME or
+///			#AOHK_REPEAT_NUMBER
+///	@param delay	ms before first repeat
+///	@param rate	repeats per second, 0 turns autorepeat off
+///
+void AOHKSetRepeat(int mode, int delay, int rate)
+{
+    if (mode < 0 || mode >= AOHK_REPEAT_MODES) {
+	return;
+    }
+    Debug(2, "Repeat mode %d: %d ms %d/s\n", mode, delay, rate);
+    AOHKRepeat[mode].Delay = delay < 0 ? 0 : delay;
+    AOHKRepeat[mode].Rate = rate < 0 ? 0 : rate > 1000 ? 1000 : rate;
+}
+
+static void AOHKHandleTimeout(int);	// forward definition
+
 ///
 ///	OneHand Statemachine.
 ///
@@ -1294,7 +2564,7 @@ int AOHKCheckOffState(void)
 ///
 ///	@returns true if key wasn't used.
 ///
-int AOHKFeedSymbol(unsigned long timestamp, int symbol, int down)
+static int AOHKHandleSymbol(unsigned long timestamp, int symbol, int down)
 {
     //
     //	Completly turned off
@@ -1319,11 +2589,18 @@ int AOHKFeedSymbol(unsigned long timestamp, int symbol, int down)
 	return -1;
     }
     //
+    //	Learn typing speed, before timeout changes the state.
+    //
+    if (AOHKAdaptive && down && symbol >= 0 && symbol < AOHK_KEY_NOP
+	&& !(AOHKDownKeys & (1 << symbol))) {
+	AOHKLearnTiming(timestamp);
+    }
+    //
     //	Timeout with timestamps
     //
     if (AOHKLastTick + AOHKTimeBase < timestamp) {
 	Debug(5, "Timeout %lu %lu\n", AOHKLastTick, timestamp);
-	AOHKFeedTimeout(timestamp - AOHKLastTick);
+	AOHKHandleTimeout(timestamp - AOHKLastTick);
     }
     AOHKLastTick = timestamp;
 
@@ -1337,7 +2614,8 @@ int AOHKFeedSymbol(unsigned long timestamp, int symbol, int down)
     //	Handling of unsupported input keys.
     //
     if (symbol == -1) {
-	if (AOHKState != OHGameMode && AOHKState != OHNumberMode) {
+	if (AOHKState != OHGameMode && AOHKState != OHNumberMode
+	    && AOHKState != OHMouseMode) {
 	    AOHKReset();		// any unsupported key reset us
 	}
 	return -1;
@@ -1354,7 +2632,8 @@ int AOHKFeedSymbol(unsigned long timestamp, int symbol, int down)
 	    //	Game mode, quote delayed to release.
 	    //
 	    if (AOHKGameSendQuote) {
-		AOHKSendPressSequence(AOHKLastModifier, AOHKLastSequence);
+		AOHKSendPressSequence(-1, AOHKLastModifier,
+		    AOHKLastSequence);
 		AOHKSendReleaseSequence(AOHKLastModifier, AOHKLastSequence);
 		AOHKGameSendQuote = 0;
 	    }
@@ -1365,22 +2644,25 @@ int AOHKFeedSymbol(unsigned long timestamp, int symbol, int down)
 	} else if (AOHKState == OHNumberMode) {
 	    if (AOHKGamePressed & (1 << symbol)) {
 		AOHKGamePressed ^= 1 << symbol;
-		AOHKSendReleaseSequence(0, &AOHKNumberTable[symbol]);
+		AOHKSendReleaseSequence(0, &AOHKSet->NumberTable[symbol]);
 	    } else {
 		// Happens on release of start sequence.
 		Debug(3, "oops key %d was not pressed\n", symbol);
 	    }
+	} else if (AOHKState == OHMouseMode) {
+	    AOHKMouseRelease(symbol);
+	    if (!(AOHKDownKeys & ~(1 << symbol) & AOHK_MOUSE_KEYS)) {
+		AOHKRepeatTimeout = 0;	// pointer stopped
+	    }
 	} else {
 	    //
-	    //	Need to send a release sequence.
+	    //	Need to send the release sequence of this key.
 	    //
-	    // FIXME: if (AOHKState == AOHKFirstKey && AOHKRelease)
-	    if (AOHKRelease) {
-		if (AOHKLastSequence) {
-		    AOHKSendReleaseSequence(AOHKLastModifier,
-			AOHKLastSequence);
-		} else if (AOHK_KEY_USR_1 <= symbol
-		    && symbol <= AOHK_KEY_USR_8) {
+	    if (AOHKPressed[symbol].Sequence) {
+		AOHKSendReleaseSequence(AOHKPressed[symbol].Modifier,
+		    AOHKPressed[symbol].Sequence);
+	    } else if (AOHKRelease && !AOHKLastSequence) {
+		if (AOHK_KEY_USR_1 <= symbol && symbol <= AOHK_KEY_USR_8) {
 		    // FIXME: hold USR than press a sequence,
 		    // FIXME: than release USR is not supported!
 		    if (AOHKLastModifier) {
@@ -1390,31 +2672,32 @@ int AOHKFeedSymbol(unsigned long timestamp, int symbol, int down)
 		    }
 		} else {
 		    Debug(3, "Release ignored for only modifier!\n");
-		    goto ignore;
-		}
-		if (AOHKRelease) {
-		    Debug(0, "Release not done!\n");
 		}
 	    }
 	}
-      ignore:
 	AOHKDownKeys &= ~(1 << symbol);
+	if (symbol == AOHKRepeatSymbol) {
+	    AOHKRepeatSymbol = -1;
+	    AOHKRepeatTimeout = 0;
+	}
 	return 0;
     } else if (AOHKDownKeys & (1 << symbol)) {	// repeating
 	//
-	//	internal key repeating, ignore
-	//	(note: 1 repeated does nothing. 11 repeated does someting!)
-	//	QUOTE is repeated in game mode, is this good?
-	//	QUAL modifiers aren't repeated
+	//	Source autorepeat is ignored, AOHKFeedRepeat() does it.
 	//
-	if (AOHKLastSequence && (AOHKState == OHGameMode
-		|| AOHKState == OHFirstKey || AOHKState == OHNumberMode)) {
-	    AOHKSendPressSequence(AOHKLastModifier, AOHKLastSequence);
-	}
 	return 0;
     }
     AOHKDownKeys |= (1 << symbol);
 
+    //
+    //	USR keys select the input method candidates.
+    //
+    if (AOHKIme && AOHKState == OHFirstKey && symbol >= AOHK_KEY_USR_1
+	&& symbol <= AOHK_KEY_USR_8
+	&& AOHKImeSelect(symbol - AOHK_KEY_USR_1)) {
+	return 0;
+    }
+
     //
     //	Convert internal code into scancodes (only down events!)
     //	The fat state machine
@@ -1440,6 +2723,10 @@ int AOHKFeedSymbol(unsigned long timestamp, int symbol, int down)
 	    AOHKSecondKey(symbol);
 	    break;
 
+	case OHTrieKey:
+	    AOHKTrieKey(symbol);
+	    break;
+
 	case OHGameMode:
 	    AOHKGameMode(symbol);
 	    break;
@@ -1448,6 +2735,10 @@ int AOHKFeedSymbol(unsigned long timestamp, int symbol, int down)
 	    AOHKNumberMode(symbol);
 	    break;
 
+	case OHMouseMode:
+	    AOHKMouseMode(symbol);
+	    break;
+
 	case OHSpecial:
 	    AOHKSpecialMode(symbol);
 	    break;
@@ -1456,10 +2747,111 @@ int AOHKFeedSymbol(unsigned long timestamp, int symbol, int down)
 	    Debug(0, "Unkown state %d reached\n", AOHKState);
 	    break;
     }
+    AOHKStartRepeat(timestamp, symbol);
 
     return 0;
 }
 
+///
+///	Game mode fast path.
+///
+///	Plain game keys, without quote and modifiers pending, are sent from
+///	the precomputed #AOHKGameFast events.  The state is updated as
+///	AOHKHandleSymbol() and AOHKGameMode() would do.
+///	The sums of traces/game*.trace are those of AOHKGameMode(), make
+///	check fails when the fast path sends other events.
+///
+///	@param timestamp	ms timestamp of event
+///	@param symbol		internal key symbol
+///	@param down		True key is pressed, false key is released
+///
+///	@returns true if handled, false use the state machine.
+///
+static inline int AOHKGameFastKey(unsigned long timestamp, int symbol,
+    int down)
+{
+    const OHGameFast *fast;
+    int i;
+
+    if ((unsigned)symbol > AOHK_KEY_SPECIAL || AOHKLastKey || AOHKModifier
+	|| AOHKGameFastSet != AOHKSet) {
+	return 0;
+    }
+    fast = &AOHKGameFast[symbol];
+    if (!fast->Sequence) {
+	return 0;
+    }
+    if (down) {
+	if (AOHKDownKeys & (1 << symbol)) {	// repeating, not our job
+	    return 0;
+	}
+	if (AOHKAdaptive) {
+	    AOHKLearnTiming(timestamp);
+	}
+	AOHKLastTick = timestamp;
+	AOHKDownKeys |= 1 << symbol;
+
+	AOHKPressed[symbol].Modifier = 0;
+	AOHKPressed[symbol].Sequence = fast->Sequence;
+	for (i = 0; i < fast->PressN; ++i) {
+	    AOHKOutKey(fast->Press[i], 1);
+	}
+	AOHKRelease = 1;
+	AOHKLastModifier = 0;
+	AOHKLastSequence = fast->Sequence;
+	AOHKGamePressed |= 1 << symbol;
+	AOHKStartRepeat(timestamp, symbol);
+    } else {
+	if (AOHKGameSendQuote || !(AOHKGamePressed & (1 << symbol))
+	    || AOHKGameQuotePressed & (1 << symbol)) {
+	    return 0;
+	}
+	AOHKLastTick = timestamp;
+
+	if (AOHKPressed[symbol].Sequence == fast->Sequence) {
+	    AOHKPressed[symbol].Sequence = NULL;
+	}
+	for (i = 0; i < fast->ReleaseN; ++i) {
+	    AOHKOutKey(fast->Release[i], 0);
+	}
+	AOHKRelease = 0;
+	AOHKGamePressed &= ~(1 << symbol);
+	AOHKDownKeys &= ~(1 << symbol);
+	if (symbol == AOHKRepeatSymbol) {
+	    AOHKRepeatSymbol = -1;
+	    AOHKRepeatTimeout = 0;
+	}
+    }
+    AOHKOutFlush();
+    return 1;
+}
+
+///
+///	Feed internal key symbol to the state machine.
+///
+///	@param timestamp	ms timestamp of event
+///	@param symbol		internal key symbol
+///	@param down		True key is pressed, false key is released
+///
+///	@returns true if key wasn't used.
+///
+int AOHKFeedSymbol(unsigned long timestamp, int symbol, int down)
+{
+    int unused;
+    int state;
+
+    state = AOHKState;
+    AOHK_PROBE4(symbol, timestamp, symbol, down, state);
+    if (AOHKState == OHGameMode && AOHKGameFastKey(timestamp, symbol, down)) {
+	AOHK_PROBE2(symbol_done, state, state);
+	return 0;
+    }
+    unused = AOHKHandleSymbol(timestamp, symbol, down);
+    AOHKOutFlush();
+    AOHK_PROBE2(symbol_done, state, AOHKState);
+    return unused;
+}
+
 ///
 ///	OneHand Statemachine.
 ///
@@ -1479,66 +2871,166 @@ void AOHKFeedKey(unsigned long timestamp, int inkey, int down)
     //	Completly turned off
     //
     if (AOHKState == OHHardOff) {
-	AOHKKeyOut(inkey, down);
+	AOHKEmitKey(inkey, down);
+	return;
+    }
+
+    Debug(6, "Keyin 0x%02X=%d %s\n", inkey, inkey, down ? "down" : "up");
+
+    symbol = AOHKMapToInternal(inkey, down);
+    if (down == 2 && symbol != -1) {	// source autorepeat, we do it
 	return;
     }
+    if (AOHKFeedSymbol(timestamp, symbol, down)) {
+	if (symbol == -1) {
+	    Debug(5, "Unsupported key %d=%#02x of state %d.\n", inkey, inkey,
+		AOHKState);
+	}
+	AOHKEmitKey(inkey, down);
+    }
+}
+
+///
+///	Handle timeouts.
+///
+///	@param which	Timeout happened,
+///
+static void AOHKHandleTimeout(int which)
+{
+    //
+    //	Timeout -> reset to intial state
+    //
+    if (AOHKState != OHGameMode && AOHKState != OHNumberMode
+	&& AOHKState != OHMouseMode && AOHKState != OHSoftOff
+	&& AOHKState != OHHardOff) {
+	// Long time: total reset
+	if (which >= AOHKLongTimeBase) {
+	    Debug(3, "Timeout long %d\n", which);
+	    AOHKReset();
+	    AOHKDownKeys = 0;
+	    AOHKTimeout = 0;
+	    return;
+	}
+	if (AOHKState != OHFirstKey) {
+	    Debug(3, "Timeout short %d\n", which);
+	    // FIXME: Check if leds are on!
+	    SecondStateLedOff();
+	    QuoteStateLedOff();
+
+	    // Short time: only reset state
+	    AOHKState = OHFirstKey;
+	}
+	AOHKTimeout = AOHKLongTimeBase;
+    }
+}
+
+///
+///	Feed Timeouts.
+///
+///	Can be called seperate to update, LEDS.
+///
+///	@param which	Timeout happened,
+///
+void AOHKFeedTimeout(int which)
+{
+    AOHK_PROBE2(timeout, which, AOHKState);
+    AOHKHandleTimeout(which);
+    AOHKOutFlush();
+}
+
+///
+///	Feed array of events, collect output in array.
+///
+///	Key events are handled like AOHKFeedKey(), timeout events like
+///	AOHKFeedTimeout() (value is the timeout) and repeat events like
+///	AOHKFeedRepeat().  Key and led output isn't sent to AOHKKeyOut()
+///	and AOHKShowLED(), it is stored in @a out with the timestamp of the
+///	input event causing it.
+///
+///	@param in	input events
+///	@param n	number of input events
+///	@param out	output events buffer
+///	@param max	size of output buffer
+///
+///	@returns number of output events, if greater than @a max, the
+///	output buffer was too small and only @a max events are stored.
+///
+int AOHKFeedEvents(const AOHKEvent * in, int n, AOHKEvent * out, int max)
+{
+    int i;
+
+    AOHKBatchOut = out;
+    AOHKBatchMax = out ? max : 0;
+    AOHKBatchN = 0;
+
+    for (i = 0; i < n; ++i) {
+	AOHKBatchTime = in[i].Timestamp;
+	switch (in[i].Type) {
+	    case AOHK_EVENT_KEY:
+		AOHKFeedKey(in[i].Timestamp, in[i].Code, in[i].Value);
+		break;
+	    case AOHK_EVENT_TIMEOUT:
+		AOHKFeedTimeout(in[i].Value);
+		break;
+	    case AOHK_EVENT_REPEAT:
+		AOHKFeedRepeat(in[i].Timestamp);
+		break;
+	    default:
+		Debug(1, "Event type %d unsupported\n", in[i].Type);
+		break;
+	}
+    }
 
-    Debug(6, "Keyin 0x%02X=%d %s\n", inkey, inkey, down ? "down" : "up");
+    AOHKBatchOut = NULL;
+    return AOHKBatchN;
+}
 
-    symbol = AOHKMapToInternal(inkey, down);
-    if (AOHKFeedSymbol(timestamp, symbol, down)) {
-	if (symbol == -1) {
-	    Debug(5, "Unsupported key %d=%#02x of state %d.\n", inkey, inkey,
-		AOHKState);
-	}
-	AOHKKeyOut(inkey, down);
+///
+///	Reset convert table
+///
+static void AOHKResetConvertTable(void)
+{
+    size_t idx;
+
+    for (idx = 0; idx < CONVERT_PAGES; ++idx) {
+	AOHKConvertTable[idx] = AOHKConvertEmpty;
     }
+    AOHKConvertPoolN = 0;
+    AOHKRemapSet = NULL;		// remap must be checked again
 }
 
 ///
-///	Feed Timeouts.
-///
-///	Can be called seperate to update, LEDS.
+///	Set entry of convert table.
 ///
-///	@param which	Timeout happened,
+///	@param key	input keycode
+///	@param internal	internal key symbol
 ///
-void AOHKFeedTimeout(int which)
+static void AOHKSetConvert(int key, int internal)
 {
-    //
-    //	Timeout -> reset to intial state
-    //
-    if (AOHKState != OHGameMode && AOHKState != OHNumberMode
-	&& AOHKState != OHSoftOff && AOHKState != OHHardOff) {
-	// Long time: total reset
-	if (which >= AOHKTimeBase * 10) {
-	    Debug(3, "Timeout long %d\n", which);
-	    AOHKReset();
-	    AOHKDownKeys = 0;
-	    AOHKTimeout = 0;
-	    return;
-	}
-	if (AOHKState != OHFirstKey) {
-	    Debug(3, "Timeout short %d\n", which);
-	    // FIXME: Check if leds are on!
-	    SecondStateLedOff();
-	    QuoteStateLedOff();
+    unsigned char **page;
 
-	    // Short time: only reset state
-	    AOHKState = OHFirstKey;
-	}
-	AOHKTimeout = 10 * AOHKTimeBase;
+    page = &AOHKConvertTable[key >> CONVERT_PAGE_BITS];
+    if (*page == AOHKConvertEmpty) {
+	*page = AOHKConvertPool[AOHKConvertPoolN++];
+	memset(*page, 255, CONVERT_PAGE_SIZE);
     }
+    (*page)[key & (CONVERT_PAGE_SIZE - 1)] = internal;
+    AOHKRemapSet = NULL;		// remap must be checked again
 }
 
 ///
-///	Reset convert table
+///	Reset table, all entries RESET.
 ///
-static void AOHKResetConvertTable(void)
+///	@param table	table to reset
+///	@param size	size of table in bytes
+///
+static void AOHKResetTable(OHKey * table, size_t size)
 {
     size_t idx;
 
-    for (idx = 0; idx < sizeof(AOHKConvertTable); ++idx) {
-	AOHKConvertTable[idx] = 255;
+    for (idx = 0; idx < size / sizeof(*table); ++idx) {
+	table[idx].Modifier = RESET;
+	table[idx].KeyCode = KEY_RESERVED;
     }
 }
 
@@ -1549,37 +3041,14 @@ static void AOHKResetConvertTable(void)
 ///
 static void AOHKResetMappingTable(void)
 {
-    size_t idx;
-
-    for (idx = 0; idx < sizeof(AOHKTable) / sizeof(*AOHKTable); ++idx) {
-	AOHKTable[idx].Modifier = RESET;
-	AOHKTable[idx].KeyCode = KEY_RESERVED;
-    }
-    for (idx = 0; idx < sizeof(AOHKQuoteTable) / sizeof(*AOHKQuoteTable);
-	++idx) {
-	AOHKQuoteTable[idx].Modifier = RESET;
-	AOHKQuoteTable[idx].KeyCode = KEY_RESERVED;
-    }
-    for (idx = 0; idx < sizeof(AOHKSuperTable) / sizeof(*AOHKSuperTable);
-	++idx) {
-	AOHKSuperTable[idx].Modifier = RESET;
-	AOHKSuperTable[idx].KeyCode = KEY_RESERVED;
-    }
-    for (idx = 0; idx < sizeof(AOHKGameTable) / sizeof(*AOHKGameTable); ++idx) {
-	AOHKGameTable[idx].Modifier = RESET;
-	AOHKGameTable[idx].KeyCode = KEY_RESERVED;
-    }
-    for (idx = 0;
-	idx < sizeof(AOHKQuoteGameTable) / sizeof(*AOHKQuoteGameTable);
-	++idx) {
-	AOHKQuoteGameTable[idx].Modifier = RESET;
-	AOHKQuoteGameTable[idx].KeyCode = KEY_RESERVED;
-    }
-    for (idx = 0; idx < sizeof(AOHKNumberTable) / sizeof(*AOHKNumberTable);
-	++idx) {
-	AOHKNumberTable[idx].Modifier = RESET;
-	AOHKNumberTable[idx].KeyCode = KEY_RESERVED;
-    }
+    AOHKResetTable(AOHKUserSet.Table, sizeof(AOHKUserSet.Table));
+    AOHKResetTable(AOHKUserSet.QuoteTable, sizeof(AOHKUserSet.QuoteTable));
+    AOHKResetTable(AOHKUserSet.SuperTable, sizeof(AOHKUserSet.SuperTable));
+    AOHKResetTable(AOHKUserSet.GameTable, sizeof(AOHKUserSet.GameTable));
+    AOHKResetTable(AOHKUserSet.QuoteGameTable,
+	sizeof(AOHKUserSet.QuoteGameTable));
+    AOHKResetTable(AOHKUserSet.NumberTable,
+	sizeof(AOHKUserSet.NumberTable));
 }
 
 ///
@@ -1587,27 +3056,94 @@ static void AOHKResetMappingTable(void)
 ///
 static void AOHKResetMacroTable(void)
 {
-    size_t idx;
+    AOHKResetTable(AOHKUserSet.MacroTable, sizeof(AOHKUserSet.MacroTable));
+    AOHKResetTable(AOHKUserSet.MacroQuoteTable,
+	sizeof(AOHKUserSet.MacroQuoteTable));
+}
 
-    for (idx = 0; idx < sizeof(AOHKMacroTable) / sizeof(*AOHKMacroTable);
-	++idx) {
-	AOHKMacroTable[idx].Modifier = RESET;
-	AOHKMacroTable[idx].KeyCode = KEY_RESERVED;
-    }
+///
+///	Reset chord table
+///
+static void AOHKResetChordTable(void)
+{
+    AOHKResetTable(AOHKUserSet.ChordTable, sizeof(AOHKUserSet.ChordTable));
+}
+
+///
+///	Reset sequence trie
+///
+static void AOHKResetTrie(void)
+{
+    memset(AOHKUserSet.Trie, 0, sizeof(AOHKUserSet.Trie));
+    AOHKUserSet.TrieN = 0;
+}
 
-    for (idx = 0;
-	idx < sizeof(AOHKMacroQuoteTable) / sizeof(*AOHKMacroQuoteTable);
-	++idx) {
+///
+///	Derive table from other table, by toggling a modifier.
+///
+///	Commands are copied unchanged.
+///
+///	@param out	derived table
+///	@param in	source table
+///	@param n	number of entries in tables
+///	@param modifier	modifier toggled in derived table
+///
+static void AOHKDeriveTable(OHKey * out, const OHKey * in, int n,
+    int modifier)
+{
+    int i;
 
-	AOHKMacroQuoteTable[idx].Modifier = RESET;
-	AOHKMacroQuoteTable[idx].KeyCode = KEY_RESERVED;
+    for (i = 0; i < n; ++i) {
+	switch (in[i].Modifier) {
+	    case RESET:
+	    case QUOTE:
+	    case QUAL:
+	    case STICKY:
+	    case TOGAME:
+	    case TONUM:
+	    case TOMOUSE:
+	    case SPECIAL:
+	    case MACRO:
+		out[i].Modifier = in[i].Modifier;
+		break;
+	    default:
+		out[i].Modifier = in[i].Modifier ^ modifier;
+		break;
+	}
+	out[i].KeyCode = in[i].KeyCode;
     }
 }
 
+///
+///	Derive macro tables of user table set. Adding Ctrl
+///
+static void AOHKDeriveMacroTables(void)
+{
+    AOHKDeriveTable(AOHKUserSet.MacroTable, AOHKUserSet.Table,
+	sizeof(AOHKUserSet.Table) / sizeof(*AOHKUserSet.Table), CTL);
+    AOHKDeriveTable(AOHKUserSet.MacroQuoteTable, AOHKUserSet.QuoteTable,
+	sizeof(AOHKUserSet.QuoteTable) / sizeof(*AOHKUserSet.QuoteTable),
+	CTL);
+}
+
+///
+///	Set chord window.
+///
+///	Sequence keys pressed together within @a ms are a chord and looked
+///	up in the chord table.
+///
+///	@param ms	chord window in ms, 0 turns chords off
+///
+void AOHKSetChordWindow(int ms)
+{
+    Debug(2, "Chord window %d ms\n", ms);
+    AOHKChordWindow = ms;
+}
+
 ///
 ///	Setup table which converts input keycodes to internal key symbols.
 ///
-///	Clears all previous entries of #AOHKConvertTable.
+///	Clears all previous entries of the convert table.
 ///
 ///	@param table	Table with pairs input internal keys.
 ///
@@ -1620,48 +3156,13 @@ void AOHKSetupConvertTable(const int *table)
     AOHKResetConvertTable();
 
     while ((idx = *table++)) {
-	if (idx > 0 && (unsigned)idx < sizeof(AOHKConvertTable)) {
-	    AOHKConvertTable[idx] = *table;
+	if (idx > 0 && idx <= KEY_MAX) {
+	    AOHKSetConvert(idx, *table);
 	}
 	++table;
     }
 }
 
-//----------------------------------------------------------------------------
-//	Macro
-//----------------------------------------------------------------------------
-
-///
-///	Add macro.
-///	Insert a string of #OHKey into first free slot of macro table
-///	#AOHKMacros.
-///
-///	@param macro	string of output sequences
-///
-static void AddMacro(OHKey * macro)
-{
-    int i;
-    unsigned u;
-
-    //	Length of macro
-    for (i = 0; i < 255; ++i) {
-	if (macro[i].KeyCode == KEY_RESERVED) {
-	    break;
-	}
-    }
-    //
-    //	Find free macro slot
-    //
-    for (u = 0; u < sizeof(AOHKMacros) / sizeof(*AOHKMacros); ++u) {
-	if (!AOHKMacros[u]) {
-	    AOHKMacros[u] = malloc(i * sizeof(OHKey));
-	    memcpy(AOHKMacros[u], macro, i * sizeof(OHKey));
-	    return;
-	}
-    }
-    Debug(0, "No space for more macros\n");
-}
-
 //----------------------------------------------------------------------------
 //	Save + Load
 //----------------------------------------------------------------------------
@@ -1816,7 +3317,7 @@ static const char* AOHKKey2String[128] = {
 ///
 static const struct {
     const char* Name;			///< alias name
-    unsigned char Key;			///< linux scan code
+    unsigned short Key;			///< linux scan code
 } AOHKKeyAlias[] = {
     {"AltGr",	KEY_RIGHTALT },
     {"KP0",	KEY_KP0 },
@@ -1831,6 +3332,130 @@ static const struct {
     {"KP9",	KEY_KP9 },
 };
 
+///
+///	Names of keycodes from 128 up to KEY_MAX.  Keycodes without name are
+///	written as hex number (fe. 0x2C0).
+///
+static const struct {
+    const char* Name;			///< key name
+    unsigned short Key;			///< linux scan code
+} AOHKKeyExtName[] = {
+    {"Calc",		KEY_CALC },
+    {"Sleep",		KEY_SLEEP },
+    {"WakeUp",		KEY_WAKEUP },
+    {"WWW",		KEY_WWW },
+    {"Mail",		KEY_MAIL },
+    {"Bookmarks",	KEY_BOOKMARKS },
+    {"Computer",	KEY_COMPUTER },
+    {"Back",		KEY_BACK },
+    {"Forward",		KEY_FORWARD },
+    {"EjectCD",		KEY_EJECTCD },
+    {"NextSong",	KEY_NEXTSONG },
+    {"PlayPause",	KEY_PLAYPAUSE },
+    {"PreviousSong",	KEY_PREVIOUSSONG },
+    {"StopCD",		KEY_STOPCD },
+    {"Record",		KEY_RECORD },
+    {"Rewind",		KEY_REWIND },
+    {"HomePage",	KEY_HOMEPAGE },
+    {"Refresh",		KEY_REFRESH },
+    {"ScrollUp",	KEY_SCROLLUP },
+    {"ScrollDown",	KEY_SCROLLDOWN },
+    {"F13",		KEY_F13 },
+    {"F14",		KEY_F14 },
+    {"F15",		KEY_F15 },
+    {"F16",		KEY_F16 },
+    {"F17",		KEY_F17 },
+    {"F18",		KEY_F18 },
+    {"F19",		KEY_F19 },
+    {"F20",		KEY_F20 },
+    {"F21",		KEY_F21 },
+    {"F22",		KEY_F22 },
+    {"F23",		KEY_F23 },
+    {"F24",		KEY_F24 },
+    {"Play",		KEY_PLAY },
+    {"FastForward",	KEY_FASTFORWARD },
+    {"Print",		KEY_PRINT },
+    {"Search",		KEY_SEARCH },
+    {"BrightnessDown",	KEY_BRIGHTNESSDOWN },
+    {"BrightnessUp",	KEY_BRIGHTNESSUP },
+    {"MicMute",		KEY_MICMUTE },
+
+    {"Btn0",		BTN_0 },
+    {"Btn1",		BTN_1 },
+    {"Btn2",		BTN_2 },
+    {"Btn3",		BTN_3 },
+    {"Btn4",		BTN_4 },
+    {"Btn5",		BTN_5 },
+    {"Btn6",		BTN_6 },
+    {"Btn7",		BTN_7 },
+    {"Btn8",		BTN_8 },
+    {"Btn9",		BTN_9 },
+    {"BtnLeft",		BTN_LEFT },
+    {"BtnRight",	BTN_RIGHT },
+    {"BtnMiddle",	BTN_MIDDLE },
+    {"BtnSide",		BTN_SIDE },
+    {"BtnExtra",	BTN_EXTRA },
+    {"BtnTrigger",	BTN_TRIGGER },
+    {"BtnThumb",	BTN_THUMB },
+    {"BtnThumb2",	BTN_THUMB2 },
+    {"BtnTop",		BTN_TOP },
+    {"BtnTop2",		BTN_TOP2 },
+    {"BtnPinkie",	BTN_PINKIE },
+    {"BtnBase",		BTN_BASE },
+    {"BtnBase2",	BTN_BASE2 },
+    {"BtnBase3",	BTN_BASE3 },
+    {"BtnBase4",	BTN_BASE4 },
+    {"BtnBase5",	BTN_BASE5 },
+    {"BtnBase6",	BTN_BASE6 },
+    {"BtnDead",		BTN_DEAD },
+    {"BtnA",		BTN_A },
+    {"BtnB",		BTN_B },
+    {"BtnC",		BTN_C },
+    {"BtnX",		BTN_X },
+    {"BtnY",		BTN_Y },
+    {"BtnZ",		BTN_Z },
+    {"BtnTL",		BTN_TL },
+    {"BtnTR",		BTN_TR },
+    {"BtnTL2",		BTN_TL2 },
+    {"BtnTR2",		BTN_TR2 },
+    {"BtnSelect",	BTN_SELECT },
+    {"BtnStart",	BTN_START },
+    {"BtnMode",		BTN_MODE },
+    {"BtnThumbL",	BTN_THUMBL },
+    {"BtnThumbR",	BTN_THUMBR },
+
+    {"Macro1",		KEY_MACRO1 },
+    {"Macro2",		KEY_MACRO2 },
+    {"Macro3",		KEY_MACRO3 },
+    {"Macro4",		KEY_MACRO4 },
+    {"Macro5",		KEY_MACRO5 },
+    {"Macro6",		KEY_MACRO6 },
+    {"Macro7",		KEY_MACRO7 },
+    {"Macro8",		KEY_MACRO8 },
+    {"Macro9",		KEY_MACRO9 },
+    {"Macro10",		KEY_MACRO10 },
+    {"Macro11",		KEY_MACRO11 },
+    {"Macro12",		KEY_MACRO12 },
+    {"Macro13",		KEY_MACRO13 },
+    {"Macro14",		KEY_MACRO14 },
+    {"Macro15",		KEY_MACRO15 },
+    {"Macro16",		KEY_MACRO16 },
+    {"Macro17",		KEY_MACRO17 },
+    {"Macro18",		KEY_MACRO18 },
+    {"Macro19",		KEY_MACRO19 },
+    {"Macro20",		KEY_MACRO20 },
+    {"Macro21",		KEY_MACRO21 },
+    {"Macro22",		KEY_MACRO22 },
+    {"Macro23",		KEY_MACRO23 },
+    {"Macro24",		KEY_MACRO24 },
+    {"Macro25",		KEY_MACRO25 },
+    {"Macro26",		KEY_MACRO26 },
+    {"Macro27",		KEY_MACRO27 },
+    {"Macro28",		KEY_MACRO28 },
+    {"Macro29",		KEY_MACRO29 },
+    {"Macro30",		KEY_MACRO30 },
+};
+
 ///
 ///	Internal key - string
 ///
@@ -1842,22 +3467,52 @@ static const char* AOHKInternal2String[] = {
 
 //	*INDENT-ON*
 
+///
+///	Name of keycode.
+///
+///	@param key	linux scan code
+///
+///	@returns name of key, valid until next call.
+///
+static const char *AOHKKeyName(int key)
+{
+    static char buf[12];
+    size_t i;
+
+    if (key < (int)(sizeof(AOHKKey2String) / sizeof(*AOHKKey2String))) {
+	return AOHKKey2String[key];
+    }
+    for (i = 0; i < sizeof(AOHKKeyExtName) / sizeof(*AOHKKeyExtName); ++i) {
+	if (AOHKKeyExtName[i].Key == key) {
+	    return AOHKKeyExtName[i].Name;
+	}
+    }
+    snprintf(buf, sizeof(buf), "0x%03X", key);
+    return buf;
+}
+
+    /// Names of the output layouts in mapping files.
+static const char *const AOHKLayoutNames[] = {
+    [OHLayoutUnknown] = "unknown",
+    [OHLayoutQwerty] = "qwerty",
+    [OHLayoutQwertz] = "qwertz",
+};
+
 ///
 ///	Save convert table.
 ///
 ///	@param fp	output file stream
-///	@param t	input to intern convert table
 ///
-static void AOHKSaveConvertTable(FILE * fp, const unsigned char *t)
+static void AOHKSaveConvertTable(FILE * fp)
 {
-    size_t i;
+    int i;
+    int internal;
 
     fprintf(fp, "\n//\tConverts input keys to internal symbols\nconvert:\n");
-    for (i = 0; i < sizeof(AOHKConvertTable)
-	&& i < sizeof(AOHKKey2String) / sizeof(*AOHKKey2String); ++i) {
-	if (t[i] != 255) {
-	    fprintf(fp, "%-10s\t-> %s\n", AOHKKey2String[i],
-		AOHKInternal2String[t[i]]);
+    for (i = 0; i <= KEY_MAX; ++i) {
+	if ((internal = AOHKMapToInternal(i, 1)) != -1) {
+	    fprintf(fp, "%-10s\t-> %s\n", AOHKKeyName(i),
+		AOHKInternal2String[internal]);
 	}
     }
 }
@@ -1868,9 +3523,9 @@ static void AOHKSaveConvertTable(FILE * fp, const unsigned char *t)
 ///	@param fp	output file stream
 ///	@param s	output key sequence
 ///
-static void AOHKSaveSequence(FILE * fp, const unsigned char *s)
+static void AOHKSaveSequence(FILE * fp, const OHKey * s)
 {
-    switch (*s) {			// modifier code
+    switch (s->Modifier) {		// modifier code
 	case RESET:
 	    fprintf(fp, "RESET");
 	    break;
@@ -1879,48 +3534,51 @@ static void AOHKSaveSequence(FILE * fp, const unsigned char *s)
 	    break;
 	case TOGAME:
 	    fprintf(fp, "TOGAME");
-	    if (s[1] != KEY_RESERVED) {
-		fprintf(fp, " %s", AOHKKey2String[s[1]]);
+	    if (s->KeyCode != KEY_RESERVED) {
+		fprintf(fp, " %s", AOHKKeyName(s->KeyCode));
 	    }
 	    break;
 	case TONUM:
 	    fprintf(fp, "TONUM");
-	    if (s[1] != KEY_RESERVED) {
-		fprintf(fp, " %s", AOHKKey2String[s[1]]);
+	    if (s->KeyCode != KEY_RESERVED) {
+		fprintf(fp, " %s", AOHKKeyName(s->KeyCode));
 	    }
 	    break;
+	case TOMOUSE:
+	    fprintf(fp, "TOMOUSE");
+	    break;
 	case SPECIAL:
 	    fprintf(fp, "SPECIAL");
 	    break;
 	case QUAL:
 	case STICKY:
-	    if (*s == QUAL) {
+	    if (s->Modifier == QUAL) {
 		fprintf(fp, "QUAL ");
 	    } else {
 		fprintf(fp, "STICKY ");
 	    }
-	    if (s[1] & Q_SHFT_L) {
+	    if (s->KeyCode & Q_SHFT_L) {
 		fprintf(fp, "LeftShift ");
 	    }
-	    if (s[1] & Q_CTRL_L) {
+	    if (s->KeyCode & Q_CTRL_L) {
 		fprintf(fp, "LeftCtrl ");
 	    }
-	    if (s[1] & Q_ALT_L) {
+	    if (s->KeyCode & Q_ALT_L) {
 		fprintf(fp, "LeftAlt ");
 	    }
-	    if (s[1] & Q_GUI_L) {
+	    if (s->KeyCode & Q_GUI_L) {
 		fprintf(fp, "LeftMeta ");
 	    }
-	    if (s[1] & Q_SHFT_R) {
+	    if (s->KeyCode & Q_SHFT_R) {
 		fprintf(fp, "RightShift ");
 	    }
-	    if (s[1] & Q_CTRL_R) {
+	    if (s->KeyCode & Q_CTRL_R) {
 		fprintf(fp, "RightCtrl ");
 	    }
-	    if (s[1] & Q_ALT_R) {
+	    if (s->KeyCode & Q_ALT_R) {
 		fprintf(fp, "RightAlt ");
 	    }
-	    if (s[1] & Q_GUI_R) {
+	    if (s->KeyCode & Q_GUI_R) {
 		fprintf(fp, "RightMeta ");
 	    }
 	    break;
@@ -1929,29 +3587,29 @@ static void AOHKSaveSequence(FILE * fp, const unsigned char *s)
 		int i;
 		const OHKey *macro;
 
-		macro = AOHKMacros[s[1]];
+		macro = AOHKMacros[s->KeyCode];
 		for (i = 0; macro[i].KeyCode != KEY_RESERVED; ++i) {
 		    if (i) {
 			fprintf(fp, " ");
 		    }
-		    AOHKSaveSequence(fp, (unsigned char *)&macro[i]);
+		    AOHKSaveSequence(fp, &macro[i]);
 		}
 	    }
 	    break;
 	default:
-	    if (s[0] & SHIFT) {
+	    if (s->Modifier & SHIFT) {
 		fprintf(fp, "LeftShift ");
 	    }
-	    if (s[0] & CTL) {
+	    if (s->Modifier & CTL) {
 		fprintf(fp, "LeftCtrl ");
 	    }
-	    if (s[0] & ALT) {
+	    if (s->Modifier & ALT) {
 		fprintf(fp, "LeftAlt ");
 	    }
-	    if (s[0] & ALTGR) {
+	    if (s->Modifier & ALTGR) {
 		fprintf(fp, "AltGr ");
 	    }
-	    fprintf(fp, "%s", AOHKKey2String[s[1]]);
+	    fprintf(fp, "%s", AOHKKeyName(s->KeyCode));
 	    break;
     }
 }
@@ -1959,26 +3617,31 @@ static void AOHKSaveSequence(FILE * fp, const unsigned char *s)
 ///
 ///	Save sequence table.
 ///
-static void AOHKSaveMapping(FILE * fp, const char *prefix,
-    const unsigned char *t, int n)
+///	@param fp	output file stream
+///	@param prefix	internal key prefix of table
+///	@param t	sequence table
+///	@param n	number of entries in table
+///
+static void AOHKSaveMapping(FILE * fp, const char *prefix, const OHKey * t,
+    int n)
 {
     int i;
 
-    for (i = 0; i < n; i += 2) {
+    for (i = 0; i < n; ++i) {
 	//
 	//	Print internal sequence code
 	//
 	fprintf(fp, "%s", prefix);
-	if (i == DOUBLE_QUOTE * 2) {
+	if (i == DOUBLE_QUOTE) {
 	    fprintf(fp, "00\t-> ");
-	} else if (i >= USR_START * 2) {
-	    fprintf(fp, "USR%d\t-> ", (i >> 1) - USR_START + 1);
-	} else if (i >= STAR_START * 2) {
-	    fprintf(fp, "%d*\t-> ", (i >> 1) % 10);
-	} else if (i >= HASH_START * 2) {
-	    fprintf(fp, "%d#\t-> ", (i >> 1) % 10);
+	} else if (i >= USR_START) {
+	    fprintf(fp, "USR%d\t-> ", i - USR_START + 1);
+	} else if (i >= STAR_START) {
+	    fprintf(fp, "%d*\t-> ", i % 10);
+	} else if (i >= HASH_START) {
+	    fprintf(fp, "%d#\t-> ", i % 10);
 	} else {
-	    fprintf(fp, "%d%d\t-> ", (i >> 1) / 10 + 1, (i >> 1) % 10);
+	    fprintf(fp, "%d%d\t-> ", i / 10 + 1, i % 10);
 	}
 
 	//
@@ -1992,18 +3655,69 @@ static void AOHKSaveMapping(FILE * fp, const char *prefix,
 ///
 ///	Save game table
 ///
-static void AOHKSaveGameTable(FILE * fp, const char *prefix,
-    const unsigned char *t, int n)
+///	@param fp	output file stream
+///	@param prefix	internal key prefix of table
+///	@param t	key table
+///	@param n	number of entries in table
+///
+static void AOHKSaveGameTable(FILE * fp, const char *prefix, const OHKey * t,
+    int n)
 {
     int i;
 
-    for (i = 0; i < n; i += 2) {
-	fprintf(fp, "%s%s\t-> ", prefix, AOHKInternal2String[i / 2]);
+    for (i = 0; i < n; ++i) {
+	fprintf(fp, "%s%s\t-> ", prefix, AOHKInternal2String[i]);
 	AOHKSaveSequence(fp, t + i);
 	fprintf(fp, "\n");
     }
 }
 
+///
+///	Save chord table, only the defined chords.
+///
+static void AOHKSaveChordTable(FILE * fp)
+{
+    int i;
+
+    fprintf(fp, "//\tkeys pressed together\nchord:\n");
+    for (i = 0; i < 9 * 9; ++i) {
+	if (AOHKSet->ChordTable[i].Modifier == RESET) {
+	    continue;
+	}
+	fprintf(fp, "%d%d\t-> ", i / 9 + 1, i % 9 + 1);
+	AOHKSaveSequence(fp, &AOHKSet->ChordTable[i]);
+	fprintf(fp, "\n");
+    }
+}
+
+///
+///	Save sequence trie, all leafs below node.
+///
+///	@param fp	output file stream
+///	@param node	trie node index
+///	@param prefix	internal key sequence to node
+///	@param depth	length of prefix
+///
+static void AOHKSaveTrie(FILE * fp, int node, char *prefix, int depth)
+{
+    const OHTrieNode *t;
+    int i;
+
+    t = &AOHKSet->Trie[node];
+    if (node && AOHKTrieLeaf(t)) {
+	fprintf(fp, "%.*s\t-> ", depth, prefix);
+	AOHKSaveSequence(fp, &t->Key);
+	fprintf(fp, "\n");
+	return;
+    }
+    for (i = 0; i < AOHK_TRIE_KEYS; ++i) {
+	if (t->Child[i]) {
+	    prefix[depth] = *AOHKInternal2String[i];
+	    AOHKSaveTrie(fp, t->Child[i], prefix, depth + 1);
+	}
+    }
+}
+
 ///
 ///	Save internals tables in a nice format.
 ///
@@ -2031,35 +3745,44 @@ void AOHKSaveTable(const char *file)
 	"//\tMERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the\n"
 	"//\tGNU General Public License for more details.\n" "//\n", file);
 
-    AOHKSaveConvertTable(fp, AOHKConvertTable);
+    AOHKSaveConvertTable(fp);
+    if (AOHKSet->Layout != OHLayoutUnknown) {
+	fprintf(fp, "\n//\tOutput keyboard layout\nlayout: %s\n",
+	    AOHKLayoutNames[AOHKSet->Layout]);
+    }
     fprintf(fp,
 	"\n//\tMapping of internal symbol sequences to keys\n" "mapping:\n");
 
+#define SaveTable(f, prefix, t) \
+    f(fp, prefix, AOHKSet->t, sizeof(AOHKSet->t) / sizeof(OHKey))
     fprintf(fp, "//\tnormal\n");
-    AOHKSaveMapping(fp, "", (unsigned char *)AOHKTable, sizeof(AOHKTable));
+    SaveTable(AOHKSaveMapping, "", Table);
     fprintf(fp, "//\tquote 0 key prefix\n");
-    AOHKSaveMapping(fp, "0", (unsigned char *)AOHKQuoteTable,
-	sizeof(AOHKQuoteTable));
+    SaveTable(AOHKSaveMapping, "0", QuoteTable);
     fprintf(fp, "//\tsuper 0# key prefix\n");
-    AOHKSaveMapping(fp, "0#", (unsigned char *)AOHKSuperTable,
-	sizeof(AOHKSuperTable));
+    SaveTable(AOHKSaveMapping, "0#", SuperTable);
     fprintf(fp, "//\tgame mode *# key prefix\n");
-    AOHKSaveGameTable(fp, "*#", (unsigned char *)AOHKGameTable,
-	sizeof(AOHKGameTable));
+    SaveTable(AOHKSaveGameTable, "*#", GameTable);
     fprintf(fp, "//\tquote game mode 0*# key prefix\n");
-    AOHKSaveGameTable(fp, "0*#", (unsigned char *)AOHKQuoteGameTable,
-	sizeof(AOHKQuoteGameTable));
+    SaveTable(AOHKSaveGameTable, "0*#", QuoteGameTable);
     fprintf(fp, "//\tnumber mode ** key prefix\n");
-    AOHKSaveGameTable(fp, "**", (unsigned char *)AOHKNumberTable,
-	sizeof(AOHKNumberTable));
+    SaveTable(AOHKSaveGameTable, "**", NumberTable);
 
     fprintf(fp, "//\tmacros * key prefix\nmacro:\n");
-    AOHKSaveMapping(fp, "*", (unsigned char *)AOHKMacroTable,
-	sizeof(AOHKMacroTable));
+    SaveTable(AOHKSaveMapping, "*", MacroTable);
 
     fprintf(fp, "//\tquoted macros *0 key prefix\n");
-    AOHKSaveMapping(fp, "*0", (unsigned char *)AOHKMacroQuoteTable,
-	sizeof(AOHKMacroQuoteTable));
+    SaveTable(AOHKSaveMapping, "*0", MacroQuoteTable);
+#undef SaveTable
+
+    AOHKSaveChordTable(fp);
+
+    if (AOHKSet->TrieN) {
+	char prefix[AOHK_TRIE_NODES];
+
+	fprintf(fp, "//\tsequences of any length\nsequence:\n");
+	AOHKSaveTrie(fp, 0, prefix, 0);
+    }
 
     if (strcmp(file, "-")) {		// !stdout
 	fclose(fp);
@@ -2103,6 +3826,24 @@ static int AOHKString2Key(const char *line, size_t l)
 	    return i;
 	}
     }
+    //
+    //	Extended names and hex numbers of all other keycodes.
+    //
+    for (i = 0; i < sizeof(AOHKKeyExtName) / sizeof(*AOHKKeyExtName); ++i) {
+	if (l == strlen(AOHKKeyExtName[i].Name)
+	    && !strncasecmp(line, AOHKKeyExtName[i].Name, l)) {
+	    return AOHKKeyExtName[i].Key;
+	}
+    }
+    if (l > 2 && !strncasecmp(line, "0x", 2)) {
+	char *e;
+	long key;
+
+	key = strtol(line, &e, 16);
+	if (e == line + l && key > 0 && key <= KEY_MAX) {
+	    return key;
+	}
+    }
     return KEY_RESERVED;
 }
 
@@ -2181,8 +3922,8 @@ static void AOHKParseConvert(char *line)
 
     Debug(4, "Key %d -> %d\n", key, internal);
 
-    if (key > 0 && (unsigned)key < sizeof(AOHKConvertTable)) {
-	AOHKConvertTable[key] = internal;
+    if (key > 0 && key <= KEY_MAX) {
+	AOHKSetConvert(key, internal);
     } else {
 	Debug(0, "Key %d out of range\n", key);
     }
@@ -2273,12 +4014,15 @@ static void AOHKParseOutput(int linenr, char *line, OHKey * out)
 	}
 	modifier = TONUM;
 	goto next;
+    } else if (l == sizeof("tomouse") - 1
+	&& !strncasecmp(line, "tomouse", sizeof("tomouse") - 1)) {
+	modifier = TOMOUSE;
     } else if (l == sizeof("special") - 1
 	&& !strncasecmp(line, "special", sizeof("special") - 1)) {
 	modifier = SPECIAL;
     } else if (l == sizeof("reserved") - 1
 	&& !strncasecmp(line, "reserved", sizeof("reserved") - 1)) {
-	modifier = 0;
+	key = KEY_RESERVED;
     } else if (l) {
 	i = AOHKString2Key(line, l);
 	if (i == KEY_RESERVED) {	// Still not found giving up.
@@ -2348,16 +4092,18 @@ static void AOHKParseOutput(int linenr, char *line, OHKey * out)
 }
 
 ///
-///	Parse mapping line.
-///
-///	[internal key sequence] -> [output key sequence]
+///	Lookup the entry of an internal key sequence.
 ///
+///	@param set	table set
 ///	@param linenr	current line number for errors
-///	@param line	pointer into current line
+///	@param line	internal key sequence, ends at white space
 ///
-static void AOHKParseMapping(int linenr, char *line)
+///	@returns entry of the sequence in @a set, NULL unsupported sequence.
+///
+static const OHKey *AOHKMappingKey(const OHTableSet * set, int linenr,
+    const char *line)
 {
-    char *s;
+    const char *s;
     int internal;
     size_t l;
     int macro;
@@ -2368,9 +4114,6 @@ static void AOHKParseMapping(int linenr, char *line)
     quote = 0;
     super = 0;
 
-    //
-    //	Get input key code
-    //
     for (s = line; *s && !isspace(*s); ++s) {
     }
     l = s - line;
@@ -2380,33 +4123,30 @@ static void AOHKParseMapping(int linenr, char *line)
 	internal = AOHKString2Internal(line + 3, l - 3);
 	if (internal == -1) {
 	    Debug(0, "Key '%s' not found\n", line);
-	    return;
+	    return NULL;
 	}
 	Debug(4, "Quoted game mode: %d\n", internal);
-	AOHKParseOutput(linenr, s, AOHKQuoteGameTable + internal);
-	return;
+	return set->QuoteGameTable + internal;
     }
     // Game mode '*#' internal key name
     if (line[0] == '*' && line[1] == '#') {
 	internal = AOHKString2Internal(line + 2, l - 2);
 	if (internal == -1) {
 	    Debug(0, "Key '%s' not found\n", line);
-	    return;
+	    return NULL;
 	}
 	Debug(4, "Game mode: %d\n", internal);
-	AOHKParseOutput(linenr, s, AOHKGameTable + internal);
-	return;
+	return set->GameTable + internal;
     }
     // Number mode '**' internal key name
     if (line[0] == '*' && line[1] == '*') {
 	internal = AOHKString2Internal(line + 2, l - 2);
 	if (internal == -1) {
 	    Debug(0, "Key '%s' not found\n", line);
-	    return;
+	    return NULL;
 	}
 	Debug(4, "Number mode: %d\n", internal);
-	AOHKParseOutput(linenr, s, AOHKNumberTable + internal);
-	return;
+	return set->NumberTable + internal;
     }
     // Macro key '*'
     if (line[0] == '*') {
@@ -2463,38 +4203,185 @@ static void AOHKParseMapping(int linenr, char *line)
 	    internal = STAR_START + line[0] - '0';
 	} else {
 	    Debug(0, "%d: Illegal internal key '%s'\n", linenr, line);
-	    return;
+	    return NULL;
+	}
+	goto parseon;
+    }
+
+    if (l == 4 && line[0] == 'U' && line[1] == 'S' && line[2] == 'R') {
+	if (line[3] < '1' || line[3] > '8') {
+	    Debug(0, "Key '%s' not found\n", line);
+	    return NULL;
 	}
+	internal = USR_START + line[3] - '1';
 	goto parseon;
     }
 
-    if (l == 4 && line[0] == 'U' && line[1] == 'S' && line[2] == 'R') {
-	if (line[3] < '1' || line[3] > '8') {
-	    Debug(0, "Key '%s' not found\n", line);
+    Debug(0, "%d: Unsupported internal key sequence: %s\n", linenr, line);
+    return NULL;
+
+  parseon:
+    Debug(4, "Key %d\n", internal);
+    if (macro && quote) {
+	return set->MacroQuoteTable + internal;
+    }
+    if (macro && super) {
+	Debug(0, "Macro + super not supported\n");
+	return NULL;
+    }
+    if (macro) {
+	return set->MacroTable + internal;
+    }
+    if (super) {
+	return set->SuperTable + internal;
+    }
+    if (quote) {
+	return set->QuoteTable + internal;
+    }
+    return set->Table + internal;
+}
+
+///
+///	Parse mapping line.
+///
+///	[internal key sequence] -> [output key sequence]
+///
+///	@param linenr	current line number for errors
+///	@param line	pointer into current line
+///
+static void AOHKParseMapping(int linenr, char *line)
+{
+    const OHKey *key;
+    char *s;
+
+    if (!(key = AOHKMappingKey(&AOHKUserSet, linenr, line))) {
+	return;
+    }
+    for (s = line; *s && !isspace(*s); ++s) {
+    }
+    // the user set isn't const, only the lookup is shared
+    AOHKParseOutput(linenr, s, (OHKey *) key);
+}
+
+///
+///	Parse chord line.
+///
+///	[two keys pressed together] -> [output key sequence]
+///
+///	@param linenr	current line number for errors
+///	@param line	pointer into current line
+///
+static void AOHKParseChord(int linenr, char *line)
+{
+    int a;
+    int b;
+
+    a = line[0] - '0';
+    b = line[1] - '0';
+    if (a < AOHK_KEY_1 || a > AOHK_KEY_9 || b < AOHK_KEY_1 || b > AOHK_KEY_9
+	|| a == b || (line[2] && !isspace(line[2]))) {
+	Debug(0, "%d: Illegal chord '%s'\n", linenr, line);
+	return;
+    }
+    if (a > b) {
+	int t;
+
+	t = a;
+	a = b;
+	b = t;
+    }
+    Debug(4, "Chord %d+%d\n", a, b);
+    AOHKParseOutput(linenr, line + 2,
+	AOHKUserSet.ChordTable + (a - AOHK_KEY_1) * 9 + b - AOHK_KEY_1);
+}
+
+///
+///	Parse sequence line.
+///
+///	[internal key sequence of any length] -> [output key sequence]
+///
+///	The sequences must be prefix free, a sequence can't be the start of
+///	another.
+///
+///	@param linenr	current line number for errors
+///	@param line	pointer into current line
+///
+static void AOHKParseSequence(int linenr, char *line)
+{
+    char *s;
+    int node;
+    int key;
+    int child;
+
+    if (*line < '1' || *line > '9') {
+	Debug(0, "%d: Sequence must start with 1-9 '%s'\n", linenr, line);
+	return;
+    }
+    if (!AOHKUserSet.TrieN) {		// root
+	AOHKUserSet.TrieN = 1;
+    }
+    node = 0;
+    for (s = line; *s && !isspace(*s); ++s) {
+	key = AOHKString2Internal(s, 1);
+	if (key < 0 || key >= AOHK_TRIE_KEYS) {
+	    Debug(0, "%d: Illegal internal key '%c'\n", linenr, *s);
 	    return;
 	}
-	internal = USR_START + line[3] - '1';
-	goto parseon;
+	if ((child = AOHKUserSet.Trie[node].Child[key])) {
+	    // existing shorter sequence is start of this
+	    if (s[1] && !isspace(s[1])
+		&& AOHKTrieLeaf(&AOHKUserSet.Trie[child])) {
+		Debug(0, "%d: Sequence '%.*s' is already mapped\n", linenr,
+		    (int)(s - line + 1), line);
+		return;
+	    }
+	} else {
+	    if (AOHKUserSet.TrieN == AOHK_TRIE_NODES) {
+		Debug(0, "%d: Too many sequences\n", linenr);
+		return;
+	    }
+	    child = AOHKUserSet.TrieN++;
+	    AOHKUserSet.Trie[node].Child[key] = child;
+	    AOHKUserSet.Trie[child].Key.Modifier = RESET;
+	    AOHKUserSet.Trie[child].Key.KeyCode = KEY_RESERVED;
+	}
+	node = child;
     }
+    if (!AOHKTrieLeaf(&AOHKUserSet.Trie[node])) {
+	Debug(0, "%d: Sequence '%.*s' is start of longer sequence\n",
+	    linenr, (int)(s - line), line);
+	return;
+    }
+    Debug(4, "Sequence %.*s\n", (int)(s - line), line);
+    AOHKParseOutput(linenr, s, &AOHKUserSet.Trie[node].Key);
+}
 
-    Debug(0, "%d: Unsupported internal key sequence: %s\n", linenr, line);
-    return;
+///
+///	Parse layout line.
+///
+///	layout: [qwerty|qwertz|unknown]
+///
+///	@param linenr	current line number for errors
+///	@param line	pointer behind layout:
+///
+static void AOHKParseLayout(int linenr, char *line)
+{
+    char *s;
+    size_t i;
 
-  parseon:
-    Debug(4, "Key %d\n", internal);
-    if (macro && quote) {
-	AOHKParseOutput(linenr, s, AOHKMacroQuoteTable + internal);
-    } else if (macro && super) {
-	Debug(0, "Macro + super not supported\n");
-    } else if (macro) {
-	AOHKParseOutput(linenr, s, AOHKMacroTable + internal);
-    } else if (super) {
-	AOHKParseOutput(linenr, s, AOHKSuperTable + internal);
-    } else if (quote) {
-	AOHKParseOutput(linenr, s, AOHKQuoteTable + internal);
-    } else {
-	AOHKParseOutput(linenr, s, AOHKTable + internal);
+    for (; *line && isspace(*line); ++line) {
+    }
+    for (s = line; *s && !isspace(*s); ++s) {
+    }
+    for (i = 0; i < sizeof(AOHKLayoutNames) / sizeof(*AOHKLayoutNames); ++i) {
+	if ((size_t)(s - line) == strlen(AOHKLayoutNames[i])
+	    && !strncasecmp(line, AOHKLayoutNames[i], s - line)) {
+	    AOHKUserSet.Layout = i;
+	    AOHKIsJunk(linenr, s);
+	    return;
+	}
     }
+    Debug(0, "%d: Unknown layout '%s'\n", linenr, line);
 }
 
 ///
@@ -2509,8 +4396,9 @@ void AOHKLoadTable(const char *file)
     char *s;
     char *line;
     int linenr;
+    int sections;
     enum
-    { Nothing, Convert, Mapping, Macro } state;
+    { Nothing, Convert, Mapping, Macro, Chord, Sequence } state;
 
     Debug(2, "Load keymap '%s'\n", file);
 
@@ -2520,6 +4408,17 @@ void AOHKLoadTable(const char *file)
 	Debug(0, "Can't open load file '%s'\n", file);
 	return;
     }
+    //
+    //	Compiled table sets are const, modify a copy.
+    //
+    if (AOHKSet != &AOHKUserSet) {
+	memcpy(&AOHKUserSet, AOHKSet, sizeof(AOHKUserSet));
+	AOHKSet = &AOHKUserSet;
+	if (AOHKResidentN) {		// modified set stays resident
+	    AOHKResident[AOHKResidentIdx] = AOHKSet;
+	}
+    }
+    sections = 0;
 
     linenr = 0;
     state = Nothing;
@@ -2567,6 +4466,7 @@ void AOHKLoadTable(const char *file)
 	if (!strncasecmp(line, "mapping:", sizeof("mapping:") - 1)) {
 	    Debug(5, "'%s'\n", line);
 	    state = Mapping;
+	    sections |= 1 << Mapping;
 	    AOHKResetMappingTable();
 	    AOHKIsJunk(linenr, line + sizeof("mapping:") - 1);
 	    continue;
@@ -2574,14 +4474,34 @@ void AOHKLoadTable(const char *file)
 	if (!strncasecmp(line, "macro:", sizeof("macro:") - 1)) {
 	    Debug(5, "'%s'\n", line);
 	    state = Macro;
+	    sections |= 1 << Macro;
 	    AOHKResetMacroTable();
 	    AOHKIsJunk(linenr, line + sizeof("macro:") - 1);
 	    continue;
 	}
+	if (!strncasecmp(line, "chord:", sizeof("chord:") - 1)) {
+	    Debug(5, "'%s'\n", line);
+	    state = Chord;
+	    AOHKResetChordTable();
+	    AOHKIsJunk(linenr, line + sizeof("chord:") - 1);
+	    continue;
+	}
+	if (!strncasecmp(line, "sequence:", sizeof("sequence:") - 1)) {
+	    Debug(5, "'%s'\n", line);
+	    state = Sequence;
+	    AOHKResetTrie();
+	    AOHKIsJunk(linenr, line + sizeof("sequence:") - 1);
+	    continue;
+	}
+	if (!strncasecmp(line, "layout:", sizeof("layout:") - 1)) {
+	    Debug(5, "'%s'\n", line);
+	    AOHKParseLayout(linenr, line + sizeof("layout:") - 1);
+	    continue;
+	}
 	switch (state) {
 	    case Nothing:
-		Debug(0, "%d: Need convert: or mapping: or macro: first\n",
-		    linenr);
+		Debug(0, "%d: Need convert: or mapping: or macro: or chord: "
+		    "or sequence: first\n", linenr);
 		break;
 	    case Convert:
 		AOHKParseConvert(line);
@@ -2590,12 +4510,24 @@ void AOHKLoadTable(const char *file)
 	    case Macro:
 		AOHKParseMapping(linenr, line);
 		break;
+	    case Chord:
+		AOHKParseChord(linenr, line);
+		break;
+	    case Sequence:
+		AOHKParseSequence(linenr, line);
+		break;
 	}
     }
 
     if (!linenr) {
 	Debug(1, "Empty file '%s'\n", file);
     }
+    //
+    //	New mapping without macros, derive them.
+    //
+    if ((sections & (1 << Mapping)) && !(sections & (1 << Macro))) {
+	AOHKDeriveMacroTables();
+    }
 
     if (strcmp(file, "-")) {		// !stdin
 	fclose(fp);
@@ -2603,670 +4535,463 @@ void AOHKLoadTable(const char *file)
 }
 
 //----------------------------------------------------------------------------
-//	Default Keymaps.
+//	Table sets
 //----------------------------------------------------------------------------
 
 ///
-///	American keyboard layout default mapping.
+///	Save table as C initializer.
 ///
-static const OHKey AOHKUsTable[11 * 10 + 1 + 8] = {
-//	*INDENT-OFF*
-/*10*/ { QUOTE,		KEY_RESERVED },	// QUOTE
-/*11*/ { 0,		KEY_1	},	// 1
-/*12*/ { 0,		KEY_I	},	// i
-/*13*/ { 0,		KEY_W	},	// w
-/*14*/ { SHIFT,		KEY_GRAVE },	// ~
-/*15*/ { 0,		KEY_R	},	// r
-/*16*/ { 0,		KEY_V	},	// v
-/*17*/ { 0,		KEY_A	},	// NO: 
-/*18*/ { 0,		KEY_D	},	// d
-/*19*/ { RESET,		KEY_RESERVED },	// (FREE)
-/*20*/ { QUOTE,		KEY_RESERVED },	// QUOTE
-/*21*/ { 0,		KEY_ENTER },	// Return
-/*22*/ { 0,		KEY_2	},	// 2
-/*23*/ { 0,		KEY_DOT	},	// .
-/*24*/ { QUAL,		Q_CTRL_L },	// Control_L
-/*25*/ { SHIFT,		KEY_6 },	// ^
-/*26*/ { 0,		KEY_MINUS },	// -
-/*27*/ { 0,		KEY_COMMA },	// ,
-/*28*/ { 0,		KEY_O },	// NO: 
-/*29*/ { SHIFT,		KEY_1	},	// !
-/*30*/ { QUOTE,		KEY_RESERVED },	// QUOTE
-/*31*/ { 0,		KEY_Q	},	// q
-/*32*/ { 0,		KEY_L	},	// l
-/*33*/ { 0,		KEY_3	},	// 3
-/*34*/ { SHIFT,		KEY_APOSTROPHE },// "
-/*35*/ { 0,		KEY_M	},	// m
-/*36*/ { SHIFT,		KEY_COMMA },	// <
-/*37*/ { 0,		KEY_APOSTROPHE },// '
-/*38*/ { 0,		KEY_F	},	// f
-/*39*/ { 0,		KEY_U	},	// NO: 
-/*40*/ { QUOTE,		KEY_RESERVED },	// QUOTE
-/*41*/ { SHIFT,		KEY_4	},	// $
-/*42*/ { 0,		KEY_A	},	// a
-/*43*/ { 0,		KEY_Y	},	// y
-/*44*/ { 0,		KEY_4	},	// 4
-/*45*/ { 0,		KEY_E	},	// e
-/*46*/ { 0,		KEY_K	},	// k
-/*47*/ { SHIFT,		KEY_5	},	// %
-/*48*/ { 0,		KEY_S	},	// s
-/*49*/ { 0,		KEY_X	},	// x
-/*50*/ { QUOTE,		KEY_RESERVED },	// QUOTE
-/*51*/ { QUAL,		Q_SHFT_L },	// Shift_L
-/*52*/ { 0,		KEY_BACKSLASH },// \ GNU idiotism
-/*53*/ { SHIFT,		KEY_9	},	// (
-/*54*/ { 0,		KEY_SPACE },	// Space
-/*55*/ { 0,		KEY_5	},	// 5
-/*56*/ { 0,		KEY_TAB	},	// Tabulator
-/*57*/ { QUAL,		Q_GUI_L },	// Gui_L
-/*58*/ { 0,		KEY_LEFTBRACE },// [
-/*59*/ { SHIFT,		KEY_0	},	// )
-/*60*/ { QUOTE,		KEY_RESERVED },	// QUOTE
-/*61*/ { SHIFT,		KEY_7	},	// &
-/*62*/ { 0,		KEY_B	},	// b
-/*63*/ { SHIFT,		KEY_DOT },	// >
-/*64*/ { SHIFT,		KEY_8 },	// *
-/*65*/ { 0,		KEY_O	},	// o
-/*66*/ { 0,		KEY_6	},	// 6
-/*67*/ { SHIFT,		KEY_EQUAL },	// +
-/*68*/ { 0,		KEY_U	},	// u
-/*69*/ { SHIFT,		KEY_LEFTBRACE },// {
-/*70*/ { QUOTE,		KEY_RESERVED },	// QUOTE
-/*71*/ { 0,		KEY_S },	// NO: 
-/*72*/ { 0,		KEY_H	},	// h
-/*73*/ { 0,		KEY_EQUAL },	// =
-/*74*/ { SHIFT,		KEY_SLASH },	// ?
-/*75*/ { 0,		KEY_T	},	// t
-/*76*/ { 0,		KEY_J	},	// j
-/*77*/ { 0,		KEY_7	},	// 7
-/*78*/ { 0,		KEY_N	},	// n
-/*79*/ { 0,		KEY_Z	},	// z
-/*80*/ { QUOTE,		KEY_RESERVED },	// QUOTE
-/*81*/ { 0,		KEY_SEMICOLON },// ;
-/*82*/ { SHIFT,		KEY_2	},	// @
-/*83*/ { SHIFT,		KEY_SEMICOLON },// :
-/*84*/ { QUAL,		Q_ALT_L	},	// Alt_L
-/*85*/ { 0,		KEY_RIGHTBRACE },// ]
-/*86*/ { SHIFT,		KEY_BACKSLASH },// |
-/*87*/ { 0,		KEY_BACKSPACE },// BackSpace
-/*88*/ { 0,		KEY_8	},	// 8
-/*89*/ { 0,		KEY_ESC	},	// Escape
-/*90*/ { QUOTE,		KEY_RESERVED },	// QUOTE
-/*91*/ { SHIFT,		KEY_3	 },	// #
-/*92*/ { 0,		KEY_P	},	// p
-/*93*/ { 0,		KEY_GRAVE },	// `
-/*94*/ { SHIFT,		KEY_MINUS },	// _
-/*95*/ { 0,		KEY_G	},	// g
-/*96*/ { SHIFT,		KEY_RIGHTBRACE },// }
-/*97*/ { 0,		KEY_SLASH },	// /
-/*98*/ { 0,		KEY_C	},	// c
-/*99*/ { 0,		KEY_9	},	// 9
-
-/*0#*/ { 0,		KEY_INSERT },	// INSERT
-/*1#*/ { 0,		KEY_END	},	// END
-/*2#*/ { 0,		KEY_DOWN },	// CURSOR-DOWN
-/*3#*/ { 0,		KEY_PAGEDOWN },	// PAGE-DOWN
-/*4#*/ { 0,		KEY_LEFT },	// CURSOR-LEFT
-/*5#*/ { 0,		KEY_DELETE },	// DELETE ( ,->5 )
-/*6#*/ { 0,		KEY_RIGHT },	// CURSOR-RIGHT
-/*7#*/ { 0,		KEY_HOME },	// HOME
-/*8#*/ { 0,		KEY_UP	},	// CURSOR-UP
-/*9#*/ { 0,		KEY_PAGEUP },	// PAGE-UP
-
-#if 0
-/*##*/ { 0,		KEY_RESERVED },	// Not possible! # is already repeat
-/**#*/ { 0,		TOGAME },	// ENTER GAME MODE
-#endif
-
-/*0**/ { RESET,		KEY_RESERVED },	// (FREE)
-/*1**/ { RESET,		KEY_RESERVED },	// (FREE)
-/*2**/ { RESET,		KEY_RESERVED },	// (FREE)
-/*3**/ { RESET,		KEY_RESERVED },	// (FREE)
-/*4**/ { RESET,		KEY_RESERVED },	// (FREE)
-/*5**/ { RESET,		KEY_RESERVED },	// (FREE)
-/*6**/ { RESET,		KEY_RESERVED },	// (FREE)
-/*7**/ { RESET,		KEY_RESERVED },	// (FREE)
-/*8**/ { RESET,		KEY_RESERVED },	// (FREE)
-/*9**/ { RESET,		KEY_RESERVED },	// (FREE)
-
-#if 0
-/*#**/ { 0,		KEY_RESERVED },	// Not possible! # is already repeat
-/****/ { 0,		TONUM },	// ENTER NUMBER MODE
-#endif
-
-/*00*/ { 0,		KEY_0	},	// 0
-
-/*USR1*/ { QUAL,	Q_SHFT_L },	// Shift_L
-/*USR2*/ { QUAL,	Q_CTRL_L },	// Ctrl_L
-/*USR3*/ { QUAL,	Q_ALT_L },	// Alt_L
-/*USR4*/ { QUAL,	Q_GUI_L },	// Gui_L
-/*USR5*/ { QUAL,	Q_SHFT_R },	// Shift_R
-/*USR6*/ { QUAL,	Q_CTRL_R },	// Ctrl_R
-/*USR7*/ { QUAL,	Q_ALT_R },	// Alt_R
-/*USR8*/ { QUAL,	Q_GUI_R },	// Gui_R
+///	@param fp	output file stream
+///	@param t	output key table
+///	@param n	number of entries in table
+///
+static void AOHKSaveCKeys(FILE * fp, const OHKey * t, int n)
+{
+    int i;
 
-// FIXME: Should I move game mode table to here?
-//	*INDENT-ON*
-};
+    fprintf(fp, "    {");
+    for (i = 0; i < n; ++i) {
+	fprintf(fp, "%s{%d, %d}", i % 8 ? " " : "\n\t", t[i].Modifier,
+	    t[i].KeyCode);
+	if (i != n - 1) {
+	    fprintf(fp, ",");
+	}
+    }
+    fprintf(fp, "},\n");
+}
 
 ///
-///	American keyboard layout default quote mapping.
+///	Save user table set as C table set.
 ///
-static const OHKey AOHKUsQuoteTable[11 * 10 + 1 + 8] = {
-//	*INDENT-OFF*
-/*010*/ { RESET,	KEY_RESERVED },	// RESET
-/*011*/ { 0,		KEY_F1	},	// F1
-/*012*/ { SHIFT,	KEY_I	},	// I
-/*013*/ { SHIFT,	KEY_W	},	// W
-/*014*/ { 0,		KEY_NUMLOCK },	// NUM-LOCK
-/*015*/ { SHIFT,	KEY_R	},	// R
-/*016*/ { SHIFT,	KEY_V	},	// V
-/*017*/ { SHIFT,	KEY_A	},	// NO: 
-/*018*/ { SHIFT,	KEY_D	},	// D
-/*019*/ { RESET,	KEY_RESERVED },	// (FREE)
-/*020*/ { RESET,	KEY_RESERVED },	// RESET
-/*021*/ { 0,		KEY_KPENTER },	// KP-ENTER
-/*022*/ { 0,		KEY_F2	},	// F2
-/*023*/ { 0,		KEY_KPDOT },	// KP-.
-/*024*/ { QUAL,		Q_CTRL_R },	// Control_R
-/*025*/ { 0,		KEY_CAPSLOCK },	// CAPS-LOCK
-/*026*/ { 0,		KEY_KPMINUS },	// KP--
-/*027*/ { 0,		KEY_KPDOT },	// KP-,
-/*028*/ { SHIFT,	KEY_O	},	// NO: 
-/*029*/ { 0,		KEY_KP0	},	// KP-0 (!no better place found)
-/*030*/ { RESET,	KEY_RESERVED },	// RESET
-/*031*/ { SHIFT,	KEY_Q	},	// Q
-/*032*/ { SHIFT,	KEY_L	},	// L
-/*033*/ { 0,		KEY_F3	},	// F3
-/*034*/ { 0,		KEY_8	},	// NO: 
-/*035*/ { SHIFT,	KEY_M	},	// M
-/*036*/ { 0,		KEY_SCROLLLOCK },// SCROLL-LOCK
-/*037*/ { 0,		KEY_APOSTROPHE },// ' (SHIFT #, doubled)
-/*038*/ { SHIFT,	KEY_F	},	// F
-/*039*/ { SHIFT,	KEY_U	},	// 
-/*040*/ { RESET,	KEY_RESERVED },	// RESET
-/*041*/ { 0,		KEY_0 },	// NO: 
-/*042*/ { SHIFT,	KEY_A	},	// A
-/*043*/ { SHIFT,	KEY_Y	},	// Y
-/*044*/ { 0,		KEY_F4	},	// F4
-/*045*/ { SHIFT,	KEY_E	},	// E
-/*046*/ { SHIFT,	KEY_K	},	// K
-/*047*/ { 0,		KEY_KPSLASH },	// KP-% (doubled)
-/*048*/ { SHIFT,	KEY_S	},	// S
-/*049*/ { SHIFT,	KEY_X	},	// X
-/*050*/ { RESET,	KEY_RESERVED },	// RESET
-/*051*/ { QUAL,		Q_SHFT_R },	// Shift_R
-/*052*/ { SHIFT,	KEY_BACKSLASH},	// | (QUOTE \, doubled)
-/*053*/ { RESET,	KEY_RESERVED },	// (FREE)
-/*054*/ { SHIFT,	KEY_SPACE },	// SHIFT Space
-/*055*/ { 0,		KEY_F5	},	// F5
-/*056*/ { SHIFT,	KEY_TAB	},	// SHIFT Tabulator
-/*057*/ { QUAL,		Q_GUI_R },	// Gui_R
-/*058*/ { SHIFT,	KEY_LEFTBRACE },// { (QUOTE [, doubled)
-/*059*/ { RESET,	KEY_RESERVED },	// (FREE)
-/*060*/ { RESET,	KEY_RESERVED },	// RESET
-/*061*/ { SHIFT,	KEY_E	},	// NO: 
-/*062*/ { SHIFT,	KEY_B	},	// B
-/*063*/ { SHIFT,	KEY_C	},	// NO: 
-/*064*/ { 0,		KEY_KPASTERISK },// KP-*
-/*065*/ { SHIFT,	KEY_O	},	// O
-/*066*/ { 0,		KEY_F6	},	// F6
-/*067*/ { 0,		KEY_KPPLUS },	// KP-+
-/*068*/ { SHIFT,	KEY_U	},	// U
-/*069*/ { RESET,	KEY_RESERVED },	// (FREE)
-/*070*/ { RESET,	KEY_RESERVED },	// RESET
-/*071*/ { 0,		KEY_SYSRQ },	// PRINT/SYSRQ
-/*072*/ { SHIFT,	KEY_H	},	// H
-/*073*/ { 0,		KEY_F10	},	// F10
-/*074*/ { 0,		KEY_F11	},	// F11
-/*075*/ { SHIFT,	KEY_T	},	// T
-/*076*/ { SHIFT,	KEY_J	},	// J
-/*077*/ { 0,		KEY_F7	},	// F7
-/*078*/ { SHIFT,	KEY_N	},	// N
-/*079*/ { SHIFT,	KEY_Z	},	// Z
-/*080*/ { RESET,	KEY_RESERVED },	// RESET
-/*081*/ { 0,		KEY_PAUSE },	// PAUSE
-/*082*/ { 0,		KEY_GRAVE },	// ` (QUOTE @, doubled)
-/*083*/ { CTL,		KEY_PAUSE },	// BREAK
-/*084*/ { QUAL,		Q_ALT_R	},	// Alt_R
-/*085*/ { SHIFT,	KEY_RIGHTBRACE },// } (QUOTE ], doubled)
-/*086*/ { ALT,		KEY_SYSRQ },	// SYSRQ
-/*087*/ { SHIFT,	KEY_BACKSPACE },// SHIFT BackSpace
-/*088*/ { 0,		KEY_F8	},	// F8
-/*089*/ { SHIFT,	KEY_ESC	},	// SHIFT Escape
-/*090*/ { RESET,	KEY_RESERVED },	// RESET
-/*091*/ { 0,		KEY_COMPOSE },	// MENU
-/*092*/ { SHIFT,	KEY_P	},	// P
-/*093*/ { 0,		KEY_F12	},	// F12
-/*094*/ { RESET,	KEY_RESERVED },	// (FREE)
-/*095*/ { SHIFT,	KEY_G	},	// G
-/*096*/ { SPECIAL,	KEY_RESERVED },	// ENTER SPECIAL MODE
-/*097*/ { 0,		KEY_KPSLASH },	// KP-/
-/*098*/ { SHIFT,	KEY_C	},	// C
-/*099*/ { 0,		KEY_F9	},	// F9
-
-/*00#*/ { 0,		KEY_RESERVED },	// Not possible! 00 is 0
-/*01#*/ { 0,		KEY_KP1	},	// KP-1
-/*02#*/ { 0,		KEY_KP2	},	// KP-2
-/*03#*/ { 0,		KEY_KP3	},	// KP-3
-/*04#*/ { 0,		KEY_KP4	},	// KP-4
-/*05#*/ { 0,		KEY_KP5 },	// KP-5
-/*06#*/ { 0,		KEY_KP6	},	// KP-6
-/*07#*/ { 0,		KEY_KP7	},	// KP-7
-/*08#*/ { 0,		KEY_KP8	},	// KP-8
-/*09#*/ { 0,		KEY_KP9	},	// KP-9
-
-/*00**/ { 0,		KEY_RESERVED },	// Not possible! 00 is 0
-/*01**/ { RESET,	KEY_RESERVED },	// (FREE)
-/*02**/ { RESET,	KEY_RESERVED },	// (FREE)
-/*03**/ { RESET,	KEY_RESERVED },	// (FREE)
-/*04**/ { RESET,	KEY_RESERVED },	// (FREE)
-/*05**/ { RESET,	KEY_RESERVED },	// (FREE)
-/*06**/ { RESET,	KEY_RESERVED },	// (FREE)
-/*07**/ { RESET,	KEY_RESERVED },	// (FREE)
-/*08**/ { RESET,	KEY_RESERVED },	// (FREE)
-/*09**/ { RESET,	KEY_RESERVED },	// (FREE)
-
-/*000*/ { 0,		KEY_RESERVED },	// Not possible! 00 is 0
-
-/*0USR1*/ { QUAL,	Q_SHFT_R },	// Shift_R
-/*0USR2*/ { QUAL,	Q_CTRL_R },	// Ctrl_R
-/*0USR3*/ { QUAL,	Q_ALT_R },	// Alt_R
-/*0USR4*/ { QUAL,	Q_GUI_R },	// Gui_R
-/*0USR5*/ { QUAL,	Q_SHFT_L },	// Shift_L
-/*0USR6*/ { QUAL,	Q_CTRL_L },	// Ctrl_L
-/*0USR7*/ { QUAL,	Q_ALT_L },	// Alt_L
-/*0USR8*/ { QUAL,	Q_GUI_L },	// Gui_L
-//	*INDENT-ON*
-};
+///	@param fp	output file stream
+///	@param name	language name of table set
+///	@param file	mapping file name of table set
+///
+static void AOHKSaveCTable(FILE * fp, const char *name, const char *file)
+{
+    int i;
+    int j;
+
+    fprintf(fp, "\n///\n///\tCompiled table set from %s.\n///\n", file);
+    fprintf(fp, "static const OHTableSet AOHKSet_%s = {\n", name);
+    fprintf(fp, "    \"%s\",\n", name);
+    fprintf(fp, "    %d,\n", AOHKUserSet.Layout);
+#define CKeys(t) \
+    AOHKSaveCKeys(fp, AOHKUserSet.t, sizeof(AOHKUserSet.t) / sizeof(OHKey))
+    CKeys(Table);
+    CKeys(QuoteTable);
+    CKeys(SuperTable);
+    CKeys(GameTable);
+    CKeys(QuoteGameTable);
+    CKeys(NumberTable);
+    CKeys(MacroTable);
+    CKeys(MacroQuoteTable);
+    CKeys(ChordTable);
+#undef CKeys
+
+    //	used trie nodes, at least the root
+    fprintf(fp, "    %d,\n    {", AOHKUserSet.TrieN);
+    for (i = 0; i < AOHKUserSet.TrieN || !i; ++i) {
+	const OHTrieNode *t;
+
+	t = &AOHKUserSet.Trie[i];
+	fprintf(fp, "\n\t{{");
+	for (j = 0; j < AOHK_TRIE_KEYS; ++j) {
+	    fprintf(fp, "%s%d", j ? ", " : "", t->Child[j]);
+	}
+	fprintf(fp, "}, {%d, %d}}%s", t->Key.Modifier, t->Key.KeyCode,
+	    i < AOHKUserSet.TrieN - 1 ? "," : "");
+    }
+    fprintf(fp, "},\n");
+    fprintf(fp, "};\n");
+}
 
 ///
-///	German keyboard layout default mapping.
+///	Compile mapping files into C table sets.
 ///
-static const OHKey AOHKDeTable[11 * 10 + 1 + 8] = {
-//	*INDENT-OFF*
-/*10*/ { QUOTE,		KEY_RESERVED },	// QUOTE
-/*11*/ { 0,		KEY_1	},	// 1
-/*12*/ { 0,		KEY_I	},	// i
-/*13*/ { 0,		KEY_W	},	// w
-/*14*/ { ALTGR,		KEY_RIGHTBRACE },// ~
-/*15*/ { 0,		KEY_R	},	// r
-/*16*/ { 0,		KEY_V	},	// v
-/*17*/ { 0,		KEY_APOSTROPHE },// 
-/*18*/ { 0,		KEY_D	},	// d
-//*19*/ { RESET,		KEY_RESERVED },	// (FREE)
-/*19*/ { MACRO,		0 },		// macro test
-/*20*/ { QUOTE,		KEY_RESERVED },	// QUOTE
-/*21*/ { 0,		KEY_ENTER },	// Return
-/*22*/ { 0,		KEY_2	},	// 2
-/*23*/ { 0,		KEY_DOT	},	// .
-/*24*/ { QUAL,		Q_CTRL_L },	// Control_L
-/*25*/ { 0,		KEY_GRAVE },	// ^
-/*26*/ { 0,		KEY_SLASH },	// -
-/*27*/ { 0,		KEY_COMMA },	// ,
-/*28*/ { 0,		KEY_SEMICOLON },// 
-/*29*/ { SHIFT,		KEY_1	},	// !
-/*30*/ { QUOTE,		KEY_RESERVED },	// QUOTE
-/*31*/ { 0,		KEY_Q	},	// q
-/*32*/ { 0,		KEY_L	},	// l
-/*33*/ { 0,		KEY_3	},	// 3
-/*34*/ { SHIFT,		KEY_2	},	// "
-/*35*/ { 0,		KEY_M	},	// m
-/*36*/ { 0,		KEY_102ND },	// <
-/*37*/ { 0,		KEY_EQUAL },	// '
-/*38*/ { 0,		KEY_F	},	// f
-/*39*/ { 0,		KEY_LEFTBRACE },// 
-/*40*/ { QUOTE,		KEY_RESERVED },	// QUOTE
-/*41*/ { SHIFT,		KEY_4	},	// $
-/*42*/ { 0,		KEY_A	},	// a
-/*43*/ { 0,		KEY_Z	},	// y
-/*44*/ { 0,		KEY_4	},	// 4
-/*45*/ { 0,		KEY_E	},	// e
-/*46*/ { 0,		KEY_K	},	// k
-/*47*/ { SHIFT,		KEY_5	},	// %
-/*48*/ { 0,		KEY_S	},	// s
-/*49*/ { 0,		KEY_X	},	// x
-/*50*/ { QUOTE,		KEY_RESERVED },	// QUOTE
-/*51*/ { QUAL,		Q_SHFT_L },	// Shift_L
-/*52*/ { ALTGR,		KEY_MINUS },	// \ FUCK GNU (gcc >2.95.4 broken)
-/*53*/ { SHIFT,		KEY_8	},	// (
-/*54*/ { 0,		KEY_SPACE },	// Space
-/*55*/ { 0,		KEY_5	},	// 5
-/*56*/ { 0,		KEY_TAB	},	// Tabulator
-/*57*/ { QUAL,		Q_GUI_L },	// Gui_L
-/*58*/ { ALTGR,		KEY_8	},	// [
-/*59*/ { SHIFT,		KEY_9	},	// )
-/*60*/ { QUOTE,		KEY_RESERVED },	// QUOTE
-/*61*/ { SHIFT,		KEY_6	},	// &
-/*62*/ { 0,		KEY_B	},	// b
-/*63*/ { SHIFT,		KEY_102ND },	// >
-/*64*/ { SHIFT,		KEY_RIGHTBRACE },// *
-/*65*/ { 0,		KEY_O	},	// o
-/*66*/ { 0,		KEY_6	},	// 6
-/*67*/ { 0,		KEY_RIGHTBRACE },// +
-/*68*/ { 0,		KEY_U	},	// u
-/*69*/ { ALTGR,		KEY_7	},	// {
-/*70*/ { QUOTE,		KEY_RESERVED },	// QUOTE
-/*71*/ { 0,		KEY_MINUS },	// 
-/*72*/ { 0,		KEY_H	},	// h
-/*73*/ { SHIFT,		KEY_0	},	// =
-/*74*/ { SHIFT,		KEY_MINUS },	// ?
-/*75*/ { 0,		KEY_T	},	// t
-/*76*/ { 0,		KEY_J	},	// j
-/*77*/ { 0,		KEY_7	},	// 7
-/*78*/ { 0,		KEY_N	},	// n
-/*79*/ { 0,		KEY_Y	},	// z
-/*80*/ { QUOTE,		KEY_RESERVED },	// QUOTE
-/*81*/ { SHIFT,		KEY_COMMA },	// ;
-/*82*/ { ALTGR,		KEY_Q	},	// @
-/*83*/ { SHIFT,		KEY_DOT	},	// :
-/*84*/ { QUAL,		Q_ALT_L	},	// Alt_L
-/*85*/ { ALTGR,		KEY_9	},	// ]
-/*86*/ { ALTGR,		KEY_102ND },	// |
-/*87*/ { 0,		KEY_BACKSPACE },// BackSpace
-/*88*/ { 0,		KEY_8	},	// 8
-/*89*/ { 0,		KEY_ESC	},	// Escape
-/*90*/ { QUOTE,		KEY_RESERVED },	// QUOTE
-/*91*/ { 0,		KEY_BACKSLASH },// #
-/*92*/ { 0,		KEY_P	},	// p
-/*93*/ { SHIFT,		KEY_EQUAL },	// `
-/*94*/ { SHIFT,		KEY_SLASH },	// _
-/*95*/ { 0,		KEY_G	},	// g
-/*96*/ { ALTGR,		KEY_0	},	// }
-/*97*/ { SHIFT,		KEY_7	},	// /
-/*98*/ { 0,		KEY_C	},	// c
-/*99*/ { 0,		KEY_9	},	// 9
-// 9 * 10
-/*0#*/ { 0,		KEY_INSERT },	// INSERT
-/*1#*/ { 0,		KEY_END	},	// END
-/*2#*/ { 0,		KEY_DOWN },	// CURSOR-DOWN
-/*3#*/ { 0,		KEY_PAGEDOWN },	// PAGE-DOWN
-/*4#*/ { 0,		KEY_LEFT },	// CURSOR-LEFT
-/*5#*/ { 0,		KEY_DELETE },	// DELETE ( ,->5 )
-/*6#*/ { 0,		KEY_RIGHT },	// CURSOR-RIGHT
-/*7#*/ { 0,		KEY_HOME },	// HOME
-/*8#*/ { 0,		KEY_UP	},	// CURSOR-UP
-/*9#*/ { 0,		KEY_PAGEUP },	// PAGE-UP
-// 10 * 10
-/*0**/ { TONUM,		KEY_KP0 },	// (FREE)
-/*1**/ { TONUM,		KEY_KP1 },	// (FREE)
-/*2**/ { TONUM,		KEY_KP2 },	// (FREE)
-/*3**/ { TONUM,		KEY_KP3 },	// (FREE)
-/*4**/ { TONUM,		KEY_KP4 },	// (FREE)
-/*5**/ { TONUM,		KEY_KP5 },	// (FREE)
-/*6**/ { TONUM,		KEY_KP6 },	// (FREE)
-/*7**/ { TONUM,		KEY_KP7 },	// (FREE)
-/*8**/ { TONUM,		KEY_KP8 },	// (FREE)
-/*9**/ { TONUM,		KEY_KP9 },	// (FREE)
-// 11 * 10
-/*00*/ { 0,		KEY_0	},	// 0
-// 11 * 10 + 1
-/*USR1*/ { QUAL,	Q_SHFT_L },	// Shift_L
-/*USR2*/ { QUAL,	Q_CTRL_L },	// Ctrl_L
-/*USR3*/ { QUAL,	Q_ALT_L },	// Alt_L
-/*USR4*/ { QUAL,	Q_GUI_L },	// Gui_L
-/*USR5*/ { QUAL,	Q_SHFT_R },	// Shift_R
-/*USR6*/ { QUAL,	Q_CTRL_R },	// Ctrl_R
-/*USR7*/ { QUAL,	Q_ALT_R },	// Alt_R
-/*USR8*/ { QUAL,	Q_GUI_R },	// Gui_R
-
-// FIXME: Should I move game mode table to here?
-//	*INDENT-ON*
-};
-
+///	Each mapping file is loaded into an empty table set and written
+///	as const C table set.  The language name is the file name up to the
+///	first '.'.  Tables without a section in the mapping file are derived
+///	like the compiled sets always were.
 ///
-///	German keyboard layout default quote mapping.
+///	@param file	output file name, - for stdout
+///	@param n	number of mapping files
+///	@param maps	mapping file names
 ///
-static const OHKey AOHKDeQuoteTable[11 * 10 + 1 + 8] = {
-//	*INDENT-OFF*
-/*010*/ { RESET,	KEY_RESERVED },	// RESET
-/*011*/ { 0,		KEY_F1	},	// F1
-/*012*/ { SHIFT,	KEY_I	},	// I
-/*013*/ { SHIFT,	KEY_W	},	// W
-/*014*/ { 0,		KEY_NUMLOCK },	// NUM-LOCK
-/*015*/ { SHIFT,	KEY_R	},	// R
-/*016*/ { SHIFT,	KEY_V	},	// V
-/*017*/ { SHIFT,	KEY_APOSTROPHE },// 
-/*018*/ { SHIFT,	KEY_D	},	// D
-/*019*/ { RESET,	KEY_RESERVED },	// (FREE)
-/*020*/ { RESET,	KEY_RESERVED },	// RESET
-/*021*/ { 0,		KEY_KPENTER },	// KP-ENTER
-/*022*/ { 0,		KEY_F2	},	// F2
-/*023*/ { 0,		KEY_KPDOT },	// KP-.
-/*024*/ { QUAL,		Q_CTRL_R },	// Control_R
-/*025*/ { 0,		KEY_CAPSLOCK },	// CAPS-LOCK
-/*026*/ { 0,		KEY_KPMINUS },	// KP--
-/*027*/ { 0,		KEY_KPDOT },	// KP-,
-/*028*/ { SHIFT,	KEY_SEMICOLON },// 
-/*029*/ { 0,		KEY_KP0	},	// KP-0 (!no better place found)
-/*030*/ { RESET,	KEY_RESERVED },	// RESET
-/*031*/ { SHIFT,	KEY_Q	},	// Q
-/*032*/ { SHIFT,	KEY_L	},	// L
-/*033*/ { 0,		KEY_F3	},	// F3
-/*034*/ { SHIFT,	KEY_3	},	// 
-/*035*/ { SHIFT,	KEY_M	},	// M
-/*036*/ { 0,		KEY_SCROLLLOCK },// SCROLL-LOCK
-/*037*/ { 0,		KEY_BACKSLASH },// ' (SHIFT #, doubled)
-/*038*/ { SHIFT,	KEY_F	},	// F
-/*039*/ { SHIFT,	KEY_LEFTBRACE },// 
-/*040*/ { RESET,	KEY_RESERVED },	// RESET
-/*041*/ { SHIFT,	KEY_GRAVE },	// 
-/*042*/ { SHIFT,	KEY_A	},	// A
-/*043*/ { SHIFT,	KEY_Z	},	// Y
-/*044*/ { 0,		KEY_F4	},	// F4
-/*045*/ { SHIFT,	KEY_E	},	// E
-/*046*/ { SHIFT,	KEY_K	},	// K
-/*047*/ { 0,		KEY_KPSLASH },	// KP-% (doubled)
-/*048*/ { SHIFT,	KEY_S	},	// S
-/*049*/ { SHIFT,	KEY_X	},	// X
-/*050*/ { RESET,	KEY_RESERVED },	// RESET
-/*051*/ { QUAL,		Q_SHFT_R },	// Shift_R
-/*052*/ { ALTGR,	KEY_102ND },	// | (QUOTE \, doubled)
-/*053*/ { RESET,	KEY_RESERVED },	// (FREE)
-/*054*/ { SHIFT,	KEY_SPACE },	// SHIFT Space
-/*055*/ { 0,		KEY_F5	},	// F5
-/*056*/ { SHIFT,	KEY_TAB	},	// SHIFT Tabulator
-/*057*/ { QUAL,		Q_GUI_R },	// Gui_R
-/*058*/ { ALTGR,	KEY_6	},	// { (QUOTE [, doubled)
-/*059*/ { RESET,	KEY_RESERVED },	// (FREE)
-/*060*/ { RESET,	KEY_RESERVED },	// RESET
-/*061*/ { ALTGR,	KEY_E	},	// 
-/*062*/ { SHIFT,	KEY_B	},	// B
-/*063*/ { ALTGR,	KEY_C	},	// 
-/*064*/ { 0,		KEY_KPASTERISK },// KP-*
-/*065*/ { SHIFT,	KEY_O	},	// O
-/*066*/ { 0,		KEY_F6	},	// F6
-/*067*/ { 0,		KEY_KPPLUS },	// KP-+
-/*068*/ { SHIFT,	KEY_U	},	// U
-/*069*/ { RESET,	KEY_RESERVED },	// (FREE)
-/*070*/ { RESET,	KEY_RESERVED },	// RESET
-/*071*/ { 0,		KEY_SYSRQ },	// PRINT/SYSRQ
-/*072*/ { SHIFT,	KEY_H	},	// H
-/*073*/ { 0,		KEY_F10	},	// F10
-/*074*/ { 0,		KEY_F11	},	// F11
-/*075*/ { SHIFT,	KEY_T	},	// T
-/*076*/ { SHIFT,	KEY_J	},	// J
-/*077*/ { 0,		KEY_F7	},	// F7
-/*078*/ { SHIFT,	KEY_N	},	// N
-/*079*/ { SHIFT,	KEY_Y	},	// Z
-/*080*/ { RESET,	KEY_RESERVED },	// RESET
-/*081*/ { 0,		KEY_PAUSE },	// PAUSE
-/*082*/ { SHIFT,	KEY_EQUAL },	// ` (QUOTE @, doubled)
-/*083*/ { CTL,		KEY_PAUSE },	// BREAK
-/*084*/ { QUAL,		Q_ALT_R	},	// Alt_R
-/*085*/ { ALTGR,	KEY_0	},	// } (QUOTE ], doubled)
-/*086*/ { ALT,		KEY_SYSRQ },	// SYSRQ
-/*087*/ { SHIFT,	KEY_BACKSPACE },// SHIFT BackSpace
-/*088*/ { 0,		KEY_F8	},	// F8
-/*089*/ { SHIFT,	KEY_ESC	},	// SHIFT Escape
-/*090*/ { RESET,	KEY_RESERVED },	// RESET
-/*091*/ { 0,		KEY_COMPOSE },	// MENU
-/*092*/ { SHIFT,	KEY_P	},	// P
-/*093*/ { 0,		KEY_F12	},	// F12
-/*094*/ { RESET,	KEY_RESERVED },	// (FREE)
-/*095*/ { SHIFT,	KEY_G	},	// G
-/*096*/ { SPECIAL,	KEY_RESERVED },	// ENTER SPECIAL MODE
-/*097*/ { 0,		KEY_KPSLASH },	// KP-/
-/*098*/ { SHIFT,	KEY_C	},	// C
-/*099*/ { 0,		KEY_F9	},	// F9
-
-/*00#*/ { 0,		KEY_RESERVED },	// Not possible! 00 is 0
-/*01#*/ { 0,		KEY_KP1	},	// KP-1
-/*02#*/ { 0,		KEY_KP2	},	// KP-2
-/*03#*/ { 0,		KEY_KP3	},	// KP-3
-/*04#*/ { 0,		KEY_KP4	},	// KP-4
-/*05#*/ { 0,		KEY_KP5 },	// KP-5
-/*06#*/ { 0,		KEY_KP6	},	// KP-6
-/*07#*/ { 0,		KEY_KP7	},	// KP-7
-/*08#*/ { 0,		KEY_KP8	},	// KP-8
-/*09#*/ { 0,		KEY_KP9	},	// KP-9
-
-/*00**/ { 0,		KEY_RESERVED },	// Not possible! 00 is 0
-/*01**/ { RESET,	KEY_RESERVED },	// (FREE)
-/*02**/ { RESET,	KEY_RESERVED },	// (FREE)
-/*03**/ { RESET,	KEY_RESERVED },	// (FREE)
-/*04**/ { RESET,	KEY_RESERVED },	// (FREE)
-/*05**/ { RESET,	KEY_RESERVED },	// (FREE)
-/*06**/ { RESET,	KEY_RESERVED },	// (FREE)
-/*07**/ { RESET,	KEY_RESERVED },	// (FREE)
-/*08**/ { RESET,	KEY_RESERVED },	// (FREE)
-/*09**/ { RESET,	KEY_RESERVED },	// (FREE)
-
-/*000*/ { 0,		KEY_RESERVED },	// Not possible! 00 is 0
-
-/*0USR1*/ { QUAL,	Q_SHFT_R },	// Shift_R
-/*0USR2*/ { QUAL,	Q_CTRL_R },	// Ctrl_R
-/*0USR3*/ { QUAL,	Q_ALT_R },	// Alt_R
-/*0USR4*/ { QUAL,	Q_GUI_R },	// Gui_R
-/*0USR5*/ { QUAL,	Q_SHFT_L },	// Shift_L
-/*0USR6*/ { QUAL,	Q_CTRL_L },	// Ctrl_L
-/*0USR7*/ { QUAL,	Q_ALT_L },	// Alt_L
-/*0USR8*/ { QUAL,	Q_GUI_L },	// Gui_L
-//	*INDENT-ON*
-};
+void AOHKCompileTables(const char *file, int n, char *const *maps)
+{
+    FILE *fp;
+    int i;
+    char names[n][32];
+
+    if (!strcmp(file, "-")) {		// stdout
+	fp = stdout;
+    } else if (!(fp = fopen(file, "w+"))) {
+	Debug(0, "Can't open compile file '%s'\n", file);
+	return;
+    }
+    fprintf(fp, "//\n//\t%s\t-\tALE one-hand keyboard table sets.\n//\n"
+	"//\tGenerated by aohkmc, do not edit.\n//\n", file);
+
+    for (i = 0; i < n; ++i) {
+	const char *s;
+	char *d;
+
+	s = strrchr(maps[i], '/');
+	s = s ? s + 1 : maps[i];
+	for (d = names[i]; *s && *s != '.' && d < names[i] + 31; ++s) {
+	    *d++ = isalnum(*s) ? *s : '_';
+	}
+	*d = '\0';
+
+	AOHKResetMappingTable();
+	AOHKResetMacroTable();
+	AOHKResetChordTable();
+	AOHKResetTrie();
+	AOHKUserSet.Layout = OHLayoutQwerty;
+	AOHKLoadTable(maps[i]);
+	AOHKSaveCTable(fp, names[i], maps[i]);
+    }
+
+    fprintf(fp, "\n///\n///\tAll compiled table sets.\n///\n"
+	"static const OHTableSet *const AOHKLanguages[] = {\n");
+    for (i = 0; i < n; ++i) {
+	fprintf(fp, "    &AOHKSet_%s,\n", names[i]);
+    }
+    fprintf(fp, "    NULL\n};\n");
+
+    if (strcmp(file, "-")) {		// !stdout
+	fclose(fp);
+    }
+}
 
 ///
 ///	Setup compiled keyboard mappings.
 ///
-///	@param lang	two character iso language code
+///	All listed table sets are resident and can be switched at runtime,
+///	the first is active.
+///
+///	@param lang	comma separated language names of compiled table
+///			sets (fe. de or de,us)
 ///
 void AOHKSetLanguage(const char *lang)
 {
-    unsigned i;
+    const OHTableSet *const *set;
+    const char *s;
+    size_t l;
 
     Debug(2, "Set Language '%s'\n", lang);
-    if (!strcmp("de", lang)) {
-	memcpy(AOHKTable, AOHKDeTable, sizeof(AOHKTable));
-	memcpy(AOHKQuoteTable, AOHKDeQuoteTable, sizeof(AOHKQuoteTable));
-    } else if (!strcmp("us", lang)) {
-	memcpy(AOHKTable, AOHKUsTable, sizeof(AOHKTable));
-	memcpy(AOHKQuoteTable, AOHKUsQuoteTable, sizeof(AOHKQuoteTable));
-    } else {
-	Debug(0, "Language '%s' isn't suported\n", lang);
-	return;
+    AOHKResidentN = 0;
+    AOHKResidentIdx = 0;
+    for (s = lang; *s; s += l + (s[l] == ',')) {
+	l = strcspn(s, ",");
+	for (set = AOHKLanguages; *set; ++set) {
+	    if (strlen((*set)->Name) == l && !strncmp((*set)->Name, s, l)) {
+		break;
+	    }
+	}
+	if (!*set) {
+	    Debug(0, "Language '%.*s' isn't suported\n", (int)l, s);
+	    continue;
+	}
+	if (AOHKResidentN == AOHK_RESIDENT) {
+	    Debug(0, "Too many languages\n");
+	    break;
+	}
+	AOHKResident[AOHKResidentN++] = *set;
     }
+    if (AOHKResidentN) {
+	AOHKSet = AOHKResident[0];
+    }
+}
 
-    if (1) {
-	OHKey version[] = {
-	    {0, KEY_A}
-	    ,
-	    {0, KEY_O}
-	    ,
-	    {0, KEY_H}
-	    ,
-	    {0, KEY_K}
-	    ,
-	    {0, KEY_SPACE}
-	    ,
-	    {0, KEY_V}
-	    ,
-	    {0, KEY_0}
-	    ,
-	    {0, KEY_DOT}
-	    ,
-	    {0, KEY_9}
-	    ,
-	    {0, KEY_0}
-	    ,
-	    {0, KEY_RESERVED}
-	    ,
-	};
-	//AOHKString2Macro("aohk v0.06");
-
-	AddMacro(version);
-    }
-    //
-    //	Convert Normal table into macro table. Adding Ctrl
-    //
-    for (i = 0; i < sizeof(AOHKTable) / sizeof(*AOHKTable); ++i) {
-	int mod;
-
-	switch (AOHKTable[i].Modifier) {
-	    case RESET:
-	    case QUOTE:
-	    case QUAL:
-	    case STICKY:
-	    case TOGAME:
-	    case TONUM:
-	    case SPECIAL:
-	    case MACRO:
-		mod = AOHKTable[i].Modifier;
-		break;
-	    default:
-		mod = AOHKTable[i].Modifier ^ CTL;
+///
+///	Switch to another resident table set.
+///
+///	Only the active table set pointer changes, nothing is parsed or
+///	derived.  Pressed keys are released, game, number and mouse mode
+///	stay on with the tables of the new set.
+///
+///	@param lang	language name of resident set, NULL for the next one
+///
+///	@returns true if switched, false if the language isn't resident.
+///
+int AOHKSwitchLanguage(const char *lang)
+{
+    int state;
+    int i;
+
+    if (!lang) {
+	i = AOHKResidentN ? (AOHKResidentIdx + 1) % AOHKResidentN : 0;
+    } else {
+	for (i = 0; i < AOHKResidentN; ++i) {
+	    if (!strcmp(AOHKResident[i]->Name, lang)) {
 		break;
+	    }
 	}
-	AOHKMacroTable[i].Modifier = mod;
-	AOHKMacroTable[i].KeyCode = AOHKTable[i].KeyCode;
     }
-    //
-    //	Convert Quote table into quote macro table. Adding Ctrl
-    //
-    for (i = 0; i < sizeof(AOHKQuoteTable) / sizeof(*AOHKQuoteTable); ++i) {
-	int mod;
+    if (i >= AOHKResidentN) {
+	Debug(0, "Language '%s' isn't resident\n", lang ? lang : "");
+	return 0;
+    }
+    state = AOHKState;
+    AOHKReset();
+    AOHKResidentIdx = i;
+    AOHKSet = AOHKResident[i];
+    if (AOHKIme && !AOHKImeReady()) {
+	AOHKIme = 0;
+    }
+    switch (state) {			// keep the mode
+	case OHGameMode:
+	    AOHKEnterGameMode();
+	    break;
+	case OHNumberMode:
+	    AOHKEnterNumberMode();
+	    break;
+	case OHMouseMode:
+	    AOHKEnterMouseMode();
+	    break;
+	case OHHardOff:
+	    AOHKState = OHHardOff;
+	    break;
+    }
+    AOHKOutFlush();
+    Debug(2, "Language now '%s'.\n", AOHKSet->Name);
+    LanguageLed();
+    return 1;
+}
 
-	switch (AOHKQuoteTable[i].Modifier) {
-	    case RESET:
-	    case QUOTE:
-	    case QUAL:
-	    case STICKY:
-	    case TOGAME:
-	    case TONUM:
-	    case SPECIAL:
-	    case MACRO:
-		mod = AOHKQuoteTable[i].Modifier;
-		break;
-	    default:
-		mod = AOHKQuoteTable[i].Modifier ^ CTL;
-		break;
+//----------------------------------------------------------------------------
+//	Control
+//----------------------------------------------------------------------------
+
+    /// State names of control replies.
+static const char *const AOHKStateNames[] = {
+    [OHFirstKey] = "normal",
+    [OHSecondKey] = "second",
+    [OHQuoteFirstKey] = "quote",
+    [OHQuoteSecondKey] = "quote-second",
+    [OHSuperFirstKey] = "super",
+    [OHSuperSecondKey] = "super-second",
+    [OHMacroFirstKey] = "macro",
+    [OHMacroSecondKey] = "macro-second",
+    [OHMacroQuoteFirstKey] = "macro-quote",
+    [OHMacroQuoteSecondKey] = "macro-quote-second",
+    [OHTrieKey] = "trie",
+    [OHGameMode] = "game",
+    [OHNumberMode] = "number",
+    [OHMouseMode] = "mouse",
+    [OHSpecial] = "special",
+    [OHSoftOff] = "off",
+    [OHHardOff] = "hardoff",
+};
+
+///
+///	Release all keys still pressed, the mode is kept.
+///
+///	Sequences, game and mouse keys and the modifiers held by the output
+///	optimizer are released, pressed input keys are forgotten.
+///
+static void AOHKDrain(void)
+{
+    int state;
+
+    state = AOHKState;
+    AOHKReset();
+    AOHKOutPending = AOHKOutHeld;
+    AOHKOutFlush();
+    AOHKDownKeys = 0;
+    switch (state) {
+	case OHGameMode:
+	    AOHKEnterGameMode();
+	    break;
+	case OHNumberMode:
+	    AOHKEnterNumberMode();
+	    break;
+	case OHMouseMode:
+	    AOHKEnterMouseMode();
+	    break;
+    }
+}
+
+///
+///	Switch mode by name.
+///
+///	@param name	normal, game, number, mouse, off or hardoff
+///
+///	@returns true if switched, false unknown mode.
+///
+static int AOHKControlMode(const char *name)
+{
+    if (!strcmp(name, "normal")) {
+	if (AOHKState == OHSoftOff || AOHKState == OHHardOff) {
+	    AOHKState = OHFirstKey;
+	    AOHKDownKeys = 0;
 	}
-	AOHKMacroQuoteTable[i].Modifier = mod;
-	AOHKMacroQuoteTable[i].KeyCode = AOHKQuoteTable[i].KeyCode;
+	AOHKReset();
+    } else if (!strcmp(name, "game")) {
+	AOHKEnterGameMode();
+    } else if (!strcmp(name, "number")) {
+	AOHKEnterNumberMode();
+    } else if (!strcmp(name, "mouse")) {
+	AOHKEnterMouseMode();
+    } else if (!strcmp(name, "off")) {
+	AOHKReset();
+	AOHKState = OHSoftOff;
+    } else if (!strcmp(name, "hardoff")) {
+	AOHKReset();
+	AOHKState = OHHardOff;
+    } else {
+	return 0;
     }
-    //
-    //	Convert Normal table into super quote table. Adding Alt
-    //
-    for (i = 0; i < sizeof(AOHKTable) / sizeof(*AOHKTable); ++i) {
-	int mod;
+    return 1;
+}
 
-	switch (AOHKTable[i].Modifier) {
-	    case RESET:
-	    case QUOTE:
-	    case QUAL:
-	    case STICKY:
-	    case TOGAME:
-	    case TONUM:
-	    case SPECIAL:
-	    case MACRO:
-		mod = AOHKTable[i].Modifier;
-		break;
-	    default:
-		mod = AOHKTable[i].Modifier ^ ALT;
-		break;
+///
+///	Apply control command.
+///
+///	The daemon calls it between input frames, a command sees the same
+///	state as the next key.  The special state commands and more:
+///
+///	-	state			mode, timeouts, table set, debug, keys
+///	-	tables			active and resident table sets
+///	-	map seq			output of sequence in the active set
+///	-	timeout ms [ms]		short and long timeout (fixed)
+///	-	adaptive pct		adaptive timeouts, 0 fixed
+///	-	mode name		normal game number mouse off hardoff
+///	-	lang [name]		switch table set, default next
+///	-	debug n			set debug level, the tracing
+///	-	onlyme 0|1		only me mode
+///	-	ime [on|off]		input method, no argument: candidates
+///	-	release			release all keys still pressed
+///	-	exit			exit the daemon
+///
+///	@param line	command line
+///	@param reply	buffer for reply line "ok ..." or "error ..."
+///	@param size	size of @a reply
+///
+///	@returns 0 success, -1 bad command.
+///
+int AOHKControl(const char *line, char *reply, int size)
+{
+    const char *error;
+    char cmd[16];
+    char arg[32];
+    int a;
+    int b;
+    int n;
+
+    arg[0] = '\0';
+    if (sscanf(line, "%15s %31s", cmd, arg) < 1) {
+	snprintf(reply, size, "error empty command\n");
+	return -1;
+    }
+    Debug(2, "Control '%s'\n", cmd);
+
+    error = NULL;
+    n = sscanf(line, "%*s %d %d", &a, &b);
+    if (!strcmp(cmd, "state")) {
+	snprintf(reply, size,
+	    "ok %s timeout %d,%d adaptive %d lang %s debug %d onlyme %d"
+	    " ime %d keys %#x held %#x\n", AOHKStateNames[(int)AOHKState],
+	    AOHKTimeBase, AOHKLongTimeBase, AOHKAdaptive, AOHKSet->Name,
+	    DebugLevel, AOHKOnlyMe, AOHKIme, AOHKDownKeys, AOHKOutHeld);
+	return 0;
+    } else if (!strcmp(cmd, "tables")) {
+	n = snprintf(reply, size, "ok %s trie %d resident", AOHKSet->Name,
+	    AOHKSet->TrieN);
+	for (a = 0; a < AOHKResidentN && n < size; ++a) {
+	    n += snprintf(reply + n, size - n, " %s", AOHKResident[a]->Name);
+	}
+	if (n < size) {
+	    snprintf(reply + n, size - n, "\n");
+	}
+	return 0;
+    } else if (!strcmp(cmd, "map")) {
+	const OHKey *key;
+	FILE *fp;
+
+	if (!*arg || !(key = AOHKMappingKey(AOHKSet, 0, arg))) {
+	    error = "usage: map sequence, like 11 0# *#1 **2 *0USR1";
+	} else if ((fp = fmemopen(reply, size, "w"))) {
+	    fprintf(fp, "ok %s\t-> ", arg);
+	    AOHKSaveSequence(fp, key);
+	    fprintf(fp, "\n");
+	    fclose(fp);
+	    return 0;
+	} else {
+	    error = "out of memory";
+	}
+    } else if (!strcmp(cmd, "timeout")) {
+	if (n < 1 || a <= 0 || (n == 2 && b < a)) {
+	    error = "usage: timeout ms [long-ms]";
+	} else {
+	    AOHKSetTimeouts(a, n == 2 ? b : 0);
+	}
+    } else if (!strcmp(cmd, "adaptive")) {
+	if (n < 1) {
+	    error = "usage: adaptive percentile";
+	} else {
+	    AOHKSetAdaptiveTimeout(a);
+	}
+    } else if (!strcmp(cmd, "mode")) {
+	if (!AOHKControlMode(arg)) {
+	    error = "usage: mode normal|game|number|mouse|off|hardoff";
+	}
+    } else if (!strcmp(cmd, "lang")) {
+	if (!AOHKSwitchLanguage(*arg ? arg : NULL)) {
+	    error = "table set isn't resident";
 	}
-	AOHKSuperTable[i].Modifier = mod;
-	AOHKSuperTable[i].KeyCode = AOHKTable[i].KeyCode;
+    } else if (!strcmp(cmd, "debug")) {
+	if (n < 1) {
+	    error = "usage: debug level";
+	} else {
+	    DebugLevel = a;
+	}
+    } else if (!strcmp(cmd, "onlyme")) {
+	if (n < 1) {
+	    error = "usage: onlyme 0|1";
+	} else {
+	    AOHKOnlyMe = a != 0;
+	}
+    } else if (!strcmp(cmd, "ime")) {
+	if (!*arg) {
+	    n = snprintf(reply, size, "ok %s %s", AOHKIme ? "on" : "off",
+		*ImeInput() ? ImeInput() : "-");
+	    for (a = 0; ImeCandidate(a) && n < size; ++a) {
+		n += snprintf(reply + n, size - n, " %s", ImeCandidate(a));
+	    }
+	    if (n < size) {
+		snprintf(reply + n, size - n, "\n");
+	    }
+	    return 0;
+	}
+	if (!strcmp(arg, "on") && AOHKImeReady()) {
+	    AOHKIme = 1;
+	} else if (!strcmp(arg, "off")) {
+	    AOHKIme = 0;
+	    ImeReset();
+	} else {
+	    error = "usage: ime [on|off], needs aohkd -i dictionary"
+		" and a table set with known layout:";
+	}
+    } else if (!strcmp(cmd, "release")) {
+	AOHKDrain();
+    } else if (!strcmp(cmd, "exit")) {
+	AOHKReset();
+	AOHKExit = 1;
+    } else {
+	error = "commands: state tables map timeout adaptive mode lang"
+	    " debug onlyme ime release exit";
     }
+    AOHKOutFlush();
+
+    if (error) {
+	snprintf(reply, size, "error %s\n", error);
+	return -1;
+    }
+    snprintf(reply, size, "ok\n");
+    return 0;
 }
 
 /// @}
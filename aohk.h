@@ -56,15 +56,58 @@ enum __aohk_internal_keys__
     AOHK_KEY_NOP,			///< internal key: no function
 };
 
+///
+///	Autorepeat modes.
+///
+enum __aohk_repeat_modes__
+{
+    AOHK_REPEAT_NORMAL,			///< normal mode
+    AOHK_REPEAT_GAME,			///< game mode
+    AOHK_REPEAT_NUMBER,			///< number mode
+    AOHK_REPEAT_MODES			///< number of repeat modes
+};
+
+///
+///	Event types of AOHKFeedEvents().
+///
+enum __aohk_event_types__
+{
+    AOHK_EVENT_KEY,			///< in/out: key code, 0/1/2
+    AOHK_EVENT_LED,			///< out: led number, on/off
+    AOHK_EVENT_TIMEOUT,			///< in: timeout ms in value
+    AOHK_EVENT_REPEAT,			///< in: autorepeat deadline reached
+    AOHK_EVENT_POINTER,			///< out: axis 0=x 1=y, relative motion
+};
+
+///
+///	Event of AOHKFeedEvents().
+///
+typedef struct _aohk_event_
+{
+    unsigned long Timestamp;		///< ms timestamp
+    unsigned short Type;		///< #AOHK_EVENT_KEY, ...
+    unsigned short Code;		///< key code, led number or axis
+    int Value;				///< key press, led state or motion
+} AOHKEvent;
+
 extern int AOHKTimeout;			///< out: timeout in ms needed
+extern unsigned long AOHKRepeatTimeout;	///< out: ms tick of next repeat
+extern unsigned long AOHKLastTick;	///< out: last key ms tick
 extern int AOHKExit;			///< out: exit flag
 
 extern void AOHKKeyOut(int, int);	///< out: key code, press
 extern void AOHKShowLED(int, int);	///< out: show led
+extern void AOHKPointerOut(int, int);	///< out: relative pointer motion
 
     /// Check current state
 extern int AOHKCheckOffState(void);
 
+    /// Check if current mode is a pure key remap
+extern int AOHKRemapMode(void);
+
+    /// Key remap of current mode
+extern int AOHKRemapKey(int);
+
     /// Handle internal key symbol
 extern int AOHKFeedSymbol(unsigned long, int, int);
 
@@ -74,6 +117,18 @@ extern void AOHKFeedKey(unsigned long, int, int);
     /// Handle timeout
 extern void AOHKFeedTimeout(int);
 
+    /// Handle autorepeat
+extern void AOHKFeedRepeat(unsigned long);
+
+    /// Handle array of events, output into array
+extern int AOHKFeedEvents(const AOHKEvent *, int, AOHKEvent *, int);
+
+    /// Set autorepeat delay and rate of mode
+extern void AOHKSetRepeat(int, int, int);
+
+    /// Set mouse keys speed, max speed and ramp
+extern void AOHKSetMouse(int, int, int);
+
     /// Set convert table
 extern void AOHKSetupConvertTable(const int *);
 
@@ -83,7 +138,22 @@ extern void AOHKSaveTable(const char *);
     /// Load internal tables
 extern void AOHKLoadTable(const char *);
 
-    /// Set language, changes mapping
+    /// Set resident languages, changes mapping
 extern void AOHKSetLanguage(const char *);
 
+    /// Switch to resident language
+extern int AOHKSwitchLanguage(const char *);
+
+    /// Compile mapping files into C table sets
+extern void AOHKCompileTables(const char *, int, char *const *);
+
+    /// Set chord window
+extern void AOHKSetChordWindow(int);
+
+    /// Set adaptive timeouts
+extern void AOHKSetAdaptiveTimeout(int);
+
+    /// Apply control command, reply text
+extern int AOHKControl(const char *, char *, int);
+
 /// @}
@@ -0,0 +1,118 @@
+///
+///	@file aohkmc.c	@brief	ALE one-hand keyboard mapping compiler.
+///
+///	Copyright (c) 2007,2009 by Lutz Sammer.	 All Rights Reserved.
+///
+///	Contributor(s):
+///
+///	This file is part of ALE one-hand keyboard
+///
+///	This program is free software; you can redistribute it and/or modify
+///	it under the terms of the GNU General Public License as published by
+///	the Free Software Foundation; only version 2 of the License.
+///
+///	This program is distributed in the hope that it will be useful,
+///	but WITHOUT ANY WARRANTY; without even the implied warranty of
+///	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+///	GNU General Public License for more details.
+///
+///	$Id$
+////////////////////////////////////////////////////////////////////////////
+
+///
+///	@defgroup aohkmc The aohk mapping compiler.
+///
+///	Compiles mapping files into const C table sets, which are linked
+///	into the daemon.  Uses the aohk module build without default tables
+///	(-DNODEFAULT).
+///
+///	@par Usage:
+///		aohkmc -o aohk-lang.h de.default.map us.default.map
+/// @{
+
+#include <stdio.h>
+#include <unistd.h>
+
+#include "aohk.h"
+#include "ime.h"
+
+////////////////////////////////////////////////////////////////////////////
+
+int AOHKTimeout;			///< in: timeout used
+int AOHKExit;				///< in: exit program flag
+
+int DebugLevel = 1;			///< debug level, only errors
+
+///
+///	Key output, not used by the compiler.
+///
+void AOHKKeyOut(int __attribute__((unused)) key,
+    int __attribute__((unused)) pressed)
+{
+}
+
+///
+///	LED output, not used by the compiler.
+///
+void AOHKShowLED(int __attribute__((unused)) num,
+    int __attribute__((unused)) on)
+{
+}
+
+///
+///	Pointer output, not used by the compiler.
+///
+void AOHKPointerOut(int __attribute__((unused)) dx,
+    int __attribute__((unused)) dy)
+{
+}
+
+///
+///	Main entry point.
+///
+///	@param argc	number of arguments
+///	@param argv	arguments vector
+///
+int main(int argc, char *const argv[])
+{
+    const char *out;
+    int ime;
+
+    out = "-";
+    ime = 0;
+    for (;;) {
+	switch (getopt(argc, argv, "io:h?-")) {
+	    case 'i':			// input method dictionary
+		ime = 1;
+		continue;
+	    case 'o':			// output file
+		out = optarg;
+		continue;
+	    case EOF:
+		break;
+	    default:
+		fprintf(stderr,
+		    "Usage: %s [-o file] mapping-files...\n"
+		    "\tCompile mapping files into C table sets\n"
+		    "   or: %s -i -o file dictionary\n"
+		    "\tCompile pinyin dictionary for aohkd -i\n", argv[0],
+		    argv[0]);
+		return -1;
+	}
+	break;
+    }
+    if (optind >= argc) {
+	fprintf(stderr, "%s: no mapping files\n", argv[0]);
+	return -1;
+    }
+
+    if (ime) {
+	return ImeCompile(argv[optind], out) ? -1 : 0;
+    }
+
+    AOHKCompileTables(out, argc - optind, argv + optind);
+
+    return 0;
+}
+
+/// @}
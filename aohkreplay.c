@@ -0,0 +1,863 @@
+///
+///	@file aohkreplay.c	@brief	ALE one-hand keyboard trace replay.
+///
+///	Copyright (c) 2007,2009 by Lutz Sammer.	 All Rights Reserved.
+///
+///	Contributor(s):
+///
+///	This file is part of ALE one-hand keyboard
+///
+///	This program is free software; you can redistribute it and/or modify
+///	it under the terms of the GNU General Public License as published by
+///	the Free Software Foundation; only version 2 of the License.
+///
+///	This program is distributed in the hope that it will be useful,
+///	but WITHOUT ANY WARRANTY; without even the implied warranty of
+///	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+///	GNU General Public License for more details.
+///
+///	$Id$
+////////////////////////////////////////////////////////////////////////////
+
+///
+///	@defgroup aohkreplay The aohk trace replay.
+///
+///	Replays typing traces through the state machine and the uinput
+///	event path (written to /dev/null), like the daemon without devices.
+///	Used to train the profile of make pgo and to compare builds.
+///
+///	A trace is a text file, one key event per line: ms timestamp, linux
+///	key code of a number pad (like aohkd -d keypad) and 0/1 for release
+///	and press.  Lines starting with # are comments.  A comment
+///	"# sum xxxxxxxx" gives the expected checksum of the output events,
+///	a trace with another output fails.
+///
+///	With -o uhid or -o uhid-nkro the keys are sent as reports of a
+///	virtual HID keyboard instead (needs /dev/uhid).  Its input device is
+///	grabbed and the keys read back must match the keys sent.
+///
+///	@par Usage:
+///		aohkreplay [-l lang] [-r runs] [-q] traces...
+///		aohkreplay [-l lang] -o uhid|uhid-nkro traces...
+///		aohkreplay [-l lang] -g text-file > trace
+///		aohkreplay [-l lang] -G events > trace
+/// @{
+
+#include <linux/input.h>
+
+#include <sys/ioctl.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+
+#include "aohk.h"
+#include "uinput.h"
+#include "uhid.h"
+
+////////////////////////////////////////////////////////////////////////////
+
+#define REPLAY_BATCH	64		///< input events per AOHKFeedEvents()
+#define REPLAY_OUT	1024		///< output events per batch
+
+int AOHKTimeout;			///< in: timeout used
+int AOHKExit;				///< in: exit program flag
+
+int DebugLevel = 1;			///< debug level, only errors
+
+static int ReplayFd = -1;		///< uinput stand-in (/dev/null)
+static unsigned long ReplayTime = 100000;	///< ms timestamp of next run
+static int ReplayFailed;		///< traces with wrong output checksum
+
+static int ReplayUHidFd = -1;		///< uhid keyboard, -1 not used
+static int ReplayEventFd = -1;		///< input device of uhid keyboard
+
+    /// Presses and releases by key code: sent to and read back from uhid.
+static unsigned ReplayKeys[2][256][2];
+
+///
+///	Number pad, same as the daemon keypad convert table.
+///
+static const int ReplayConvertTable[] = {
+    KEY_KPENTER, AOHK_KEY_0,
+    KEY_KP1, AOHK_KEY_1,
+    KEY_KP2, AOHK_KEY_2,
+    KEY_KP3, AOHK_KEY_3,
+    KEY_KP4, AOHK_KEY_4,
+    KEY_KP5, AOHK_KEY_5,
+    KEY_KP6, AOHK_KEY_6,
+    KEY_KP7, AOHK_KEY_7,
+    KEY_KP8, AOHK_KEY_8,
+    KEY_KP9, AOHK_KEY_9,
+    KEY_KP0, AOHK_KEY_HASH,
+    KEY_KPDOT, AOHK_KEY_STAR,
+    KEY_KPSLASH, AOHK_KEY_USR_1,
+    KEY_KPASTERISK, AOHK_KEY_USR_2,
+    KEY_KPMINUS, AOHK_KEY_USR_3,
+    KEY_KPPLUS, AOHK_KEY_USR_4,
+    KEY_NUMLOCK, AOHK_KEY_SPECIAL,
+    KEY_RESERVED, KEY_RESERVED
+};
+
+///
+///	Key code of internal key symbol.
+///
+///	@param symbol	#AOHK_KEY_0 ... #AOHK_KEY_SPECIAL
+///
+///	@returns number pad key code, #KEY_RESERVED if none.
+///
+static int ReplayKey(int symbol)
+{
+    const int *table;
+
+    for (table = ReplayConvertTable; *table; table += 2) {
+	if (table[1] == symbol) {
+	    return table[0];
+	}
+    }
+    return KEY_RESERVED;
+}
+
+//----------------------------------------------------------------------------
+//	Output
+//----------------------------------------------------------------------------
+
+///
+///	Key output of the state machine outside of batches.
+///
+void AOHKKeyOut(int key, int pressed)
+{
+    if (ReplayUHidFd >= 0) {
+	if (UHidKey(ReplayUHidFd, key, pressed)) {
+	    if (pressed != 2) {
+		++ReplayKeys[0][key][pressed];
+	    }
+	    return;
+	}
+	UHidSync(ReplayUHidFd);		// keep order with uinput
+    }
+    if (pressed == 2) {
+	UInputKeyrepeat(ReplayFd, key);
+    } else if (pressed) {
+	UInputKeydown(ReplayFd, key);
+    } else {
+	UInputKeyup(ReplayFd, key);
+    }
+}
+
+///
+///	LED output, not replayed.
+///
+void AOHKShowLED(int __attribute__((unused)) num,
+    int __attribute__((unused)) on)
+{
+}
+
+///
+///	Pointer output of the state machine outside of batches.
+///
+void AOHKPointerOut(int dx, int dy)
+{
+    UInputRel(ReplayFd, dx, dy);
+}
+
+///
+///	Write batch output like the daemon.
+///
+///	@param out	output events of AOHKFeedEvents()
+///	@param n	number of events
+///
+static void ReplayOutput(const AOHKEvent * out, int n)
+{
+    int i;
+
+    for (i = 0; i < n; ++i) {
+	switch (out[i].Type) {
+	    case AOHK_EVENT_KEY:
+		AOHKKeyOut(out[i].Code, out[i].Value);
+		break;
+	    case AOHK_EVENT_POINTER:
+		if (out[i].Code) {
+		    UInputRel(ReplayFd, 0, out[i].Value);
+		} else {
+		    UInputRel(ReplayFd, out[i].Value, 0);
+		}
+		break;
+	}
+    }
+}
+
+//----------------------------------------------------------------------------
+//	Uhid loopback
+//----------------------------------------------------------------------------
+
+///
+///	Open uhid keyboard and grab its input device.
+///
+///	hid-input creates the input device in the background, it is
+///	searched by name for up to 2s.
+///
+///	@param nkro	true NKRO reports, false boot protocol reports
+///
+///	@returns true if success.
+///
+static int LoopbackOpen(int nkro)
+{
+    static const char name[] = "ALE OneHand Replay Loopback";
+    char path[64];
+    char buf[256];
+    int i;
+    int n;
+    int fd;
+
+    if ((ReplayUHidFd = OpenUHid(name, nkro)) < 0) {
+	return 0;
+    }
+    for (n = 0; n < 100; ++n) {
+	UHidSync(ReplayUHidFd);		// answer kernel requests
+	for (i = 0; i < 64; ++i) {
+	    sprintf(path, "/dev/input/event%d", i);
+	    if ((fd = open(path, O_RDONLY | O_NONBLOCK | O_CLOEXEC)) < 0) {
+		continue;
+	    }
+	    if (ioctl(fd, EVIOCGNAME(sizeof(buf)), buf) >= 0
+		&& !strncmp(buf, name, sizeof(name))) {
+		// keys must not reach the desktop
+		if (ioctl(fd, EVIOCGRAB, 1) < 0) {
+		    perror("ioctl(EVIOCGRAB)");
+		    close(fd);
+		    return 0;
+		}
+		ReplayEventFd = fd;
+		return 1;
+	    }
+	    close(fd);
+	}
+	usleep(20 * 1000);
+    }
+    fprintf(stderr, "No input device of uhid keyboard\n");
+    return 0;
+}
+
+///
+///	Send queued report and read the keys back.
+///
+///	The kernel handles a report in the write, its events are ready
+///	when UHidSync() returns.
+///
+static void LoopbackSync(void)
+{
+    struct input_event ev[64];
+    ssize_t n;
+    int i;
+
+    UHidSync(ReplayUHidFd);
+    while ((n = read(ReplayEventFd, ev, sizeof(ev))) > 0) {
+	for (i = 0; i < n / (int)sizeof(*ev); ++i) {
+	    if (ev[i].type == EV_KEY && ev[i].code < 256
+		&& ev[i].value != 2) {
+		++ReplayKeys[1][ev[i].code][ev[i].value != 0];
+	    } else if (ev[i].type == EV_SYN && ev[i].code == SYN_DROPPED) {
+		fprintf(stderr, "Loopback events dropped\n");
+	    }
+	}
+    }
+}
+
+///
+///	Compare keys sent and read back.
+///
+///	Keys of one report arrive in usage order, not in the order sent.
+///	Presses and releases are counted by key code.
+///
+///	@param file	trace file name
+///
+static void LoopbackCheck(const char *file)
+{
+    int i;
+    int bad;
+
+    LoopbackSync();
+    bad = 0;
+    for (i = 0; i < 256; ++i) {
+	if (ReplayKeys[0][i][0] != ReplayKeys[1][i][0]
+	    || ReplayKeys[0][i][1] != ReplayKeys[1][i][1]) {
+	    fprintf(stderr, "%s: key %d sent %u/%u read back %u/%u\n", file,
+		i, ReplayKeys[0][i][1], ReplayKeys[0][i][0],
+		ReplayKeys[1][i][1], ReplayKeys[1][i][0]);
+	    bad = 1;
+	}
+    }
+    if (bad) {
+	++ReplayFailed;
+    }
+    memset(ReplayKeys, 0, sizeof(ReplayKeys));
+}
+
+//----------------------------------------------------------------------------
+//	Replay
+//----------------------------------------------------------------------------
+
+///
+///	Load trace file.
+///
+///	@param file	trace file name
+///	@param[out] n	number of events
+///	@param[out] expect	expected checksum of output events
+///	@param[out] check	true if the trace has an expected checksum
+///
+///	@returns malloced events, NULL if failure.
+///
+static AOHKEvent *ReplayLoad(const char *file, int *n, unsigned *expect,
+    int *check)
+{
+    FILE *fp;
+    AOHKEvent *events;
+    AOHKEvent *grow;
+    char line[128];
+    unsigned long ts;
+    int max;
+    int code;
+    int value;
+
+    if (!(fp = fopen(file, "r"))) {
+	perror(file);
+	return NULL;
+    }
+    events = NULL;
+    max = 0;
+    *n = 0;
+    *check = 0;
+    while (fgets(line, sizeof(line), fp)) {
+	if (sscanf(line, "# sum %x", expect) == 1) {
+	    *check = 1;
+	    continue;
+	}
+	if (*line == '#' || *line == '\n') {
+	    continue;
+	}
+	if (sscanf(line, "%lu %d %d", &ts, &code, &value) != 3) {
+	    fprintf(stderr, "%s: bad line '%s'\n", file, line);
+	    continue;
+	}
+	if (*n == max) {
+	    max = max ? 2 * max : 4096;
+	    if (!(grow = realloc(events, max * sizeof(*events)))) {
+		perror(file);
+		free(events);
+		fclose(fp);
+		return NULL;
+	    }
+	    events = grow;
+	}
+	events[*n].Timestamp = ts;
+	events[*n].Type = AOHK_EVENT_KEY;
+	events[*n].Code = code;
+	events[*n].Value = value;
+	++*n;
+    }
+    fclose(fp);
+
+    return events;
+}
+
+///
+///	Replay events once.
+///
+///	Autorepeat is only checked between batches.  With the uhid loopback
+///	each event is its own batch, the reports are read back after it.
+///
+///	@param events	trace events
+///	@param n	number of events
+///	@param[in,out] sum	checksum of output events, NULL none
+///
+///	@returns number of output events.
+///
+static int ReplayRun(const AOHKEvent * events, int n, unsigned *sum)
+{
+    static AOHKEvent out[REPLAY_OUT];
+    AOHKEvent repeat;
+    int total;
+    int i;
+    int j;
+    int k;
+    int m;
+
+    total = 0;
+    for (i = 0; i < n; i += k) {
+	if (AOHKRepeatTimeout && AOHKRepeatTimeout <= events[i].Timestamp) {
+	    repeat.Timestamp = AOHKRepeatTimeout;
+	    repeat.Type = AOHK_EVENT_REPEAT;
+	    repeat.Code = 0;
+	    repeat.Value = 0;
+	    m = AOHKFeedEvents(&repeat, 1, out, REPLAY_OUT);
+	    total += m;
+	    ReplayOutput(out, m < REPLAY_OUT ? m : REPLAY_OUT);
+	    k = 0;
+	    continue;
+	}
+	k = n - i < REPLAY_BATCH ? n - i : REPLAY_BATCH;
+	if (ReplayEventFd >= 0) {
+	    k = 1;
+	}
+	m = AOHKFeedEvents(events + i, k, out, REPLAY_OUT);
+	total += m;
+	if (m > REPLAY_OUT) {
+	    m = REPLAY_OUT;
+	}
+	ReplayOutput(out, m);
+	if (ReplayEventFd >= 0) {
+	    LoopbackSync();
+	}
+	if (sum) {			// FNV-1a
+	    for (j = 0; j < m; ++j) {
+		*sum = (*sum ^ out[j].Type) * 16777619;
+		*sum = (*sum ^ out[j].Code) * 16777619;
+		*sum = (*sum ^ (unsigned)out[j].Value) * 16777619;
+	    }
+	}
+    }
+    return total;
+}
+
+///
+///	Replay trace file.
+///
+///	Each run starts in normal mode, its timestamps are shifted behind
+///	the last run.  The best run is reported.  The output of the first
+///	run is checked against the expected checksum of the trace.
+///
+///	@param file	trace file name
+///	@param runs	number of runs
+///	@param quiet	no report
+///	@param[out] best	ns of best run
+///
+///	@returns number of input events, -1 failure.
+///
+static int ReplayFile(const char *file, int runs, int quiet, double *best)
+{
+    AOHKEvent *events;
+    struct timespec start;
+    struct timespec end;
+    char reply[256];
+    unsigned sum;
+    unsigned expect;
+    unsigned long offset;
+    unsigned long span;
+    double ns;
+    int n;
+    int r;
+    int i;
+    int m;
+    int check;
+
+    if (!(events = ReplayLoad(file, &n, &expect, &check))) {
+	return -1;
+    }
+    if (!n) {
+	free(events);
+	return 0;
+    }
+    span = events[n - 1].Timestamp + 60 * 1000;
+    offset = 0;
+    *best = 0;
+    sum = 2166136261U;
+    m = 0;
+    for (r = 0; r < runs; ++r) {
+	for (i = 0; i < n; ++i) {
+	    events[i].Timestamp += ReplayTime - offset;
+	}
+	offset = ReplayTime;
+	ReplayTime += span;
+	AOHKControl("mode normal", reply, sizeof(reply));
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	i = ReplayRun(events, n, r ? NULL : &sum);
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	if (!r) {
+	    m = i;
+	}
+	ns = (end.tv_sec - start.tv_sec) * 1e9 + (end.tv_nsec -
+	    start.tv_nsec);
+	if (!r || ns < *best) {
+	    *best = ns;
+	}
+    }
+    if (!quiet) {
+	printf("%-30s %7d events %7d out sum %08x %8.1f ns/event\n", file, n,
+	    m, sum, *best / n);
+    }
+    if (ReplayEventFd >= 0) {
+	LoopbackCheck(file);
+    }
+    if (check && sum != expect) {
+	fprintf(stderr, "%s: output sum %08x, expected %08x\n", file, sum,
+	    expect);
+	++ReplayFailed;
+    }
+    free(events);
+
+    return n;
+}
+
+//----------------------------------------------------------------------------
+//	Trace generator
+//----------------------------------------------------------------------------
+
+///
+///	Rows of the us keyboard, consecutive key codes.
+///
+static const struct
+{
+    int First;				///< key code of first char
+    const char *Plain;			///< chars without shift
+    const char *Shifted;		///< chars with shift
+} ReplayRows[] = {
+    {KEY_1, "1234567890-=", "!@#$%^&*()_+"},
+    {KEY_Q, "qwertyuiop[]", "QWERTYUIOP{}"},
+    {KEY_A, "asdfghjkl;'`", "ASDFGHJKL:\"~"},
+    {KEY_BACKSLASH, "\\", "|"},
+    {KEY_Z, "zxcvbnm,./", "ZXCVBNM<>?"},
+    {KEY_SPACE, " ", ""},
+    {KEY_ENTER, "\n", ""},
+    {KEY_TAB, "\t", ""},
+};
+
+#define GEN_SYMBOLS	12		///< sequence keys 0-9 # *
+#define GEN_LENGTH	3		///< longest sequence searched
+
+    /// Shortest internal key sequence of char.
+static unsigned char GenSequence[256][GEN_LENGTH + 1];
+static unsigned long GenTime = 100000;	///< ms timestamp of generator
+static unsigned GenSeed = 4711;		///< random generator state
+
+///
+///	Small random number.
+///
+///	@param n	range
+///
+///	@returns 0 .. @a n - 1
+///
+static int GenRandom(int n)
+{
+    GenSeed = GenSeed * 1103515245 + 12345;
+    return (GenSeed >> 16) % n;
+}
+
+///
+///	Char of key code.
+///
+///	@param key	output key code
+///	@param shift	shift pressed
+///
+///	@returns char, 0 if none.
+///
+static int GenChar(int key, int shift)
+{
+    const char *s;
+    size_t i;
+
+    for (i = 0; i < sizeof(ReplayRows) / sizeof(*ReplayRows); ++i) {
+	s = shift ? ReplayRows[i].Shifted : ReplayRows[i].Plain;
+	if (key >= ReplayRows[i].First
+	    && key < ReplayRows[i].First + (int)strlen(s)) {
+	    return s[key - ReplayRows[i].First];
+	}
+    }
+    return 0;
+}
+
+///
+///	Find the shortest sequences of all chars.
+///
+///	Every sequence of up to #GEN_LENGTH keys is typed into the state
+///	machine, those sending a single key with or without shift and
+///	ending in normal mode are kept.
+///
+static void GenSearch(void)
+{
+    AOHKEvent in[2 * GEN_LENGTH];
+    AOHKEvent out[64];
+    char reply[256];
+    int len;
+    int seq;
+    int i;
+    int n;
+    int m;
+    int c;
+    int key;
+    int shift;
+    int bad;
+
+    for (len = 1; len <= GEN_LENGTH; ++len) {
+	n = 1;
+	for (i = 0; i < len; ++i) {
+	    n *= GEN_SYMBOLS;
+	}
+	for (seq = 0; seq < n; ++seq) {
+	    AOHKControl("mode normal", reply, sizeof(reply));
+	    GenTime += 20 * 1000;
+	    for (i = 0, c = seq; i < len; ++i, c /= GEN_SYMBOLS) {
+		in[2 * i].Timestamp = GenTime + 200 * i;
+		in[2 * i].Type = AOHK_EVENT_KEY;
+		in[2 * i].Code = ReplayKey(c % GEN_SYMBOLS);
+		in[2 * i].Value = 1;
+		in[2 * i + 1] = in[2 * i];
+		in[2 * i + 1].Timestamp += 100;
+		in[2 * i + 1].Value = 0;
+	    }
+	    m = AOHKFeedEvents(in, 2 * len, out, 64);
+	    AOHKControl("state", reply, sizeof(reply));
+	    if (m > 64 || strncmp(reply, "ok normal ", 10)) {
+		continue;
+	    }
+	    key = 0;
+	    shift = 0;
+	    bad = 0;
+	    for (i = 0; i < m; ++i) {
+		if (out[i].Type != AOHK_EVENT_KEY || out[i].Value != 1) {
+		    continue;
+		}
+		if (out[i].Code == KEY_LEFTSHIFT
+		    || out[i].Code == KEY_RIGHTSHIFT) {
+		    shift = 1;
+		} else if (key) {
+		    bad = 1;
+		} else {
+		    key = out[i].Code;
+		}
+	    }
+	    // other modifiers are pressed like keys, they are bad too
+	    if (bad || !(c = GenChar(key, shift)) || GenSequence[c][0]) {
+		continue;
+	    }
+	    GenSequence[c][0] = len;
+	    for (i = 0, m = seq; i < len; ++i, m /= GEN_SYMBOLS) {
+		GenSequence[c][i + 1] = m % GEN_SYMBOLS;
+	    }
+	}
+    }
+}
+
+///
+///	Print key press or release.
+///
+///	@param key	number pad key code
+///	@param value	1 press, 0 release
+///
+static void GenEvent(int key, int value)
+{
+    printf("%lu %d %d\n", GenTime - 100000, key, value);
+}
+
+///
+///	Type text file with human like rhythm.
+///
+///	Pauses at word and sentence ends, some longer than the timeout.
+///
+///	@param file	text file, chars without sequence are skipped
+///
+///	@returns 0 success, -1 failure.
+///
+static int GenText(const char *file)
+{
+    FILE *fp;
+    int c;
+    int i;
+    int key;
+
+    if (!(fp = fopen(file, "r"))) {
+	perror(file);
+	return -1;
+    }
+    GenSearch();
+    GenTime = 100000;
+
+    printf("# aohk trace of %s: ms, key code, press\n", file);
+    while ((c = getc(fp)) != EOF) {
+	if (!GenSequence[c][0]) {
+	    continue;
+	}
+	for (i = 1; i <= GenSequence[c][0]; ++i) {
+	    key = ReplayKey(GenSequence[c][i]);
+	    GenEvent(key, 1);
+	    GenTime += 50 + GenRandom(60);
+	    GenEvent(key, 0);
+	    GenTime += 40 + GenRandom(120);
+	}
+	GenTime += 80 + GenRandom(200);
+	if (c == ' ') {
+	    GenTime += GenRandom(300);
+	} else if (c == '.' || c == '\n') {
+	    GenTime += 400 + GenRandom(1600);
+	}
+    }
+    fclose(fp);
+
+    return 0;
+}
+
+///
+///	Play game mode with random keys.
+///
+///	Enters game mode with SPECIAL 6, up to three keys are held.
+///
+///	@param n	number of key events
+///
+static void GenGame(int n)
+{
+    unsigned held;
+    int i;
+    int symbol;
+
+    printf("# aohk trace of game mode: ms, key code, press\n");
+    GenTime = 100000;
+    GenEvent(KEY_NUMLOCK, 1);
+    GenTime += 80;
+    GenEvent(KEY_NUMLOCK, 0);
+    GenTime += 150;
+    GenEvent(KEY_KP6, 1);
+    GenTime += 80;
+    GenEvent(KEY_KP6, 0);
+
+    held = 0;
+    for (i = 0; i < n; ++i) {
+	GenTime += 20 + GenRandom(130);
+	symbol = GenRandom(GEN_SYMBOLS);
+	if (held & (1 << symbol)) {
+	    held &= ~(1 << symbol);
+	    GenEvent(ReplayKey(symbol), 0);
+	} else if (__builtin_popcount(held) < 3) {
+	    held |= 1 << symbol;
+	    GenEvent(ReplayKey(symbol), 1);
+	}
+    }
+    for (symbol = 0; symbol < GEN_SYMBOLS; ++symbol) {
+	if (held & (1 << symbol)) {
+	    GenTime += 50;
+	    GenEvent(ReplayKey(symbol), 0);
+	}
+    }
+}
+
+///
+///	Main entry point.
+///
+///	@param argc	number of arguments
+///	@param argv	arguments vector
+///
+int main(int argc, char *const argv[])
+{
+    const char *lang;
+    const char *text;
+    const char *output;
+    double best;
+    double total;
+    int events;
+    int game;
+    int runs;
+    int quiet;
+    int i;
+    int n;
+
+    lang = "us";
+    text = NULL;
+    output = "uinput";
+    game = 0;
+    runs = 10;
+    quiet = 0;
+    for (;;) {
+	switch (getopt(argc, argv, "G:g:l:o:qr:h?-")) {
+	    case 'G':			// generate game trace
+		game = atoi(optarg);
+		continue;
+	    case 'g':			// generate text trace
+		text = optarg;
+		continue;
+	    case 'l':			// language
+		lang = optarg;
+		continue;
+	    case 'o':			// output backend
+		output = optarg;
+		continue;
+	    case 'q':			// quiet
+		quiet = 1;
+		continue;
+	    case 'r':			// runs
+		runs = atoi(optarg);
+		if (runs < 1) {
+		    runs = 1;
+		}
+		continue;
+	    case EOF:
+		break;
+	    default:
+		fprintf(stderr,
+		    "Usage: %s [-l lang] [-r runs] [-q] [-o out] traces...\n"
+		    "\tReplay traces, report ns/event of best run\n"
+		    "\t-o uhid or uhid-nkro checks the keys read back\n"
+		    "\tfrom a virtual HID keyboard\n"
+		    "   or: %s [-l lang] -g text-file\n"
+		    "\tGenerate trace typing the text\n"
+		    "   or: %s [-l lang] -G events\n"
+		    "\tGenerate trace playing game mode\n", argv[0], argv[0],
+		    argv[0]);
+		return -1;
+	}
+	break;
+    }
+
+    if ((ReplayFd = open("/dev/null", O_WRONLY)) < 0) {
+	perror("/dev/null");
+	return -1;
+    }
+    AOHKSetLanguage(lang);
+    AOHKSetupConvertTable(ReplayConvertTable);
+
+    if (text) {
+	return GenText(text);
+    }
+    if (game) {
+	GenGame(game);
+	return 0;
+    }
+
+    if (strcmp(output, "uinput")) {
+	if (strcmp(output, "uhid") && strcmp(output, "uhid-nkro")) {
+	    fprintf(stderr, "Unknown output '%s'\n", output);
+	    return -1;
+	}
+	if (!LoopbackOpen(!strcmp(output, "uhid-nkro"))) {
+	    return -1;
+	}
+    }
+
+    total = 0;
+    events = 0;
+    for (i = optind; i < argc; ++i) {
+	if ((n = ReplayFile(argv[i], runs, quiet, &best)) < 0) {
+	    return -1;
+	}
+	events += n;
+	total += best;
+    }
+    if (!quiet && events) {
+	printf("%-30s %7d events %26s %8.1f ns/event\n", "total", events, "",
+	    total / events);
+    }
+    if (ReplayEventFd >= 0) {
+	close(ReplayEventFd);
+    }
+    if (ReplayUHidFd >= 0) {
+	CloseUHid(ReplayUHidFd);
+    }
+    close(ReplayFd);
+
+    return ReplayFailed ? -1 : 0;
+}
+
+/// @}
@@ -33,23 +33,37 @@
 ///		- builtin bluetooth virtual keyboard emulation
 /// @{
 
+#define _GNU_SOURCE			///< pthread_setaffinity_np
+
 #include <linux/input.h>
 #include <linux/uinput.h>
 
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/timerfd.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdint.h>
 #include <unistd.h>
 #include <fcntl.h>
 #include <string.h>
 #include <errno.h>
 #include <syslog.h>
 #include <poll.h>
+#include <time.h>
+#include <sched.h>
+#include <pthread.h>
 
 #include "aohk.h"
 #include "uinput.h"
+#include "uhid.h"
+#include "inject.h"
+#include "ime.h"
+#include "probe.h"
 
 ////////////////////////////////////////////////////////////////////////////
 
@@ -220,33 +234,33 @@ static const int Numpad2ConvertTable[] = {
 ///	End marked with KEY_RESERVED
 ///
 static const int PgcuConvertTable[] = {
-    16, AOHK_KEY_0,
-    9, AOHK_KEY_1,
-    10, AOHK_KEY_2,
-    11, AOHK_KEY_3,
-    5, AOHK_KEY_4,
-    6, AOHK_KEY_5,
-    7, AOHK_KEY_6,
-    1, AOHK_KEY_7,
-    2, AOHK_KEY_8,
-    3, AOHK_KEY_9,
-    12, AOHK_KEY_HASH,
-    13, AOHK_KEY_HASH,
-
-    15, AOHK_KEY_STAR,
-    21, AOHK_KEY_STAR,
-
-    17, AOHK_KEY_USR_1,
-    18, AOHK_KEY_USR_2,
-    19, AOHK_KEY_USR_3,
-    20, AOHK_KEY_USR_4,
-    4, AOHK_KEY_SPECIAL,
-
-    // 14, 8, 22, 23. 24 unused
-
-    22, AOHK_KEY_NOP,			// these produce only down, when switched up
-    23, AOHK_KEY_NOP,
-    24, AOHK_KEY_NOP,
+    BTN_DEAD, AOHK_KEY_0,
+    BTN_BASE3, AOHK_KEY_1,
+    BTN_BASE4, AOHK_KEY_2,
+    BTN_BASE5, AOHK_KEY_3,
+    BTN_TOP2, AOHK_KEY_4,
+    BTN_PINKIE, AOHK_KEY_5,
+    BTN_BASE, AOHK_KEY_6,
+    BTN_TRIGGER, AOHK_KEY_7,
+    BTN_THUMB, AOHK_KEY_8,
+    BTN_THUMB2, AOHK_KEY_9,
+    BTN_BASE6, AOHK_KEY_HASH,
+    BTN_BASE6 + 1, AOHK_KEY_HASH,
+
+    BTN_BASE6 + 3, AOHK_KEY_STAR,
+    BTN_WEST, AOHK_KEY_STAR,
+
+    BTN_SOUTH, AOHK_KEY_USR_1,
+    BTN_EAST, AOHK_KEY_USR_2,
+    BTN_C, AOHK_KEY_USR_3,
+    BTN_NORTH, AOHK_KEY_USR_4,
+    BTN_TOP, AOHK_KEY_SPECIAL,
+
+    // BTN_BASE6 + 2, BTN_BASE2, BTN_Z, BTN_TL, BTN_TR unused
+
+    BTN_Z, AOHK_KEY_NOP,		// these produce only down, when switched up
+    BTN_TL, AOHK_KEY_NOP,
+    BTN_TR, AOHK_KEY_NOP,
 
     KEY_RESERVED, KEY_RESERVED
 };
@@ -261,7 +275,6 @@ struct input_device
     int Vendor;				///< usb/bluetooth vendor id
     int Product;			///< usb/bluetooth product id
     const int *ConvertTable;		///< default input convert table
-    int Offset;				///< to convert buttons of joysticks
 };
 
 ///
@@ -269,25 +282,32 @@ struct input_device
 ///
 static const struct input_device InputDevices[] = {
     {
-	"n52", BELKIN_VENDOR_ID, NOSTROMO_N52_ID, N52ConvertTable, 0}, {
-	"pc102", SYSTEM_VENDOR_ID, PS2_KEYBOARD_ID, PC102ConvertTable, 0}, {
-	"keypad", CHERRY_VENDOR_ID, KEYPAD_ID, NumpadConvertTable, 0}, {
-	"keypad", FUJSI_VENDOR_ID, KEYPAD2_ID, Numpad2ConvertTable, 0}, {
-	"pgcu", SAITEK_VENDOR_ID, PGCU_ID, PgcuConvertTable, 0x11F}, {
-	"awkb", APPLE_VENDOR_ID, AWKB_ID, PC102ConvertTable, 0}, {
-	"aawkb", APPLE_VENDOR_ID, AAWKB_ID, PC102ConvertTable, 0}, {
-	"aakb", APPLE_VENDOR_ID, AAKB_ID, PC102ConvertTable, 0}, {
-	"g13", LOGITECH_VENDOR_ID, G13_ID, PC102ConvertTable, 0}, {
-	NULL, 0, 0, NULL, 0}
+	"n52", BELKIN_VENDOR_ID, NOSTROMO_N52_ID, N52ConvertTable}, {
+	"pc102", SYSTEM_VENDOR_ID, PS2_KEYBOARD_ID, PC102ConvertTable}, {
+	"keypad", CHERRY_VENDOR_ID, KEYPAD_ID, NumpadConvertTable}, {
+	"keypad", FUJSI_VENDOR_ID, KEYPAD2_ID, Numpad2ConvertTable}, {
+	"pgcu", SAITEK_VENDOR_ID, PGCU_ID, PgcuConvertTable}, {
+	"awkb", APPLE_VENDOR_ID, AWKB_ID, PC102ConvertTable}, {
+	"aawkb", APPLE_VENDOR_ID, AAWKB_ID, PC102ConvertTable}, {
+	"aakb", APPLE_VENDOR_ID, AAKB_ID, PC102ConvertTable}, {
+	"g13", LOGITECH_VENDOR_ID, G13_ID, PC102ConvertTable}, {
+	NULL, 0, 0, NULL}
 };
 
 #define MAX_INPUTS	32		///< max input devices supported
 int InputFds[MAX_INPUTS];		///< inputs
 int InputDid[MAX_INPUTS];		///< input device ID
 int InputLEDs[MAX_INPUTS];		///< inputs LED support
+unsigned InputLEDOn[MAX_INPUTS];	///< inputs LED shadow state
+unsigned InputLEDValid[MAX_INPUTS];	///< inputs LED shadow state known
 int InputFdsN;				///< number of Inputs
 
 int UInputFd;				///< output uinput file descriptor
+int OutputFd;				///< output events, uinput or writer pipe
+int UHidFd = -1;			///< output uhid keyboard, -1 not used
+int RepeatFd = -1;			///< autorepeat and swipe timer descriptor
+int InjectFd = -1;			///< injection socket, -1 not used
+int ControlFd = -1;			///< control socket, -1 not used
 
 int AOHKTimeout = 1000;			///< in: timeout used
 int AOHKExit;				///< in: exit program flag
@@ -407,6 +427,7 @@ static int OpenEvent(void)
 		    if (InputFdsN < MAX_INPUTS) {
 			InputDid[InputFdsN] = 0;
 			InputLEDs[InputFdsN] = EventCheckLEDs(fd);
+			InputLEDValid[InputFdsN] = 0;
 			InputFds[InputFdsN++] = fd;
 		    }
 		    goto found;
@@ -432,6 +453,7 @@ static int OpenEvent(void)
 			if (InputFdsN < MAX_INPUTS) {
 			    InputDid[InputFdsN] = j;
 			    InputLEDs[InputFdsN] = EventCheckLEDs(fd);
+			    InputLEDValid[InputFdsN] = 0;
 			    InputFds[InputFdsN++] = fd;
 			}
 			if (!NoConvertTable) {
@@ -458,24 +480,52 @@ static int OpenEvent(void)
     return InputFdsN;
 }
 
+static unsigned LEDWantOn;		///< LEDs wanted on
+static unsigned LEDWantSet;		///< LEDs wanted at all
+
 ///
-///	Turn LED on/off.
-///
-///	@param fd	file descriptor of input device
-///	@param num	led integer number
-///	@param state	true turn led on, false turn led off
+///	Write changed LEDs to all devices.
 ///
-///	@see LED_NUML, LED_CAPSL, LED_SCROLLL, ... in /usr/include/linux/input.h
+///	All LED changes since the last call are written with one syn report
+///	as one write per device.  LEDs already in the wanted state aren't
+///	written again, slow keyboards send a HID report for each write.
 ///
-static void EventLEDs(int fd, int num, int state)
+static void LEDFlush(void)
 {
-    struct input_event ev;
+    struct input_event ev[LED_CNT + 1];
+    unsigned changed;
+    int i;
+    int n;
+    int num;
 
-    ev.type = EV_LED;
-    ev.code = num;
-    ev.value = state;
-    if (write(fd, &ev, sizeof(ev)) < 0) {
-	perror("write()");
+    for (i = 0; i < InputFdsN; ++i) {
+	if (!InputLEDs[i]) {
+	    continue;
+	}
+	changed = LEDWantSet & (~InputLEDValid[i]
+	    | (InputLEDOn[i] ^ LEDWantOn));
+	if (!changed) {
+	    continue;
+	}
+	memset(ev, 0, sizeof(ev));
+	n = 0;
+	for (num = 0; num < LED_CNT; ++num) {
+	    if (changed & (1 << num)) {
+		ev[n].type = EV_LED;
+		ev[n].code = num;
+		ev[n].value = (LEDWantOn >> num) & 1;
+		++n;
+	    }
+	}
+	ev[n].type = EV_SYN;
+	ev[n].code = SYN_REPORT;
+	++n;
+	if (write(InputFds[i], ev, n * sizeof(*ev)) < 0) {
+	    perror("write()");
+	    continue;
+	}
+	InputLEDValid[i] |= changed;
+	InputLEDOn[i] = (InputLEDOn[i] & ~changed) | (LEDWantOn & changed);
     }
 }
 
@@ -505,26 +555,276 @@ static int TouchY2 = 1200 + 2333 + 100;	///< y2 of touchpad
 static int TouchY3 = 4750;		///< y3 of touchpad
 
 static int TouchLastSector;		///< last pressed sector
+static int TouchCandidate;		///< swipe sector entered
+static unsigned long TouchSince;	///< swipe sector entered at ms
+static unsigned long TouchDeadline;	///< ms a swipe candidate dwelt, 0 none
+
+static int TouchDwell = 50;		///< ms swipe must stay in new sector
+static int TouchHysteresis = 100;	///< swipe must be this deep in sector
+
+#define TOUCH_SLOTS	10		///< max multitouch contacts tracked
+
+///
+///	Multitouch contact, one slot of protocol B.
+///
+struct touch_slot
+{
+    int X;				///< x of contact
+    int Y;				///< y of contact
+    int Sector;				///< pressed sector, 0 none
+    int Candidate;			///< swipe sector entered
+    unsigned long Since;		///< swipe sector entered at ms
+    char Down;				///< contact touches the pad
+    char Changed;			///< contact changed since last syn
+};
+
+static int TouchMT;			///< device uses multitouch protocol B
+static int TouchSlot;			///< slot of following MT events
+static struct touch_slot TouchSlots[TOUCH_SLOTS];	///< MT contacts
+
+///
+///	Sector to internal key symbol.
+///
+static const int TouchSectorCodes[13] = { AOHK_KEY_0,
+    AOHK_KEY_1, AOHK_KEY_2, AOHK_KEY_3,
+    AOHK_KEY_4, AOHK_KEY_5, AOHK_KEY_6,
+    AOHK_KEY_7, AOHK_KEY_8, AOHK_KEY_9,
+    AOHK_KEY_HASH, AOHK_KEY_SPECIAL, AOHK_KEY_STAR
+};
 
 ///
 ///	Show LED.
 ///
+///	Only remembers the wanted state, LEDFlush() writes it.
+///
 ///	@param num	led integer number
 ///	@param state	true turn led on, false turn led off
 ///
 ///	@see LED_NUML, LED_CAPSL, LED_SCROLLL, ... in /usr/include/linux/input.h
 ///
 void AOHKShowLED(int num, int state)
+{
+    if (num < 0 || num >= LED_CNT) {
+	return;
+    }
+    LEDWantSet |= 1 << num;
+    if (state) {
+	LEDWantOn |= 1 << num;
+    } else {
+	LEDWantOn &= ~(1 << num);
+    }
+}
+
+///
+///	Convert touchpad position to sector.
+///
+///	@param x	x of touchpad
+///	@param y	y of touchpad
+///
+///	@returns sector 1-9 or 11 for the corner, 0 if out of range.
+///
+static int TouchSector(int x, int y)
+{
+    int sector;
+
+    if (x < TouchX0 || x > TouchX3 || y < TouchY0 || y > TouchY3) {
+	return 0;
+    }
+    if (x < TouchX2) {
+	if (x < TouchX1) {
+	    sector = 1;
+	} else {
+	    sector = 2;
+	}
+    } else {
+	sector = 3;
+    }
+    if (TouchXI) {
+	sector = 4 - sector;
+    }
+    if (y < TouchY2) {
+	if (y < TouchY1) {
+	    sector += TouchYI ? 0 : 6;
+	} else {
+	    sector += 3;
+	}
+    } else {
+	sector += TouchYI ? 6 : 0;
+    }
+    if (sector == 7 && x < TouchXC && y < TouchYC) {
+	Debug(3, "Corner %d\n", sector);
+	sector = 11;
+    }
+    return sector;
+}
+
+///
+///	Contact deep enough in sector.
+///
+///	The sector must be the same #TouchHysteresis away in all four
+///	directions.  The pad border isn't a sector border, the sample
+///	points are clamped to the pad.  In the small corner sector a third
+///	of its size is deep enough.
+///
+///	@param s	sector of contact
+///	@param x	x of contact
+///	@param y	y of contact
+///
+///	@returns true if the contact is deep in sector @a s.
+///
+static int TouchDeep(int s, int x, int y)
+{
+    int dx;
+    int dy;
+
+    dx = TouchHysteresis;
+    dy = TouchHysteresis;
+    if (s == 11) {
+	if (dx > (TouchXC - TouchX0) / 3) {
+	    dx = (TouchXC - TouchX0) / 3;
+	}
+	if (dy > (TouchYC - TouchY0) / 3) {
+	    dy = (TouchYC - TouchY0) / 3;
+	}
+    }
+    return s == TouchSector(x - dx < TouchX0 ? TouchX0 : x - dx, y)
+	&& s == TouchSector(x + dx > TouchX3 ? TouchX3 : x + dx, y)
+	&& s == TouchSector(x, y - dy < TouchY0 ? TouchY0 : y - dy)
+	&& s == TouchSector(x, y + dy > TouchY3 ? TouchY3 : y + dy);
+}
+
+///
+///	Follow a swipe gesture.
+///
+///	A contact pressed in sector A and moved into sector B, releases A
+///	and presses B, feeding the sequence A,B in one stroke.  The new
+///	sector must be entered deep (TouchDeep()) and the contact must
+///	stay #TouchDwell ms in it, crossed sectors are ignored.  A contact
+///	resting in the new sector sends no events, #TouchDeadline lets the
+///	timer finish the swipe.
+///
+///	@param timestamp	ms timestamp of event
+///	@param x		x of contact
+///	@param y		y of contact
+///	@param sector		sector currently pressed by the contact
+///	@param[in,out] candidate	swipe sector entered
+///	@param[in,out] since	ms timestamp candidate was entered
+///
+///	@returns new sector to press, 0 if the contact stays.
+///
+static int TouchSwipe(unsigned long timestamp, int x, int y, int sector,
+    int *candidate, unsigned long *since)
+{
+    int s;
+
+    s = TouchSector(x, y);
+    if (!s || s == sector || !TouchDeep(s, x, y)) {
+	*candidate = 0;
+	return 0;
+    }
+    if (s != *candidate) {		// just entered
+	*candidate = s;
+	*since = timestamp;
+    }
+    if (timestamp - *since < (unsigned long)TouchDwell) {
+	if (!TouchDeadline || *since + TouchDwell < TouchDeadline) {
+	    TouchDeadline = *since + TouchDwell;
+	}
+	return 0;
+    }
+    *candidate = 0;
+    Debug(3, "Swipe %d -> %d\n", sector, s);
+    AOHKFeedSymbol(timestamp, TouchSectorCodes[sector], 0);
+    AOHKFeedSymbol(timestamp, TouchSectorCodes[s], 1);
+
+    return s;
+}
+
+///
+///	Handle multitouch (protocol B) events.
+///
+///	Each contact is tracked in its own slot and presses its sector
+///	independent of the other contacts.  Holding quote (0) or repeat (#)
+///	with one finger and tapping with another gives chords.
+///
+///	@param timestamp	ms timestamp of event
+///	@param ev		input event
+///
+static void TouchMultiTouch(unsigned long timestamp,
+    const struct input_event *ev)
 {
     int i;
+    int sector;
+    struct touch_slot *slot;
 
-    //	Search device for LEDs.
-    for (i = 0; i < InputFdsN; ++i) {
-	if (InputLEDs[i]) {
-	    // printf("LED: %d\n", InputLEDs[i] );
-	    EventLEDs(InputFds[i], num, state);
+    if (ev->type == EV_SYN) {
+	for (i = 0; i < TOUCH_SLOTS; ++i) {
+	    slot = TouchSlots + i;
+	    if (!slot->Changed) {
+		continue;
+	    }
+	    slot->Changed = 0;
+	    if (!slot->Down) {		// contact lifted
+		if (slot->Sector) {
+		    // lifted in other sector, finish swipe
+		    sector = TouchSector(slot->X, slot->Y);
+		    if (sector && sector != slot->Sector) {
+			Debug(3, "Swipe %d -> %d\n", slot->Sector, sector);
+			AOHKFeedSymbol(timestamp,
+			    TouchSectorCodes[slot->Sector], 0);
+			AOHKFeedSymbol(timestamp, TouchSectorCodes[sector], 1);
+			slot->Sector = sector;
+		    }
+		    Debug(3, "Slot %d sector %d release\n", i, slot->Sector);
+		    AOHKFeedSymbol(timestamp, TouchSectorCodes[slot->Sector],
+			0);
+		    slot->Sector = 0;
+		}
+		slot->Candidate = 0;
+		continue;
+	    }
+	    if (slot->Sector) {		// moving contact
+		if ((sector =
+			TouchSwipe(timestamp, slot->X, slot->Y, slot->Sector,
+			    &slot->Candidate, &slot->Since))) {
+		    slot->Sector = sector;
+		}
+		continue;
+	    }
+	    if (!(sector = TouchSector(slot->X, slot->Y))) {
+		Debug(3, "Slot %d out of range\n", i);
+		continue;
+	    }
+	    Debug(3, "Slot %d sector %d press\n", i, sector);
+	    slot->Sector = sector;
+	    AOHKFeedSymbol(timestamp, TouchSectorCodes[sector], 1);
 	}
+	return;
+    }
+
+    if (ev->code == ABS_MT_SLOT) {
+	TouchSlot = ev->value;
+	return;
+    }
+    if (TouchSlot < 0 || TouchSlot >= TOUCH_SLOTS) {
+	Debug(3, "Slot %d unsupported\n", TouchSlot);
+	return;
+    }
+    slot = TouchSlots + TouchSlot;
+    switch (ev->code) {
+	case ABS_MT_TRACKING_ID:
+	    slot->Down = ev->value >= 0;
+	    break;
+	case ABS_MT_POSITION_X:
+	    slot->X = ev->value;
+	    break;
+	case ABS_MT_POSITION_Y:
+	    slot->Y = ev->value;
+	    break;
+	default:			// pressure, touch major, ...
+	    return;
     }
+    slot->Changed = 1;
 }
 
 ///
@@ -538,22 +838,15 @@ void AOHKShowLED(int num, int state)
 ///
 static void InputTouch(int did, int fd, const struct input_event *ev)
 {
-    int i;
     int sector;
-    int timestamp;
-
-    static int sector_codes[13] = { AOHK_KEY_0,
-	AOHK_KEY_1, AOHK_KEY_2, AOHK_KEY_3,
-	AOHK_KEY_4, AOHK_KEY_5, AOHK_KEY_6,
-	AOHK_KEY_7, AOHK_KEY_8, AOHK_KEY_9,
-	AOHK_KEY_HASH, AOHK_KEY_SPECIAL, AOHK_KEY_STAR
-    };
+    unsigned long timestamp;
 
     did = did;
 
     if (TouchFd == -1) {		// touchpad autodection
 	if (ev->code == BTN_TOUCH || ev->code == ABS_PRESSURE
-	    || ev->code == ABS_TOOL_WIDTH) {
+	    || ev->code == ABS_TOOL_WIDTH || ev->code == ABS_MT_SLOT
+	    || ev->code == ABS_MT_TRACKING_ID) {
 	    Debug(5, "touch device auto detected\n");
 	    TouchFd = fd;
 	} else {
@@ -564,19 +857,32 @@ static void InputTouch(int did, int fd, const struct input_event *ev)
     }
 
     if (AOHKCheckOffState()) {		// turned off
-	if (write(UInputFd, ev, sizeof(*ev)) != sizeof(*ev)) {
+	if (write(OutputFd, ev, sizeof(*ev)) != sizeof(*ev)) {
 	    perror("write");
 	}
 	// FIXME: can't turn touchpad on again!
 	return;
     }
 
-    timestamp = ev->time.tv_sec * 1000 + ev->time.tv_usec / 1000;
+    timestamp = ev->time.tv_sec * 1000UL + ev->time.tv_usec / 1000;
+
+    //
+    //	Multitouch device, the single touch emulation is ignored.
+    //
+    if (!TouchMT && ev->type == EV_ABS && ev->code >= ABS_MT_SLOT
+	&& ev->code <= ABS_MT_TOOL_Y) {
+	Debug(3, "multitouch device detected\n");
+	TouchMT = 1;
+    }
+    if (TouchMT && (ev->type == EV_SYN || (ev->type == EV_ABS
+		&& ev->code >= ABS_MT_SLOT && ev->code <= ABS_MT_TOOL_Y))) {
+	TouchMultiTouch(timestamp, ev);
+	return;
+    }
 
     if (ev->type == EV_SYN) {
 	//	Ignore out of range events
-	if (TouchX0 > TouchX || TouchX > TouchX3 || TouchY0 > TouchY
-	    || TouchY > TouchY3) {
+	if (!(sector = TouchSector(TouchX, TouchY))) {
 	    Debug(3, "out of range\n");
 	    return;
 	}
@@ -584,74 +890,31 @@ static void InputTouch(int did, int fd, const struct input_event *ev)
 	//	Unhandled button event
 	//
 	if (TouchB) {
-	    //	Convert to sector
-	    i = TouchX;
-	    if (i < TouchX0 || i > TouchX3) {
-		if (TouchB < 0) {
-		    if (TouchLastSector) {
-			AOHKFeedSymbol(timestamp,
-			    sector_codes[TouchLastSector], 0);
-		    }
-		    Debug(1, "x out of range\n");
-		    TouchB = 0;
-		}
-		return;
-	    }
-	    if (i < TouchX2) {
-		if (i < TouchX1) {
-		    sector = 1;
-		} else {
-		    sector = 2;
-		}
-	    } else {
-		sector = 3;
-	    }
-	    if (TouchXI) {
-		sector = 3 - sector;
-	    }
-	    i = TouchY;
-	    if (i < TouchY0 || i > TouchY3) {
-		if (TouchB < 0) {
-		    if (TouchLastSector) {
-			AOHKFeedSymbol(timestamp,
-			    sector_codes[TouchLastSector], 0);
-		    }
-		    Debug(1, "y out of range\n");
-		    TouchB = 0;
-		}
-		return;
-	    }
-	    if (i < TouchY2) {
-		if (i < TouchY1) {
-		    sector += TouchYI ? 0 : 6;
-		} else {
-		    sector += 3;
-		}
-	    } else {
-		sector += TouchYI ? 6 : 0;
-	    }
 	    TouchB++;			// to release code
-	    if (sector == 7 && TouchX < TouchXC && TouchY < TouchYC) {
-		Debug(3, "Corner %d %s\n", sector,
-		    TouchB ? "press" : "release");
-		sector = 11;
-	    }
 	    Debug(3, "Sector %d %s\n", sector, TouchB ? "press" : "release");
 	    // release not the same sector release the old sector
 	    if (TouchLastSector && TouchLastSector != sector) {
 		// release old sector, press new sector
-		AOHKFeedSymbol(timestamp, sector_codes[TouchLastSector], 0);
+		AOHKFeedSymbol(timestamp, TouchSectorCodes[TouchLastSector],
+		    0);
 		if (!TouchB) {		// release in new sector
-		    AOHKFeedSymbol(timestamp, sector_codes[sector], 1);
+		    AOHKFeedSymbol(timestamp, TouchSectorCodes[sector], 1);
 		}
 	    }
-	    AOHKFeedSymbol(timestamp, sector_codes[sector], TouchB);
+	    AOHKFeedSymbol(timestamp, TouchSectorCodes[sector], TouchB);
 	    if (TouchB) {		// remember to release
 		TouchLastSector = sector;
 	    } else {
 		TouchLastSector = 0;
 	    }
+	    TouchCandidate = 0;
 	    TouchB = 0;
+	} else if (TouchLastSector) {	// moving while pressed
+	    if ((sector =
+		    TouchSwipe(timestamp, TouchX, TouchY, TouchLastSector,
+			&TouchCandidate, &TouchSince))) {
+		TouchLastSector = sector;
+	    }
 	} else {
 	    Debug(1, "%d x:%d,y:%d,p:%d,r:%d\n", TouchB, TouchX, TouchY,
 		TouchP, TouchR);
@@ -661,20 +924,20 @@ static void InputTouch(int did, int fd, const struct input_event *ev)
     if (ev->type == EV_KEY) {
 	if (ev->code == BTN_LEFT) {
 	    Debug(1, "0 %s\n", ev->value ? "pressed" : "released");
-	    AOHKFeedSymbol(timestamp, sector_codes[0], ev->value);
+	    AOHKFeedSymbol(timestamp, TouchSectorCodes[0], ev->value);
 	    return;
 	}
 	if (ev->code == BTN_RIGHT) {
 	    Debug(1, "# %s\n", ev->value ? "pressed" : "released");
-	    AOHKFeedSymbol(timestamp, sector_codes[10], ev->value);
+	    AOHKFeedSymbol(timestamp, TouchSectorCodes[10], ev->value);
 	    return;
 	}
 	if (ev->code == BTN_MIDDLE) {
 	    Debug(1, "* %s\n", ev->value ? "pressed" : "released");
-	    AOHKFeedSymbol(timestamp, sector_codes[12], ev->value);
+	    AOHKFeedSymbol(timestamp, TouchSectorCodes[12], ev->value);
 	    return;
 	}
-	if (ev->code != BTN_TOUCH) {
+	if (ev->code != BTN_TOUCH || TouchMT) {
 	    return;
 	}
 	TouchB = ev->value ? 1 : -1;
@@ -711,126 +974,1097 @@ static void InputTouch(int did, int fd, const struct input_event *ev)
 }
 
 ///
-///	Input read.
-///	Read input from events, emulate aohk, output to uinput.
+///	Swipe dwell time reached.
 ///
-///	@param did	internal device id (#InputDevices) of input
-///	@param fd	file descriptor of input device
+///	Finishes the swipes of contacts resting in their new sector.
 ///
-///	@see InputDevices
+///	@param timestamp	ms timestamp now
 ///
-static void InputRead(int did, int fd)
+static void TouchTimeout(unsigned long timestamp)
 {
-    struct input_event ev;
+    struct touch_slot *slot;
+    int sector;
+    int i;
 
-    if (read(fd, &ev, sizeof(ev)) != sizeof(ev)) {
-	perror("read()");
-	return;
+    TouchDeadline = 0;
+    if (TouchLastSector && TouchCandidate
+	&& (sector = TouchSwipe(timestamp, TouchX, TouchY, TouchLastSector,
+		&TouchCandidate, &TouchSince))) {
+	TouchLastSector = sector;
     }
-    switch (ev.type) {
-	case EV_KEY:			// Key event
-	    if (ev.code >= BTN_MISC) {
-		Debug(4, "Key 0x%02X=%d %s\n", ev.code, ev.code,
-		    ev.value ? "pressed" : "released");
-		InputTouch(did, fd, &ev);
-		break;
-	    }
-	    // FIXME: 0x100 - 0x200
-	    // Feed into AOHK Statemachine
-	    AOHKFeedKey(ev.time.tv_sec * 1000 + ev.time.tv_usec / 1000,
-		ev.code - InputDevices[did].Offset, ev.value);
-	    break;
+    for (i = 0; i < TOUCH_SLOTS; ++i) {
+	slot = TouchSlots + i;
+	if (slot->Down && slot->Sector && slot->Candidate
+	    && (sector = TouchSwipe(timestamp, slot->X, slot->Y,
+		    slot->Sector, &slot->Candidate, &slot->Since))) {
+	    slot->Sector = sector;
+	}
+    }
+}
 
-	case EV_LED:			// Led event
-	    // Ignore
-	    break;
+//----------------------------------------------------------------------------
+//	Kernel keymap offload
+//----------------------------------------------------------------------------
 
-	case EV_MSC:			// Send by system keyboard
-	    // Ignore
-	    Debug(5, "msc for %d\n", fd);
-	    break;
-	case EV_SYN:			// Synchronization events
-	    // Ignore
-	    Debug(5, "syn for %d\n", fd);
-	    InputTouch(did, fd, &ev);
-	    break;
-	case EV_ABS:			// ABS event parse on.
-	    // ev.code: ABS_X, ABS_Y, ABS_PRESSURE, ABS_TOOLWIDTH
-	    Debug(6, "Event Type(%d,$%02x,%d) abs\n", ev.type, ev.code,
-		ev.value);
-	    InputTouch(did, fd, &ev);
-	    break;
+int RemapOffload;			///< offload pure remap modes to keymap
+static int RemapTried;			///< offload done for current mode
+static int RemapActive;			///< some inputs are remapped
+static struct input_keymap_entry *InputKeymap[MAX_INPUTS];	///< saved keymap
+static int InputKeymapN[MAX_INPUTS];	///< saved keymap entries
+static char InputRemapped[MAX_INPUTS];	///< input is remapped and ungrabbed
+static uint32_t InputScan[MAX_INPUTS];	///< last MSC_SCAN of remapped input
+static char InputScanned[MAX_INPUTS];	///< #InputScan belongs to next key
 
-	default:
-	    Debug(1, "Event Type(%d,%d,%d) unsupported\n", ev.type, ev.code,
-		ev.value);
-	    if (write(UInputFd, &ev, sizeof(ev)) != sizeof(ev)) {
-		perror("write");
+///
+///	Check if device reports scancodes.
+///
+///	@param fd	file descriptor of input device
+///
+///	@returns True if device sends MSC_SCAN.
+///
+static int EventCheckScan(int fd)
+{
+    unsigned char msc_bitmask[MSC_MAX / 8 + 1] = { 0 };
+
+    if (ioctl(fd, EVIOCGBIT(EV_MSC, sizeof(msc_bitmask)), msc_bitmask) < 0) {
+	return 0;
+    }
+    return (msc_bitmask[MSC_SCAN / 8] >> (MSC_SCAN % 8)) & 1;
+}
+
+///
+///	Read keymap of device.
+///
+///	@param fd	file descriptor of input device
+///	@param[out] keymap	malloced keymap entries
+///
+///	@returns number of keymap entries.
+///
+static int RemapRead(int fd, struct input_keymap_entry **keymap)
+{
+    struct input_keymap_entry *km;
+    struct input_keymap_entry *grow;
+    int n;
+
+    km = NULL;
+    for (n = 0;; ++n) {
+	if (!(n & 63)) {
+	    if (!(grow = realloc(km, (n + 64) * sizeof(*km)))) {
+		perror("realloc()");
+		break;
 	    }
+	    km = grow;
+	}
+	memset(km + n, 0, sizeof(*km));
+	km[n].flags = INPUT_KEYMAP_BY_INDEX;
+	km[n].index = n;
+	if (ioctl(fd, EVIOCGKEYCODE_V2, km + n) < 0) {
 	    break;
+	}
     }
+    *keymap = km;
+    return n;
 }
 
 ///
-///	Event Loop
+///	Write keymap entries to device.
 ///
-void EventLoop(void)
+///	@param fd	file descriptor of input device
+///	@param keymap	keymap entries, set by scancode
+///	@param n	number of keymap entries
+///
+static void RemapWrite(int fd, const struct input_keymap_entry *keymap, int n)
 {
-    struct pollfd fds[MAX_INPUTS + 1];
-    int ret;
+    struct input_keymap_entry ke;
     int i;
 
-    for (i = 0; i < InputFdsN; ++i) {
-	fds[i].fd = InputFds[i];
-	fds[i].events = POLLIN;
-	fds[i].revents = 0;
-    }
-
-    while (!AOHKExit) {
-	ret = poll(fds, InputFdsN, AOHKTimeout ? AOHKTimeout : -1);
-	if (ret < 0) {			// -1 error
-	    perror("poll()");
-	    continue;
-	}
-	if (!ret) {
-	    // FIXME: not correct. this can be longer
-	    AOHKFeedTimeout(AOHKTimeout);
-	    continue;
-	}
-	for (i = 0; i < InputFdsN; ++i) {
-	    if (fds[i].revents) {
-		InputRead(InputDid[i], fds[i].fd);
-		fds[i].revents = 0;
-	    }
+    for (i = 0; i < n; ++i) {
+	ke = keymap[i];
+	ke.flags = 0;
+	if (ioctl(fd, EVIOCSKEYCODE_V2, &ke) < 0) {
+	    perror("ioctl(EVIOCSKEYCODE_V2)");
 	}
     }
 }
 
 ///
-///	@details Key out, called from aohk module to output final scancodes.
+///	Check if a key leaving the mode is held on input device.
 ///
-///	@param key	linux scan code for key (/usr/include/linux/input.h)
-///	@param pressed	true key is pressed, false released.
+///	@param fd	file descriptor of input device
 ///
-void AOHKKeyOut(int key, int pressed)
+///	@returns true if held.
+///
+static int RemapHeld(int fd)
 {
-    if (pressed) {
-	UInputKeydown(UInputFd, key);
-    } else {
-	UInputKeyup(UInputFd, key);
+    unsigned char keys[KEY_MAX / 8 + 1];
+    int code;
+
+    memset(keys, 0, sizeof(keys));
+    if (ioctl(fd, EVIOCGKEY(sizeof(keys)), keys) < 0) {
+	return 0;
+    }
+    for (code = 0; code <= KEY_MAX; ++code) {
+	if ((keys[code / 8] >> (code % 8)) & 1 && AOHKRemapKey(code) < 0) {
+	    return 1;
+	}
     }
+    return 0;
 }
 
 ///
-///	Show firework. No time lost, need some delay to release start keys.
+///	Offload current mode to the keymap of the input devices.
 ///
-static void Firework(void)
+///	The keys of a remapped device reach the other clients without
+///	us, the device is ungrabbed.  The keys leaving the mode are mapped
+///	to #KEY_UNKNOWN, which every driver reports (atkbd and hid-input
+///	drop keys mapped to #KEY_RESERVED, hid-input even their MSC_SCAN).
+///	Keys the device reports as #KEY_UNKNOWN are dropped meanwhile.
+///	Hard off can't be left, the devices are only ungrabbed.
+///
+///	While a key leaving the mode is still held (the key entering it),
+///	nothing is offloaded, its release and repeats would be taken as
+///	exit.
+///
+///	@returns false if deferred, call again.
+///
+static int RemapOn(void)
 {
-    static const int8_t led_firework[][3] = {
-	{0, 0, 0},
-	{1, 0, 0},
-	{0, 1, 0},
-	{0, 0, 1},
+    struct input_keymap_entry *keymap;
+    struct input_keymap_entry ke;
+    int exit;
+    int code;
+    int fd;
+    int n;
+    int i;
+    int j;
+
+    for (i = 0; i < InputFdsN; ++i) {
+	if (RemapHeld(InputFds[i])) {
+	    return 0;
+	}
+    }
+    for (i = 0; i < InputFdsN; ++i) {
+	fd = InputFds[i];
+	keymap = NULL;
+	n = 0;
+	if (AOHKCheckOffState() < 0) {	// hard off: keymap unchanged
+	    goto ungrab;
+	}
+	if (!EventCheckScan(fd) || !(n = RemapRead(fd, &keymap))) {
+	    free(keymap);
+	    continue;
+	}
+	exit = 0;
+	for (j = 0; j < n; ++j) {
+	    ke = keymap[j];
+	    ke.flags = 0;
+	    if ((code = AOHKRemapKey(ke.keycode)) < 0) {
+		code = KEY_UNKNOWN;
+		exit = 1;
+	    } else if (code == KEY_UNKNOWN) {
+		code = KEY_RESERVED;
+	    }
+	    if ((unsigned)code == ke.keycode) {
+		continue;
+	    }
+	    ke.keycode = code;
+	    if (ioctl(fd, EVIOCSKEYCODE_V2, &ke) < 0) {
+		perror("ioctl(EVIOCSKEYCODE_V2)");
+		break;
+	    }
+	}
+	if (j < n || !exit) {		// failed or can't leave the mode
+	    RemapWrite(fd, keymap, j);
+	    free(keymap);
+	    continue;
+	}
+      ungrab:
+	if (ioctl(fd, EVIOCGRAB, 0) < 0) {
+	    perror("ioctl(EVIOCGRAB)");
+	}
+	Debug(2, "Input %d: mode offloaded to keymap\n", fd);
+	InputKeymap[i] = keymap;
+	InputKeymapN[i] = n;
+	InputRemapped[i] = 1;
+	InputScanned[i] = 0;
+	RemapActive = 1;
+    }
+    return 1;
+}
+
+///
+///	Restore keymaps and grab of the input devices.
+///
+static void RemapOff(void)
+{
+    int i;
+
+    for (i = 0; i < InputFdsN; ++i) {
+	if (!InputRemapped[i]) {
+	    continue;
+	}
+	RemapWrite(InputFds[i], InputKeymap[i], InputKeymapN[i]);
+	if (ioctl(InputFds[i], EVIOCGRAB, 1) < 0) {
+	    perror("ioctl(EVIOCGRAB)");
+	}
+	Debug(2, "Input %d: keymap restored\n", InputFds[i]);
+	free(InputKeymap[i]);
+	InputKeymap[i] = NULL;
+	InputKeymapN[i] = 0;
+	InputRemapped[i] = 0;
+    }
+    RemapActive = 0;
+}
+
+///
+///	Key leaving the mode pressed on remapped device.
+///
+///	Restores the keymaps and feeds the key with its original key code.
+///	The key is found by the MSC_SCAN sent before it, without one the
+///	first key leaving the mode is used, they all do the same.
+///
+///	@param i		index of input device (#InputFds)
+///	@param timestamp	ms timestamp of event
+///
+static void RemapExit(int i, unsigned long timestamp)
+{
+    const struct input_keymap_entry *ke;
+    uint32_t sc;
+    int code;
+    int j;
+
+    code = -1;
+    for (j = 0; j < InputKeymapN[i]; ++j) {
+	ke = InputKeymap[i] + j;
+	if (AOHKRemapKey(ke->keycode) >= 0) {
+	    continue;
+	}
+	if (code < 0) {
+	    code = ke->keycode;
+	}
+	sc = 0;
+	memcpy(&sc, ke->scancode, ke->len < sizeof(sc) ? ke->len : sizeof(sc));
+	if (InputScanned[i] && sc == InputScan[i]) {
+	    code = ke->keycode;
+	    break;
+	}
+    }
+    RemapOff();
+    RemapTried = 0;
+    if (code >= 0) {
+	AOHKFeedKey(timestamp, code, 1);
+	AOHKFeedKey(timestamp, code, 0);
+    }
+}
+
+///
+///	Check if the keymaps must follow a mode change.
+///
+///	Only with #RemapOffload.  Retried each round, until the key entering
+///	the mode is released.
+///
+static void RemapCheck(void)
+{
+    if (RemapOffload && AOHKRemapMode()) {
+	if (!RemapTried) {
+	    RemapTried = RemapOn();
+	}
+    } else if (RemapTried) {
+	RemapTried = 0;
+	RemapOff();
+    }
+}
+
+///
+///	Input event.
+///	Emulate aohk for one input event, output to uinput.
+///
+///	@param did	internal device id (#InputDevices) of input
+///	@param fd	file descriptor of input device
+///	@param evp	input event
+///
+///	@see InputDevices
+///
+static void InputEvent(int did, int fd, const struct input_event *evp)
+{
+    struct input_event ev;
+    int i;
+
+    AOHK_PROBE4(input, fd, evp->type, evp->code, evp->value);
+
+    //
+    //	Remapped: the kernel does the keys, watch for the mode exit
+    //	(#KEY_UNKNOWN).  Releases are still fed, keys pressed before the
+    //	remap are released.
+    //	Turned off nothing needs a release.
+    //
+    if (RemapActive) {
+	for (i = 0; i < InputFdsN && InputFds[i] != fd; ++i) {
+	}
+	if (i < InputFdsN && InputRemapped[i]) {
+	    if (evp->type == EV_MSC && evp->code == MSC_SCAN) {
+		InputScan[i] = evp->value;
+		InputScanned[i] = 1;
+		return;
+	    }
+	    if (evp->type == EV_KEY && evp->code == KEY_UNKNOWN) {
+		if (evp->value == 1) {
+		    RemapExit(i,
+			evp->time.tv_sec * 1000 + evp->time.tv_usec / 1000);
+		}
+		InputScanned[i] = 0;
+		return;
+	    }
+	    if (evp->type == EV_KEY) {
+		InputScanned[i] = 0;
+	    }
+	    if (evp->type != EV_KEY || evp->value || AOHKCheckOffState()) {
+		return;
+	    }
+	}
+    }
+
+    ev = *evp;
+    switch (ev.type) {
+	case EV_KEY:			// Key event
+	    // Mouse and touch buttons belong to the touchpad emulation
+	    if ((ev.code >= BTN_MOUSE && ev.code < BTN_JOYSTICK)
+		|| (ev.code >= BTN_DIGI && ev.code < BTN_WHEEL)) {
+		Debug(4, "Key 0x%02X=%d %s\n", ev.code, ev.code,
+		    ev.value ? "pressed" : "released");
+		InputTouch(did, fd, &ev);
+		break;
+	    }
+	    // Feed into AOHK Statemachine
+	    AOHKFeedKey(ev.time.tv_sec * 1000 + ev.time.tv_usec / 1000,
+		ev.code, ev.value);
+	    break;
+
+	case EV_LED:			// Led event
+	    // Ignore
+	    break;
+
+	case EV_MSC:			// Send by system keyboard
+	    // Ignore
+	    Debug(5, "msc for %d\n", fd);
+	    break;
+	case EV_SYN:			// Synchronization events
+	    // Ignore
+	    Debug(5, "syn for %d\n", fd);
+	    InputTouch(did, fd, &ev);
+	    break;
+	case EV_ABS:			// ABS event parse on.
+	    // ev.code: ABS_X, ABS_Y, ABS_PRESSURE, ABS_TOOLWIDTH
+	    Debug(6, "Event Type(%d,$%02x,%d) abs\n", ev.type, ev.code,
+		ev.value);
+	    InputTouch(did, fd, &ev);
+	    break;
+
+	default:
+	    Debug(1, "Event Type(%d,%d,%d) unsupported\n", ev.type, ev.code,
+		ev.value);
+	    if (write(OutputFd, &ev, sizeof(ev)) != sizeof(ev)) {
+		perror("write");
+	    }
+	    break;
+    }
+}
+
+///
+///	Input read.
+///	Read input from events, emulate aohk, output to uinput.
+///
+///	@param did	internal device id (#InputDevices) of input
+///	@param fd	file descriptor of input device
+///
+///	@see InputDevices
+///
+static void InputRead(int did, int fd)
+{
+    struct input_event ev;
+
+    if (read(fd, &ev, sizeof(ev)) != sizeof(ev)) {
+	perror("read()");
+	return;
+    }
+    InputEvent(did, fd, &ev);
+}
+
+//----------------------------------------------------------------------------
+//	Threaded pipeline
+//----------------------------------------------------------------------------
+
+#define RING_SIZE	256		///< events per ring, power of 2
+
+///
+///	Input ring, single producer (reader thread), single consumer
+///	(engine thread).
+///
+struct input_ring
+{
+    struct input_event Event[RING_SIZE];	///< events
+    unsigned Head;			///< next write, only producer writes
+    unsigned Tail;			///< next read, only consumer writes
+    int Waiting;			///< producer sleeps on full ring
+    int SpaceFd;			///< eventfd wakes producer
+    int Did;				///< internal device id of input
+    int Fd;				///< file descriptor of input device
+    int Cpu;				///< pin reader to cpu, -1 not pinned
+    pthread_t Thread;			///< reader thread
+};
+
+int Threaded;				///< use reader and writer threads
+static int ThreadCpus[2 + MAX_INPUTS];	///< engine, writer, readers cpu
+static int ThreadCpusN;			///< number of pinned threads
+
+static struct input_ring InputRings[MAX_INPUTS];	///< reader rings
+static int ThreadWakeFd = -1;		///< eventfd wakes engine
+static int WriterPipe = -1;		///< read side of output pipe
+static pthread_t WriterThread;		///< uinput writer thread
+
+///
+///	Pin thread to cpu.
+///
+///	@param thread	thread to pin
+///	@param cpu	cpu number, -1 not pinned
+///
+static void ThreadPin(pthread_t thread, int cpu)
+{
+    cpu_set_t set;
+
+    if (cpu < 0) {
+	return;
+    }
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    if (pthread_setaffinity_np(thread, sizeof(set), &set)) {
+	Debug(0, "Can't pin thread to cpu %d\n", cpu);
+    }
+}
+
+///
+///	Reader thread, one for each input device.
+///
+///	@param arg	input ring of device
+///
+static void *ReaderThread(void *arg)
+{
+    struct input_ring *ring;
+    struct input_event ev[64];
+    ssize_t n;
+    int i;
+    unsigned head;
+    uint64_t one;
+    uint64_t count;
+
+    ring = arg;
+    one = 1;
+    for (;;) {
+	n = read(ring->Fd, ev, sizeof(ev));
+	if (n < (ssize_t) sizeof(*ev)) {
+	    if (n < 0 && errno == EINTR) {
+		continue;
+	    }
+	    perror("read()");
+	    return NULL;
+	}
+	n /= sizeof(*ev);
+	head = ring->Head;
+	for (i = 0; i < n; ++i) {
+	    // ring full, sleep until the engine made room
+	    while (head - __atomic_load_n(&ring->Tail, __ATOMIC_ACQUIRE)
+		>= RING_SIZE) {
+		__atomic_store_n(&ring->Waiting, 1, __ATOMIC_SEQ_CST);
+		if (head - __atomic_load_n(&ring->Tail, __ATOMIC_SEQ_CST)
+		    < RING_SIZE) {
+		    continue;
+		}
+		// engine must see the events queued so far
+		if (write(ThreadWakeFd, &one, sizeof(one)) < 0) {
+		    perror("write()");
+		}
+		if (read(ring->SpaceFd, &count, sizeof(count)) < 0
+		    && errno != EINTR) {
+		    perror("read()");
+		    return NULL;
+		}
+	    }
+	    ring->Event[head % RING_SIZE] = ev[i];
+	    __atomic_store_n(&ring->Head, ++head, __ATOMIC_RELEASE);
+	}
+	if (write(ThreadWakeFd, &one, sizeof(one)) < 0) {
+	    perror("write()");
+	}
+    }
+}
+
+///
+///	Engine: feed all queued input events in timestamp order.
+///
+///	A reader sleeping on its full ring is woken, after the tail moved.
+///
+static void ThreadDrain(void)
+{
+    static const uint64_t one = 1;
+    uint64_t count;
+    struct input_ring *ring;
+    struct input_ring *best;
+    const struct input_event *ev;
+    const struct input_event *best_ev;
+    int i;
+
+    if (read(ThreadWakeFd, &count, sizeof(count)) < 0) {
+	return;
+    }
+    for (;;) {
+	best = NULL;
+	best_ev = NULL;
+	for (i = 0; i < InputFdsN; ++i) {
+	    ring = InputRings + i;
+	    if (ring->Tail == __atomic_load_n(&ring->Head, __ATOMIC_ACQUIRE)) {
+		continue;
+	    }
+	    ev = ring->Event + ring->Tail % RING_SIZE;
+	    if (!best_ev || timercmp(&ev->time, &best_ev->time, <)) {
+		best = ring;
+		best_ev = ev;
+	    }
+	}
+	if (!best) {
+	    break;
+	}
+	InputEvent(best->Did, best->Fd, best_ev);
+	__atomic_store_n(&best->Tail, best->Tail + 1, __ATOMIC_SEQ_CST);
+	if (__atomic_load_n(&best->Waiting, __ATOMIC_SEQ_CST)
+	    && __atomic_exchange_n(&best->Waiting, 0, __ATOMIC_SEQ_CST)
+	    && write(best->SpaceFd, &one, sizeof(one)) < 0) {
+	    perror("write()");
+	}
+    }
+}
+
+///
+///	Writer thread, writes output of engine to uinput.
+///
+///	The engine writes complete event reports into a pipe, a slow
+///	uinput write doesn't stop reading of the inputs.
+///
+static void *WriterThreadMain(void __attribute__((unused)) * arg)
+{
+    struct input_event ev[64];
+    ssize_t n;
+
+    for (;;) {
+	n = read(WriterPipe, ev, sizeof(ev));
+	if (n <= 0) {
+	    if (n < 0 && errno == EINTR) {
+		continue;
+	    }
+	    return NULL;		// engine closed pipe
+	}
+	if (write(UInputFd, ev, n) != n) {
+	    perror("write()");
+	}
+	AOHK_PROBE2(uinput_write, UInputFd, n / sizeof(*ev));
+    }
+}
+
+///
+///	Start reader and writer threads.
+///
+///	The writer thread owns the writes to #UInputFd, the engine writes
+///	its output events to the returned pipe.
+///
+///	@returns file descriptor the engine writes its output to, -1 failure.
+///
+static int ThreadStart(void)
+{
+    int pipefd[2];
+    int i;
+
+    if ((ThreadWakeFd = eventfd(0, EFD_CLOEXEC)) < 0) {
+	perror("eventfd()");
+	return -1;
+    }
+    if (pipe(pipefd) < 0) {
+	perror("pipe()");
+	return -1;
+    }
+    WriterPipe = pipefd[0];
+    if (pthread_create(&WriterThread, NULL, WriterThreadMain, NULL)) {
+	Debug(0, "Can't create writer thread\n");
+	return -1;
+    }
+    ThreadPin(pthread_self(), ThreadCpusN > 0 ? ThreadCpus[0] : -1);
+    ThreadPin(WriterThread, ThreadCpusN > 1 ? ThreadCpus[1] : -1);
+
+    for (i = 0; i < InputFdsN; ++i) {
+	InputRings[i].Did = InputDid[i];
+	InputRings[i].Fd = InputFds[i];
+	InputRings[i].Cpu = ThreadCpusN > 2 + i ? ThreadCpus[2 + i] : -1;
+	if ((InputRings[i].SpaceFd = eventfd(0, EFD_CLOEXEC)) < 0) {
+	    perror("eventfd()");
+	    return -1;
+	}
+	if (pthread_create(&InputRings[i].Thread, NULL, ReaderThread,
+		InputRings + i)) {
+	    Debug(0, "Can't create reader thread\n");
+	    return -1;
+	}
+	ThreadPin(InputRings[i].Thread, InputRings[i].Cpu);
+    }
+    Debug(1, "Threaded pipeline with %d readers\n", InputFdsN);
+
+    return pipefd[1];
+}
+
+///
+///	Stop reader and writer threads.
+///
+///	@param fd	file descriptor returned by ThreadStart()
+///
+static void ThreadStop(int fd)
+{
+    int i;
+
+    for (i = 0; i < InputFdsN; ++i) {
+	pthread_cancel(InputRings[i].Thread);
+	pthread_join(InputRings[i].Thread, NULL);
+	close(InputRings[i].SpaceFd);
+    }
+    close(fd);				// writer drains pipe and stops
+    pthread_join(WriterThread, NULL);
+    close(WriterPipe);
+    close(ThreadWakeFd);
+}
+
+///
+///	Next deadline of the timer, autorepeat or swipe dwell.
+///
+///	@returns ms deadline, 0 none.
+///
+static unsigned long TimerDeadline(void)
+{
+    if (TouchDeadline && (!AOHKRepeatTimeout
+	    || TouchDeadline < AOHKRepeatTimeout)) {
+	return TouchDeadline;
+    }
+    return AOHKRepeatTimeout;
+}
+
+///
+///	Arm autorepeat timer.
+///
+///	Input event timestamps are CLOCK_REALTIME, the timer uses absolute
+///	deadlines of the same clock.
+///
+///	@param timeout	ms deadline of next repeat, 0 disarms timer
+///
+static void RepeatArm(unsigned long timeout)
+{
+    struct itimerspec its;
+
+    memset(&its, 0, sizeof(its));
+    its.it_value.tv_sec = timeout / 1000;
+    its.it_value.tv_nsec = (timeout % 1000) * 1000000;
+    if (timerfd_settime(RepeatFd, TFD_TIMER_ABSTIME, &its, NULL) < 0) {
+	perror("timerfd_settime()");
+    }
+}
+
+///
+///	Autorepeat or swipe timer expired.
+///
+static void RepeatRead(void)
+{
+    uint64_t expirations;
+    struct timespec now;
+    unsigned long timestamp;
+
+    if (read(RepeatFd, &expirations, sizeof(expirations)) < 0) {
+	return;				// disarmed or rearmed meanwhile
+    }
+    clock_gettime(CLOCK_REALTIME, &now);
+    timestamp = now.tv_sec * 1000UL + now.tv_nsec / 1000000;
+    if (TouchDeadline && timestamp >= TouchDeadline) {
+	TouchTimeout(timestamp);
+    }
+    AOHKFeedRepeat(timestamp);
+}
+
+//----------------------------------------------------------------------------
+//	Injection socket
+//----------------------------------------------------------------------------
+
+#define INJECT_BURST	8		///< max datagrams per loop round
+
+static const char *InjectPath;		///< path of injection socket
+
+///
+///	Open unix datagram socket.
+///
+///	@param path	file name of unix socket
+///
+///	@returns socket file descriptor, -1 if failure.
+///
+static int SocketOpen(const char *path)
+{
+    struct sockaddr_un addr;
+    int fd;
+
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+	Debug(0, "Socket path '%s' too long\n", path);
+	return -1;
+    }
+    fd = socket(AF_UNIX, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+	perror("socket()");
+	return -1;
+    }
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, path);
+    unlink(path);			// stale socket of last run
+    if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+	perror("bind()");
+	close(fd);
+	return -1;
+    }
+    chmod(path, 0660);
+
+    return fd;
+}
+
+///
+///	Open injection socket.
+///
+///	The queue of a unix datagram socket is limited by the sysctl
+///	net.unix.max_dgram_qlen datagrams (SO_RCVBUF is ignored), a slow
+///	daemon blocks the clients instead of queuing seconds of input.
+///
+///	@param path	file name of unix socket
+///
+///	@returns socket file descriptor, -1 if failure.
+///
+static int InjectOpen(const char *path)
+{
+    int fd;
+
+    if ((fd = SocketOpen(path)) < 0) {
+	return -1;
+    }
+    InjectPath = path;
+
+    return fd;
+}
+
+///
+///	Close injection socket.
+///
+static void InjectClose(void)
+{
+    close(InjectFd);
+    unlink(InjectPath);
+    InjectFd = -1;
+}
+
+///
+///	Injection socket readable.
+///
+///	Reads at most #INJECT_BURST datagrams, the input devices aren't
+///	starved by a flooding client.  The frames are rebased to now, but
+///	never before the last key fed, time of the state machine can't go
+///	backwards.
+///
+static void InjectRead(void)
+{
+    struct aohk_inject frame[AOHK_INJECT_MAX];
+    struct timespec now;
+    unsigned long timestamp;
+    uint32_t last;
+    ssize_t size;
+    int burst;
+    int n;
+    int i;
+
+    for (burst = 0; burst < INJECT_BURST; ++burst) {
+	size = recv(InjectFd, frame, sizeof(frame), MSG_TRUNC);
+	if (size < 0) {
+	    if (errno != EAGAIN && errno != EINTR) {
+		perror("recv()");
+	    }
+	    return;
+	}
+	if (!size || size > (ssize_t) sizeof(frame)
+	    || size % sizeof(*frame)) {
+	    Debug(1, "Inject datagram of %zd bytes ignored\n", size);
+	    continue;
+	}
+	n = size / sizeof(*frame);
+	clock_gettime(CLOCK_REALTIME, &now);
+	timestamp = now.tv_sec * 1000UL + now.tv_nsec / 1000000;
+	last = frame[n - 1].Time;
+	for (i = 0; i < n; ++i) {
+	    unsigned long ts;
+
+	    ts = timestamp - (uint32_t) (last - frame[i].Time);
+	    if (ts < AOHKLastTick) {
+		ts = AOHKLastTick;
+	    }
+	    switch (frame[i].Type) {
+		case AOHK_INJECT_SYMBOL:
+		    if (frame[i].Code >= AOHK_KEY_NOP || frame[i].Value > 1) {
+			break;
+		    }
+		    AOHKFeedSymbol(ts, frame[i].Code, frame[i].Value);
+		    continue;
+		case AOHK_INJECT_KEY:
+		    if (frame[i].Code > KEY_MAX || frame[i].Value > 1) {
+			break;
+		    }
+		    AOHKFeedKey(ts, frame[i].Code, frame[i].Value);
+		    continue;
+	    }
+	    Debug(1, "Inject frame %d,%d,%d ignored\n", frame[i].Type,
+		frame[i].Code, frame[i].Value);
+	}
+    }
+}
+
+//----------------------------------------------------------------------------
+//	Control socket
+//----------------------------------------------------------------------------
+
+#define CONTROL_BURST	4		///< max datagrams per loop round
+#define CONTROL_SIZE	1024		///< max datagram size
+
+static const char *ControlPath;		///< path of control socket
+
+///
+///	Open control socket.
+///
+///	@param path	file name of unix socket
+///
+///	@returns socket file descriptor, -1 if failure.
+///
+static int ControlOpen(const char *path)
+{
+    int fd;
+
+    if ((fd = SocketOpen(path)) >= 0) {
+	ControlPath = path;
+    }
+    return fd;
+}
+
+///
+///	Close control socket.
+///
+static void ControlClose(void)
+{
+    close(ControlFd);
+    unlink(ControlPath);
+    ControlFd = -1;
+}
+
+///
+///	Control socket readable.
+///
+///	A datagram holds one command per line, the replies of all lines go
+///	back in one datagram, if the client has bound an address.  The
+///	commands run here in the engine thread between the input frames,
+///	the state machine needs no locks.  A client not reading its replies
+///	loses them, the daemon never blocks.
+///
+static void ControlRead(void)
+{
+    char buf[CONTROL_SIZE + 1];
+    char reply[CONTROL_SIZE];
+    struct sockaddr_un addr;
+    socklen_t addrlen;
+    ssize_t size;
+    char *line;
+    char *next;
+    int burst;
+    int n;
+
+    for (burst = 0; burst < CONTROL_BURST; ++burst) {
+	addrlen = sizeof(addr);
+	size = recvfrom(ControlFd, buf, CONTROL_SIZE, 0,
+	    (struct sockaddr *)&addr, &addrlen);
+	if (size < 0) {
+	    if (errno != EAGAIN && errno != EINTR) {
+		perror("recvfrom()");
+	    }
+	    return;
+	}
+	buf[size] = '\0';
+	n = 0;
+	for (line = buf; line; line = next) {
+	    if ((next = strchr(line, '\n'))) {
+		*next++ = '\0';
+	    }
+	    if (!*line || n >= CONTROL_SIZE - 1) {
+		continue;
+	    }
+	    AOHKControl(line, reply + n, CONTROL_SIZE - n);
+	    n += strlen(reply + n);
+	}
+	if (n && addrlen > sizeof(sa_family_t)) {
+	    if (sendto(ControlFd, reply, n, MSG_DONTWAIT,
+		    (struct sockaddr *)&addr, addrlen) < 0) {
+		Debug(1, "Control reply lost: %s\n", strerror(errno));
+	    }
+	}
+    }
+}
+
+///
+///	Event Loop
+///
+void EventLoop(void)
+{
+    struct pollfd fds[MAX_INPUTS + 3];
+    unsigned long repeat;
+    int ret;
+    int i;
+    int n;
+    int inputs;
+    int inject;
+    int control;
+
+    if (Threaded) {			// readers wake us
+	fds[0].fd = ThreadWakeFd;
+	fds[0].events = POLLIN;
+	fds[0].revents = 0;
+	inputs = 1;
+    } else {
+	for (i = 0; i < InputFdsN; ++i) {
+	    fds[i].fd = InputFds[i];
+	    fds[i].events = POLLIN;
+	    fds[i].revents = 0;
+	}
+	inputs = InputFdsN;
+    }
+    n = inputs;
+    RepeatFd = timerfd_create(CLOCK_REALTIME, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (RepeatFd < 0) {
+	perror("timerfd_create()");
+    } else {
+	fds[n].fd = RepeatFd;
+	fds[n].events = POLLIN;
+	fds[n].revents = 0;
+	++n;
+    }
+    inject = -1;
+    if (InjectFd >= 0) {
+	fds[n].fd = InjectFd;
+	fds[n].events = POLLIN;
+	fds[n].revents = 0;
+	inject = n++;
+    }
+    control = -1;
+    if (ControlFd >= 0) {
+	fds[n].fd = ControlFd;
+	fds[n].events = POLLIN;
+	fds[n].revents = 0;
+	control = n++;
+    }
+    repeat = 0;
+
+    while (!AOHKExit) {
+	ret = poll(fds, n, AOHKTimeout ? AOHKTimeout : -1);
+	if (ret < 0) {			// -1 error
+	    perror("poll()");
+	    continue;
+	}
+	if (!ret) {
+	    // FIXME: not correct. this can be longer
+	    AOHKFeedTimeout(AOHKTimeout);
+	} else {
+	    for (i = 0; i < inputs; ++i) {
+		if (fds[i].revents) {
+		    if (Threaded) {
+			ThreadDrain();
+		    } else {
+			InputRead(InputDid[i], fds[i].fd);
+		    }
+		    fds[i].revents = 0;
+		}
+	    }
+	    if (RepeatFd >= 0 && fds[inputs].revents) {
+		RepeatRead();
+		fds[inputs].revents = 0;
+	    }
+	    if (inject >= 0 && fds[inject].revents) {
+		InjectRead();
+		fds[inject].revents = 0;
+	    }
+	    if (control >= 0 && fds[control].revents) {
+		ControlRead();
+		fds[control].revents = 0;
+	    }
+	}
+	RemapCheck();
+	LEDFlush();
+	if (UHidFd >= 0) {
+	    UHidSync(UHidFd);
+	}
+	if (RepeatFd >= 0 && repeat != TimerDeadline()) {
+	    repeat = TimerDeadline();
+	    RepeatArm(repeat);
+	}
+    }
+    if (RepeatFd >= 0) {
+	close(RepeatFd);
+	RepeatFd = -1;
+    }
+}
+
+///
+///	@details Key out, called from aohk module to output final scancodes.
+///
+///	@param key	linux scan code for key (/usr/include/linux/input.h)
+///	@param pressed	1 key is pressed, 0 released, 2 repeated.
+///
+void AOHKKeyOut(int key, int pressed)
+{
+    if (UHidFd >= 0) {
+	if (UHidKey(UHidFd, key, pressed)) {
+	    return;
+	}
+	UHidSync(UHidFd);		// keep order with uinput keys
+    }
+    if (pressed == 2) {
+	UInputKeyrepeat(OutputFd, key);
+    } else if (pressed) {
+	UInputKeydown(OutputFd, key);
+    } else {
+	UInputKeyup(OutputFd, key);
+    }
+}
+
+///
+///	Pointer output of the mouse mode.
+///
+///	@param dx	relative x motion
+///	@param dy	relative y motion
+///
+void AOHKPointerOut(int dx, int dy)
+{
+    UInputRel(OutputFd, dx, dy);
+}
+
+///
+///	Show firework. No time lost, need some delay to release start keys.
+///
+static void Firework(void)
+{
+    static const int8_t led_firework[][3] = {
+	{0, 0, 0},
+	{1, 0, 0},
+	{0, 1, 0},
+	{0, 0, 1},
 	{0, 1, 0},
 	{1, 0, 0},
 	{0, 1, 0},
@@ -848,6 +2082,7 @@ static void Firework(void)
 	AOHKShowLED(0, led_firework[i][0]);
 	AOHKShowLED(1, led_firework[i][1]);
 	AOHKShowLED(2, led_firework[i][2]);
+	LEDFlush();
 	usleep(100000);
     }
 }
@@ -877,6 +2112,8 @@ static int ParseGeometry(const char *string, int *x, int *y, unsigned *width,
     unsigned th;
 
     mask = 0;
+    tx = ty = 0;
+    tw = th = 0;
     if (!string || !*string) {		// empty or null string
 	return mask;
     }
@@ -937,10 +2174,10 @@ static int ParseGeometry(const char *string, int *x, int *y, unsigned *width,
     if (mask & 2) {
 	*y = ty;
     }
-    if (mask & 3) {
+    if (mask & 4) {
 	*width = tw;
     }
-    if (mask & 4) {
+    if (mask & 8) {
 	*height = th;
     }
     return mask;
@@ -980,10 +2217,18 @@ int main(int argc, char *const *argv)
     int background;
     const char *save;
     const char *lang;
+    const char *output;
+    const char *inject;
+    const char *control;
+    const char *dict;
 
     lang = "de";			// My choice :>
     background = 0;
     save = NULL;
+    output = "uinput";
+    inject = NULL;
+    control = NULL;
+    dict = NULL;
     SysLog = 0;
 
     //
@@ -993,11 +2238,17 @@ int main(int argc, char *const *argv)
     //		...
     //
     for (;;) {
-	switch (getopt(argc, argv, "DLQ:bd:e:g:l:np:s:v:h?-")) {
+	switch (getopt(argc, argv, "C:DLQ:a:bc:d:e:g:i:kl:m:no:p:r:s:t:u:v:w:h?-")) {
+	    case 'a':			// adaptive timeout percentile
+		AOHKSetAdaptiveTimeout(strtol(optarg, NULL, 0));
+		continue;
 	    case 'b':			// background
 		background = 1;
 		SysLog = 1;
 		continue;
+	    case 'c':			// chord window
+		AOHKSetChordWindow(strtol(optarg, NULL, 0));
+		continue;
 	    case 'd':			// device
 		UseDev = optarg;
 		continue;
@@ -1012,6 +2263,8 @@ int main(int argc, char *const *argv)
 		unsigned w;
 		unsigned h;
 
+		x = y = 0;		// missing parts of the geometry
+		w = h = 0;
 		m = ParseGeometry(optarg, &x, &y, &w, &h);
 		printf("%x = %dx%d%+d%+d\n", m, w, h, x, y);
 
@@ -1036,27 +2289,115 @@ int main(int argc, char *const *argv)
 
 	    }
 		continue;
+	    case 'k':			// kernel keymap offload
+		RemapOffload = 1;
+		continue;
 	    case 'l':			// language
-		if (strlen(optarg) != 2) {
-		    fprintf(stderr,
-			"%s\nUse 2 character language codes. FE. 'de', 'us'\n",
-			TITLE);
-		    return -1;
-		}
 		lang = optarg;
 		continue;
 	    case 'n':			// no leds
 		NoLed = 1;
 		continue;
+	    case 'm':			// mouse keys speed,max,ramp
+	    {
+		char *s;
+		int speed;
+		int max;
+		int ramp;
+
+		speed = strtol(optarg, &s, 0);
+		max = speed;
+		ramp = 1;
+		if (*s == ',') {
+		    max = strtol(s + 1, &s, 0);
+		    if (*s == ',') {
+			ramp = strtol(s + 1, NULL, 0);
+		    }
+		}
+		AOHKSetMouse(speed, max, ramp);
+	    }
+		continue;
+	    case 'i':			// input method dictionary
+		dict = optarg;
+		continue;
+	    case 'o':			// output backend
+		output = optarg;
+		continue;
 	    case 'p':			// product id
 		UseProduct = strtol(optarg, NULL, 0);
 		continue;
+	    case 'r':			// autorepeat [mode:]delay,rate
+	    {
+		static const char *const modes[AOHK_REPEAT_MODES] = {
+		    "normal", "game", "number"
+		};
+		char *s;
+		int m;
+		int delay;
+		int rate;
+
+		s = optarg;
+		m = -1;			// all modes
+		for (i = 0; i < AOHK_REPEAT_MODES; ++i) {
+		    size_t l;
+
+		    l = strlen(modes[i]);
+		    if (!strncmp(s, modes[i], l) && s[l] == ':') {
+			m = i;
+			s += l + 1;
+			break;
+		    }
+		}
+		delay = strtol(s, &s, 0);
+		rate = 0;
+		if (*s == ',') {
+		    rate = strtol(s + 1, NULL, 0);
+		}
+		for (i = 0; i < AOHK_REPEAT_MODES; ++i) {
+		    if (m < 0 || m == i) {
+			AOHKSetRepeat(i, delay, rate);
+		    }
+		}
+	    }
+		continue;
 	    case 's':			// save internal tables
 		save = optarg;
 		continue;
+	    case 't':			// threaded, cpus to pin
+	    {
+		char *s;
+
+		Threaded = 1;
+		ThreadCpusN = 0;
+		s = optarg;
+		while (*s && ThreadCpusN < 2 + MAX_INPUTS) {
+		    ThreadCpus[ThreadCpusN++] = strtol(s, &s, 0);
+		    if (*s != ',') {
+			break;
+		    }
+		    ++s;
+		}
+	    }
+		continue;
+	    case 'u':			// injection socket
+		inject = optarg;
+		continue;
 	    case 'v':			// vendor id
 		UseVendor = strtol(optarg, NULL, 0);
 		continue;
+	    case 'w':			// swipe dwell,hysteresis
+	    {
+		char *s;
+
+		TouchDwell = strtol(optarg, &s, 0);
+		if (*s == ',') {
+		    TouchHysteresis = strtol(s + 1, NULL, 0);
+		}
+	    }
+		continue;
+	    case 'C':			// control socket
+		control = optarg;
+		continue;
 	    case 'D':			// debug
 		DebugLevel++;
 		continue;
@@ -1083,13 +2424,29 @@ int main(int argc, char *const *argv)
 		    "-b\tBackground, run as daemon\n"
 		    "-L\tList all available input devices\n"
 		    "-D\tIncrease debug level\n"
+		    "-c ms\tKeys pressed together within ms are a chord\n"
+		    "-a pct\tAdapt timeouts to percentile of typing gaps\n"
+		    "-r [mode:]ms,n\tAutorepeat delay and rate of mode\n"
+		    "\tmode normal, game or number, default all. n=0 off\n"
+		    "-m px,px,ms\tMouse mode speed, max speed and ms to max\n"
+		    "-t cpus\tThread per input, engine and writer thread\n"
+		    "\tpinned to cpus engine,writer,reader... (-1 not pinned)\n"
+		    "-k\tLet the keymap of the device do pure remap modes\n"
+		    "\tand the off states\n"
+		    "-u path\tRead injected keys from unix datagram socket\n"
+		    "-C path\tRead control commands from unix datagram socket\n"
+		    "-i dict\tPinyin input method dictionary, toggle SPECIAL USR1\n"
 		    "-d dev\tUse only this input device\n"
 		    "-e n\tAlso use this /dev/input/eventN device\n"
 		    "-v id\tAlso use the input device with vendor id\n"
 		    "-p id\tAlso use the input device with product id\n"
 		    "-g geo\tGeometry of the touch device <width>x<height>{+-}<xoffset>{+-}<yoffset\n"
+		    "-w ms[,n]\tSwipe dwell time and hysteresis of the touch device\n"
 		    "-n\tNo leds, some control goes wired with leds\n"
-		    "-l lang\tUse internal language table (de,us)\n"
+		    "-o out\tKey output uinput, uhid (boot protocol reports)\n"
+		    "\tor uhid-nkro (all keys reports)\n"
+		    "-l lang\tUse compiled language tables (xx of xx.default.map)\n"
+		    "\tfe. -l de,us, switch with SPECIAL *\n"
 		    "-s file\tSave internal tables\nSupported input devices: ",
 		    TITLE, argv[0], argv[0]);
 		ListSupportedDevices();
@@ -1132,6 +2489,10 @@ int main(int argc, char *const *argv)
 	AOHKLoadTable(argv[i]);
     }
 
+    if (dict && ImeOpen(dict)) {
+	return -1;
+    }
+
     if (save) {				// save resulting tables and exit
 	AOHKSaveTable(save);
 	return -1;
@@ -1146,17 +2507,54 @@ int main(int argc, char *const *argv)
     //	Open output device
     //
     ufd = OpenUInput("ALE OneHand Keyboard");
+    if (ufd >= 0 && strcmp(output, "uinput")) {
+	// keys without HID usage, pointer and passthrough stay on uinput
+	if (!strcmp(output, "uhid") || !strcmp(output, "uhid-nkro")) {
+	    UHidFd = OpenUHid("ALE OneHand HID Keyboard",
+		!strcmp(output, "uhid-nkro"));
+	} else {
+	    Debug(0, "Unknown output '%s'\n", output);
+	}
+	if (UHidFd < 0) {
+	    CloseUInput(ufd);
+	    return -1;
+	}
+    }
     if (ufd >= 0) {
 	UInputFd = ufd;
+	OutputFd = ufd;
 	if (!background && !SysLog) {
 	    printf("Press SPECIAL 5 to exit\n");
 	}
 	//sleep(1);			// sleep 1s for key release
 	Firework();
+	if (inject && (InjectFd = InjectOpen(inject)) < 0) {
+	    return -1;
+	}
+	if (control && (ControlFd = ControlOpen(control)) < 0) {
+	    return -1;
+	}
+	if (Threaded && (OutputFd = ThreadStart()) < 0) {
+	    return -1;
+	}
 	EventLoop();
+	RemapOff();
+	if (Threaded) {
+	    ThreadStop(OutputFd);
+	}
+	if (InjectFd >= 0) {
+	    InjectClose();
+	}
+	if (ControlFd >= 0) {
+	    ControlClose();
+	}
+	if (UHidFd >= 0) {
+	    CloseUHid(UHidFd);
+	}
 
 	CloseUInput(ufd);
     }
+    ImeClose();
     //
     //	Close input devices, cleanup
     //
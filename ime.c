@@ -0,0 +1,498 @@
+///
+///	@file ime.c	@brief	pinyin input method.
+///
+///	Copyright (c) 2007,2009 by Lutz Sammer.	 All Rights Reserved.
+///
+///	Contributor(s):
+///
+///	This file is part of ALE one-hand keyboard
+///
+///	This program is free software; you can redistribute it and/or modify
+///	it under the terms of the GNU General Public License as published by
+///	the Free Software Foundation; only version 2 of the License.
+///
+///	This program is distributed in the hope that it will be useful,
+///	but WITHOUT ANY WARRANTY; without even the implied warranty of
+///	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+///	GNU General Public License for more details.
+///
+///	$Id$
+////////////////////////////////////////////////////////////////////////////
+
+///	@defgroup ime The input method module.
+///
+///	Letters typed with the sequence tables build a romanization (pinyin)
+///	buffer, the dictionary returns the ranked candidates of the buffer
+///	as prefix.
+///
+///	The dictionary is compiled from a text file (key text frequency per
+///	line) by aohkmc -i.  Every prefix of every key is a node with its
+///	#IME_TOP best texts, exact keys first, precomputed.  A lookup is a
+///	binary search over the nodes, nothing is parsed or allocated at
+///	runtime, the file is only mapped.
+///
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "ime.h"
+
+static const struct ime_prefix *ImePrefix;	///< mapped prefix nodes
+static const char *ImePool;		///< mapped string pool
+static uint32_t ImePrefixes;		///< number of prefix nodes
+static uint32_t ImePoolSize;		///< bytes of string pool
+static void *ImeMap;			///< mapped dictionary file
+static size_t ImeMapSize;		///< size of mapping
+
+static char ImeKey[IME_KEY_MAX + 1];	///< romanization buffer
+static int ImeKeyN;			///< letters in buffer
+static const struct ime_prefix *ImeNode;	///< node of buffer, NULL none
+
+//----------------------------------------------------------------------------
+//	Compiler
+//----------------------------------------------------------------------------
+
+///
+///	Dictionary source entry.
+///
+struct ime_source
+{
+    char *Key;				///< romanization
+    char *Text;				///< UTF-8 text
+    unsigned Freq;			///< frequency, higher first
+    uint32_t Offset;			///< pool offset of text
+};
+
+///
+///	Prefix of a source entry.
+///
+struct ime_pair
+{
+    const struct ime_source *Entry;	///< source entry
+    int Len;				///< prefix length of key
+};
+
+///
+///	Compare pairs: prefix, exact key first, frequency.
+///
+static int ImePairCmp(const void *a, const void *b)
+{
+    const struct ime_pair *x;
+    const struct ime_pair *y;
+    int r;
+
+    x = a;
+    y = b;
+    if ((r = memcmp(x->Entry->Key, y->Entry->Key,
+		x->Len < y->Len ? x->Len : y->Len))) {
+	return r;
+    }
+    if (x->Len != y->Len) {
+	return x->Len - y->Len;
+    }
+    r = !x->Entry->Key[x->Len] - !y->Entry->Key[y->Len];
+    if (r) {
+	return -r;
+    }
+    if (x->Entry->Freq != y->Entry->Freq) {
+	return x->Entry->Freq > y->Entry->Freq ? -1 : 1;
+    }
+    return strcmp(x->Entry->Text, y->Entry->Text);
+}
+
+///
+///	Add string to pool.
+///
+///	@param pool	pool buffer, grows
+///	@param size	bytes used
+///	@param max	bytes allocated
+///	@param s	string
+///	@param l	length of string
+///
+///	@returns pool offset of string.
+///
+static uint32_t ImePoolAdd(char **pool, uint32_t * size, uint32_t * max,
+    const char *s, size_t l)
+{
+    uint32_t offset;
+
+    while (*size + l + 1 > *max) {
+	*max = *max ? 2 * *max : 65536;
+	*pool = realloc(*pool, *max);
+    }
+    offset = *size;
+    memcpy(*pool + offset, s, l);
+    (*pool)[offset + l] = '\0';
+    *size += l + 1;
+
+    return offset;
+}
+
+///
+///	Compile dictionary source into dictionary file.
+///
+///	@param in	source file, lines "key text frequency", # comments
+///	@param out	dictionary file, - stdout
+///
+///	@returns 0 success, -1 failure.
+///
+int ImeCompile(const char *in, const char *out)
+{
+    FILE *fp;
+    struct ime_source *entries;
+    struct ime_pair *pairs;
+    struct ime_prefix *nodes;
+    struct ime_header header;
+    char *pool;
+    char line[256];
+    char key[IME_KEY_MAX + 1];
+    char text[128];
+    unsigned freq;
+    uint32_t size;
+    uint32_t max;
+    int n;
+    int entries_max;
+    int pairs_n;
+    int nodes_n;
+    int linenr;
+    int i;
+    int j;
+    int k;
+
+    if (!(fp = fopen(in, "r"))) {
+	perror(in);
+	return -1;
+    }
+    entries = NULL;
+    entries_max = 0;
+    n = 0;
+    pairs_n = 0;
+    linenr = 0;
+    while (fgets(line, sizeof(line), fp)) {
+	++linenr;
+	if (*line == '#' || *line == '\n') {
+	    continue;
+	}
+	if (sscanf(line, "%32s %127s %u", key, text, &freq) != 3
+	    || strspn(key, "abcdefghijklmnopqrstuvwxyz") != strlen(key)) {
+	    fprintf(stderr, "%s:%d: bad line '%s'\n", in, linenr, line);
+	    continue;
+	}
+	if (n == entries_max) {
+	    entries_max = entries_max ? 2 * entries_max : 1024;
+	    entries = realloc(entries, entries_max * sizeof(*entries));
+	}
+	entries[n].Key = strdup(key);
+	entries[n].Text = strdup(text);
+	entries[n].Freq = freq;
+	pairs_n += strlen(key);
+	++n;
+    }
+    fclose(fp);
+
+    //
+    //	Pool offset 0 is the empty string, end of candidates.
+    //
+    pool = NULL;
+    size = 0;
+    max = 0;
+    ImePoolAdd(&pool, &size, &max, "", 0);
+    for (i = 0; i < n; ++i) {
+	entries[i].Offset =
+	    ImePoolAdd(&pool, &size, &max, entries[i].Text,
+	    strlen(entries[i].Text));
+    }
+
+    //
+    //	All prefixes, sorted.  Equal prefixes are a node.
+    //
+    pairs = malloc(pairs_n * sizeof(*pairs) + 1);
+    for (i = k = 0; i < n; ++i) {
+	for (j = 1; entries[i].Key[j - 1]; ++j) {
+	    pairs[k].Entry = entries + i;
+	    pairs[k].Len = j;
+	    ++k;
+	}
+    }
+    qsort(pairs, pairs_n, sizeof(*pairs), ImePairCmp);
+
+    nodes = calloc(pairs_n + 1, sizeof(*nodes));
+    nodes_n = 0;
+    for (i = 0; i < pairs_n; i = j) {
+	nodes[nodes_n].Key =
+	    ImePoolAdd(&pool, &size, &max, pairs[i].Entry->Key, pairs[i].Len);
+	for (j = i, k = 0; j < pairs_n && pairs[j].Len == pairs[i].Len
+	    && !memcmp(pairs[j].Entry->Key, pairs[i].Entry->Key,
+		pairs[i].Len); ++j) {
+	    if (k < IME_TOP) {
+		nodes[nodes_n].Top[k++] = pairs[j].Entry->Offset;
+	    }
+	}
+	++nodes_n;
+    }
+
+    if (!strcmp(out, "-")) {
+	fp = stdout;
+    } else if (!(fp = fopen(out, "w"))) {
+	perror(out);
+	return -1;
+    }
+    memset(&header, 0, sizeof(header));
+    memcpy(header.Magic, IME_MAGIC, sizeof(header.Magic));
+    header.Prefixes = nodes_n;
+    header.PoolSize = size;
+    fwrite(&header, sizeof(header), 1, fp);
+    fwrite(nodes, sizeof(*nodes), nodes_n, fp);
+    fwrite(pool, 1, size, fp);
+    if (fp != stdout) {
+	fclose(fp);
+    }
+    fprintf(stderr, "%s: %d entries, %d prefixes, %u bytes\n", out, n,
+	nodes_n, (unsigned)(sizeof(header) + nodes_n * sizeof(*nodes)
+	    + size));
+
+    for (i = 0; i < n; ++i) {
+	free(entries[i].Key);
+	free(entries[i].Text);
+    }
+    free(entries);
+    free(pairs);
+    free(nodes);
+    free(pool);
+
+    return 0;
+}
+
+//----------------------------------------------------------------------------
+//	Dictionary
+//----------------------------------------------------------------------------
+
+///
+///	Map dictionary file.
+///
+///	Only the header is checked, the pages are read on first lookup.
+///
+///	@param file	dictionary file compiled by ImeCompile()
+///
+///	@returns 0 success, -1 failure.
+///
+int ImeOpen(const char *file)
+{
+    const struct ime_header *header;
+    struct stat st;
+    int fd;
+
+    if ((fd = open(file, O_RDONLY | O_CLOEXEC)) < 0) {
+	perror(file);
+	return -1;
+    }
+    if (fstat(fd, &st) < 0 || (size_t)st.st_size < sizeof(*header)) {
+	fprintf(stderr, "%s: no dictionary\n", file);
+	close(fd);
+	return -1;
+    }
+    ImeMapSize = st.st_size;
+    ImeMap = mmap(NULL, ImeMapSize, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (ImeMap == MAP_FAILED) {
+	perror(file);
+	ImeMap = NULL;
+	return -1;
+    }
+
+    header = ImeMap;
+    if (memcmp(header->Magic, IME_MAGIC, sizeof(header->Magic))
+	|| sizeof(*header) + (size_t)header->Prefixes * sizeof(*ImePrefix)
+	+ header->PoolSize != ImeMapSize || !header->PoolSize
+	|| ((const char *)ImeMap)[ImeMapSize - 1]) {
+	fprintf(stderr, "%s: bad dictionary\n", file);
+	ImeClose();
+	return -1;
+    }
+    ImePrefixes = header->Prefixes;
+    ImePoolSize = header->PoolSize;
+    ImePrefix = (const struct ime_prefix *)(header + 1);
+    ImePool = (const char *)(ImePrefix + ImePrefixes);
+    ImeReset();
+
+    return 0;
+}
+
+///
+///	Unmap dictionary file.
+///
+void ImeClose(void)
+{
+    if (ImeMap) {
+	munmap(ImeMap, ImeMapSize);
+    }
+    ImeMap = NULL;
+    ImePrefix = NULL;
+    ImePrefixes = 0;
+    ImeNode = NULL;
+}
+
+///
+///	Check if dictionary is mapped.
+///
+int ImeReady(void)
+{
+    return ImePrefix != NULL;
+}
+
+///
+///	String of pool.
+///
+///	@param offset	pool offset, from the mapped file
+///
+///	@returns string, empty string if @a offset is bad.
+///
+static const char *ImeString(uint32_t offset)
+{
+    return offset < ImePoolSize ? ImePool + offset : "";
+}
+
+///
+///	Find prefix node of romanization buffer.
+///
+///	@returns node, NULL if the buffer isn't a known prefix.
+///
+static const struct ime_prefix *ImeLookup(void)
+{
+    uint32_t lo;
+    uint32_t hi;
+    uint32_t mid;
+    int r;
+
+    lo = 0;
+    hi = ImePrefixes;
+    while (lo < hi) {
+	mid = (lo + hi) / 2;
+	r = strncmp(ImeKey, ImeString(ImePrefix[mid].Key), IME_KEY_MAX + 1);
+	if (!r) {
+	    return ImePrefix + mid;
+	}
+	if (r < 0) {
+	    hi = mid;
+	} else {
+	    lo = mid + 1;
+	}
+    }
+    return NULL;
+}
+
+//----------------------------------------------------------------------------
+//	Romanization buffer
+//----------------------------------------------------------------------------
+
+///
+///	Add letter to romanization buffer.
+///
+///	@param c	letter a-z
+///
+///	@returns true if added, false buffer full.
+///
+int ImeAdd(int c)
+{
+    if (ImeKeyN == IME_KEY_MAX) {
+	return 0;
+    }
+    ImeKey[ImeKeyN++] = c;
+    ImeKey[ImeKeyN] = '\0';
+    ImeNode = ImeLookup();
+    return 1;
+}
+
+///
+///	Delete last letter of romanization buffer.
+///
+void ImeDelete(void)
+{
+    if (ImeKeyN) {
+	ImeKey[--ImeKeyN] = '\0';
+	ImeNode = ImeKeyN ? ImeLookup() : NULL;
+    }
+}
+
+///
+///	Clear romanization buffer.
+///
+void ImeReset(void)
+{
+    ImeKeyN = 0;
+    ImeKey[0] = '\0';
+    ImeNode = NULL;
+}
+
+///
+///	Current romanization buffer.
+///
+const char *ImeInput(void)
+{
+    return ImeKey;
+}
+
+///
+///	Candidate of romanization buffer.
+///
+///	@param n	rank, 0 best
+///
+///	@returns UTF-8 text, NULL if none.
+///
+const char *ImeCandidate(int n)
+{
+    const char *s;
+
+    if (!ImeNode || n < 0 || n >= IME_TOP || !ImeNode->Top[n]) {
+	return NULL;
+    }
+    s = ImeString(ImeNode->Top[n]);
+    return *s ? s : NULL;
+}
+
+///
+///	Decode next code point of UTF-8 text.
+///
+///	@param[in,out] s	text, advanced behind the code point
+///
+///	@returns code point, 0 at end of text.
+///
+unsigned ImeUtf8(const char **s)
+{
+    const unsigned char *p;
+    unsigned c;
+    int n;
+
+    p = (const unsigned char *)*s;
+    if (!*p) {
+	return 0;
+    }
+    c = *p++;
+    if (c >= 0xF0) {
+	c &= 0x07;
+	n = 3;
+    } else if (c >= 0xE0) {
+	c &= 0x0F;
+	n = 2;
+    } else if (c >= 0xC0) {
+	c &= 0x1F;
+	n = 1;
+    } else {
+	n = 0;
+    }
+    for (; n && (*p & 0xC0) == 0x80; --n) {
+	c = (c << 6) | (*p++ & 0x3F);
+    }
+    *s = (const char *)p;
+
+    return c;
+}
+
+/// @}
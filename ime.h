@@ -0,0 +1,69 @@
+///
+///	@file ime.h	@brief	pinyin input method headerfile.
+///
+///	Copyright (c) 2007,2009 by Lutz Sammer.	 All Rights Reserved.
+///
+///	Contributor(s):
+///
+///	This file is part of ALE one-hand keyboard
+///
+///	This program is free software; you can redistribute it and/or modify
+///	it under the terms of the GNU General Public License as published by
+///	the Free Software Foundation; only version 2 of the License.
+///
+///	This program is distributed in the hope that it will be useful,
+///	but WITHOUT ANY WARRANTY; without even the implied warranty of
+///	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+///	GNU General Public License for more details.
+///
+///	$Id$
+////////////////////////////////////////////////////////////////////////////
+
+/// @addtogroup ime
+/// @{
+
+#include <stdint.h>
+
+#define IME_MAGIC	"AOHKIME1"	///< dictionary file magic
+#define IME_TOP		8		///< candidates per prefix
+#define IME_KEY_MAX	32		///< max romanization length
+
+///
+///	Dictionary file header, host byte order.
+///
+///	The header is followed by the prefix nodes, sorted by their key,
+///	and the string pool of NUL terminated keys and UTF-8 texts.
+///
+struct ime_header
+{
+    char Magic[8];			///< #IME_MAGIC
+    uint32_t Prefixes;			///< number of prefix nodes
+    uint32_t PoolSize;			///< bytes of string pool
+};
+
+///
+///	Prefix node, all candidates of a romanization prefix.
+///
+struct ime_prefix
+{
+    uint32_t Key;			///< pool offset of prefix
+    uint32_t Top[IME_TOP];		///< pool offsets of ranked texts, 0 end
+};
+
+//----------------------------------------------------------------------------
+//	Prototypes
+//----------------------------------------------------------------------------
+
+extern int ImeCompile(const char *, const char *);	///< compile dictionary
+extern int ImeOpen(const char *);	///< map dictionary
+extern void ImeClose(void);		///< unmap dictionary
+extern int ImeReady(void);		///< dictionary is mapped
+
+extern int ImeAdd(int);			///< add letter to romanization
+extern void ImeDelete(void);		///< delete last letter
+extern void ImeReset(void);		///< clear romanization
+extern const char *ImeInput(void);	///< current romanization
+extern const char *ImeCandidate(int);	///< ranked candidate text
+extern unsigned ImeUtf8(const char **);	///< next code point of text
+
+/// @}
@@ -0,0 +1,58 @@
+///
+///	@file inject.h	@brief	symbol injection socket protocol
+///
+///	Copyright (c) 2007,2009 by Lutz Sammer.	 All Rights Reserved.
+///
+///	Contributor(s):
+///
+///	This file is part of ALE one-hand keyboard
+///
+///	This program is free software; you can redistribute it and/or modify
+///	it under the terms of the GNU General Public License as published by
+///	the Free Software Foundation; only version 2 of the License.
+///
+///	This program is distributed in the hope that it will be useful,
+///	but WITHOUT ANY WARRANTY; without even the implied warranty of
+///	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+///	GNU General Public License for more details.
+///
+///	$Id$
+////////////////////////////////////////////////////////////////////////////
+
+///	@defgroup inject The symbol injection socket.
+///
+///	Local clients (remotes, kiosks, test drivers) send datagrams to the
+///	unix socket of the daemon (aohkd -u path).  A datagram is an array
+///	of up to #AOHK_INJECT_MAX frames, fed in order into the state
+///	machine.  The frame timestamps are relative: the last frame of the
+///	datagram is "now", the others keep their distance to it.
+///
+///	Frames are never older than the last key fed, from a device or
+///	a former datagram.
+///
+///	The daemon reads the socket like an input device.  When it falls
+///	behind, the socket queue (net.unix.max_dgram_qlen datagrams) fills
+///	and the clients block (or get EAGAIN with MSG_DONTWAIT), no datagram
+///	is dropped.
+///
+/// @{
+
+#include <stdint.h>
+
+#define AOHK_INJECT_SYMBOL	0	///< code is internal key symbol
+#define AOHK_INJECT_KEY		1	///< code is linux key code
+
+#define AOHK_INJECT_MAX		64	///< max frames per datagram
+
+///
+///	Injection frame, host byte order.
+///
+struct aohk_inject
+{
+    uint32_t Time;			///< ms timestamp of client clock
+    uint16_t Code;			///< internal key symbol or key code
+    uint8_t Type;			///< #AOHK_INJECT_SYMBOL, ...
+    uint8_t Value;			///< 0 release, 1 press
+};
+
+/// @}
@@ -0,0 +1,62 @@
+///
+///	@file probe.h	@brief	static tracepoints
+///
+///	Copyright (c) 2007,2009 by Lutz Sammer.	 All Rights Reserved.
+///
+///	Contributor(s):
+///
+///	This file is part of ALE one-hand keyboard
+///
+///	This program is free software; you can redistribute it and/or modify
+///	it under the terms of the GNU General Public License as published by
+///	the Free Software Foundation; only version 2 of the License.
+///
+///	This program is distributed in the hope that it will be useful,
+///	but WITHOUT ANY WARRANTY; without even the implied warranty of
+///	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+///	GNU General Public License for more details.
+///
+///	$Id$
+////////////////////////////////////////////////////////////////////////////
+
+///	@defgroup probe The static tracepoints.
+///
+///	USDT probes of provider aohk, build with make USE_SDT=1 (needs
+///	sys/sdt.h of systemtap).  A disabled probe is a nop instruction,
+///	without USE_SDT the probes compile to nothing.
+///
+///	@see aohk-latency.bt
+///
+/// @{
+
+#ifdef USE_SDT
+
+#include <sys/sdt.h>
+
+#define AOHK_PROBE1(name, a) \
+    DTRACE_PROBE1(aohk, name, a)
+#define AOHK_PROBE2(name, a, b) \
+    DTRACE_PROBE2(aohk, name, a, b)
+#define AOHK_PROBE3(name, a, b, c) \
+    DTRACE_PROBE3(aohk, name, a, b, c)
+#define AOHK_PROBE4(name, a, b, c, d) \
+    DTRACE_PROBE4(aohk, name, a, b, c, d)
+
+#else
+
+    /// probe with 1 argument
+#define AOHK_PROBE1(name, a) \
+	((void)(a))
+    /// probe with 2 arguments
+#define AOHK_PROBE2(name, a, b) \
+	((void)(a), (void)(b))
+    /// probe with 3 arguments
+#define AOHK_PROBE3(name, a, b, c) \
+	((void)(a), (void)(b), (void)(c))
+    /// probe with 4 arguments
+#define AOHK_PROBE4(name, a, b, c, d) \
+	((void)(a), (void)(b), (void)(c), (void)(d))
+
+#endif
+
+/// @}
@@ -0,0 +1,352 @@
+///
+///	@file uhid.c	@brief	linux uhid modul
+///
+///	Copyright (c) 2007,2009 by Lutz Sammer.	 All Rights Reserved.
+///
+///	Contributor(s):
+///
+///	This file is part of ALE one-hand keyboard
+///
+///	This program is free software; you can redistribute it and/or modify
+///	it under the terms of the GNU General Public License as published by
+///	the Free Software Foundation; only version 2 of the License.
+///
+///	This program is distributed in the hope that it will be useful,
+///	but WITHOUT ANY WARRANTY; without even the implied warranty of
+///	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+///	GNU General Public License for more details.
+///
+///	$Id$
+////////////////////////////////////////////////////////////////////////////
+
+///	@defgroup uhid The uhid module.
+///
+///	Virtual HID keyboard over /dev/uhid.
+///
+///	Key changes are collected into whole keyboard reports (modifier byte
+///	and keys).  A report is only written, when a change would undo a
+///	not yet sent change, or by UHidSync().  Shift + key press is one
+///	write instead of four uinput event pairs.
+///
+///	Boot protocol (6 keys) or NKRO (bitmap of all keys) reports are
+///	supported.  The kernel's hid-input creates an input device for it,
+///	which can be tested with evtest like any other keyboard.
+///
+
+#include <linux/input.h>
+#include <linux/uhid.h>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include <stdio.h>
+#include <stddef.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "uhid.h"
+
+//	*INDENT-OFF*
+
+///
+///	HID keyboard usage to linux keycode, like hid-input of the kernel.
+///
+static const unsigned char UHidKeyboard[256] = {
+      0,  0,  0,  0, 30, 48, 46, 32, 18, 33, 34, 35, 23, 36, 37, 38,
+     50, 49, 24, 25, 16, 19, 31, 20, 22, 47, 17, 45, 21, 44,  2,  3,
+      4,  5,  6,  7,  8,  9, 10, 11, 28,  1, 14, 15, 57, 12, 13, 26,
+     27, 43, 43, 39, 40, 41, 51, 52, 53, 58, 59, 60, 61, 62, 63, 64,
+     65, 66, 67, 68, 87, 88, 99, 70,119,110,102,104,111,107,109,106,
+    105,108,103, 69, 98, 55, 74, 78, 96, 79, 80, 81, 75, 76, 77, 71,
+     72, 73, 82, 83, 86,127,116,117,183,184,185,186,187,188,189,190,
+    191,192,193,194,134,138,130,132,128,129,131,137,133,135,136,113,
+    115,114,  0,  0,  0,121,  0, 89, 93,124, 92, 94, 95,  0,  0,  0,
+    122,123, 90, 91, 85,  0,  0,  0,  0,  0,  0,  0,111,  0,  0,  0,
+      0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+      0,  0,  0,  0,  0,  0,179,180,  0,  0,  0,  0,  0,  0,  0,  0,
+      0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+      0,  0,  0,  0,  0,  0,  0,  0,111,  0,  0,  0,  0,  0,  0,  0,
+     29, 42, 56,125, 97, 54,100,126,164,166,165,163,161,115,114,113,
+    150,158,159,128,136,177,178,176,142,152,173,140,  0,  0,  0,  0
+};
+
+///
+///	Boot protocol keyboard report descriptor.
+///	Report: modifier byte, reserved byte, 6 key usages.
+///
+static const unsigned char UHidBootDescriptor[] = {
+    0x05, 0x01,				// Usage Page (Generic Desktop)
+    0x09, 0x06,				// Usage (Keyboard)
+    0xA1, 0x01,				// Collection (Application)
+    0x05, 0x07,				//   Usage Page (Keyboard)
+    0x19, 0xE0,				//   Usage Minimum (Left Control)
+    0x29, 0xE7,				//   Usage Maximum (Right GUI)
+    0x15, 0x00,				//   Logical Minimum (0)
+    0x25, 0x01,				//   Logical Maximum (1)
+    0x75, 0x01,				//   Report Size (1)
+    0x95, 0x08,				//   Report Count (8)
+    0x81, 0x02,				//   Input (Data, Variable, Absolute)
+    0x95, 0x01,				//   Report Count (1)
+    0x75, 0x08,				//   Report Size (8)
+    0x81, 0x01,				//   Input (Constant)
+    0x95, 0x05,				//   Report Count (5)
+    0x75, 0x01,				//   Report Size (1)
+    0x05, 0x08,				//   Usage Page (LEDs)
+    0x19, 0x01,				//   Usage Minimum (Num Lock)
+    0x29, 0x05,				//   Usage Maximum (Kana)
+    0x91, 0x02,				//   Output (Data, Variable, Absolute)
+    0x95, 0x01,				//   Report Count (1)
+    0x75, 0x03,				//   Report Size (3)
+    0x91, 0x01,				//   Output (Constant)
+    0x95, 0x06,				//   Report Count (6)
+    0x75, 0x08,				//   Report Size (8)
+    0x15, 0x00,				//   Logical Minimum (0)
+    0x26, 0xE7, 0x00,			//   Logical Maximum (231)
+    0x05, 0x07,				//   Usage Page (Keyboard)
+    0x19, 0x00,				//   Usage Minimum (0)
+    0x29, 0xE7,				//   Usage Maximum (231)
+    0x81, 0x00,				//   Input (Data, Array)
+    0xC0				// End Collection
+};
+
+///
+///	NKRO keyboard report descriptor.
+///	Report: modifier byte, bitmap of usages 0 - 223.
+///
+static const unsigned char UHidNkroDescriptor[] = {
+    0x05, 0x01,				// Usage Page (Generic Desktop)
+    0x09, 0x06,				// Usage (Keyboard)
+    0xA1, 0x01,				// Collection (Application)
+    0x05, 0x07,				//   Usage Page (Keyboard)
+    0x19, 0xE0,				//   Usage Minimum (Left Control)
+    0x29, 0xE7,				//   Usage Maximum (Right GUI)
+    0x15, 0x00,				//   Logical Minimum (0)
+    0x25, 0x01,				//   Logical Maximum (1)
+    0x75, 0x01,				//   Report Size (1)
+    0x95, 0x08,				//   Report Count (8)
+    0x81, 0x02,				//   Input (Data, Variable, Absolute)
+    0x19, 0x00,				//   Usage Minimum (0)
+    0x29, 0xDF,				//   Usage Maximum (223)
+    0x96, 0xE0, 0x00,			//   Report Count (224)
+    0x81, 0x02,				//   Input (Data, Variable, Absolute)
+    0x95, 0x05,				//   Report Count (5)
+    0x05, 0x08,				//   Usage Page (LEDs)
+    0x19, 0x01,				//   Usage Minimum (Num Lock)
+    0x29, 0x05,				//   Usage Maximum (Kana)
+    0x91, 0x02,				//   Output (Data, Variable, Absolute)
+    0x95, 0x01,				//   Report Count (1)
+    0x75, 0x03,				//   Report Size (3)
+    0x91, 0x01,				//   Output (Constant)
+    0xC0				// End Collection
+};
+
+//	*INDENT-ON*
+
+static unsigned char UHidUsage[256];	///< linux keycode to HID usage
+static int UHidNkro;			///< send NKRO reports
+
+static unsigned char UHidDown[32];	///< usages pressed
+static unsigned char UHidPressed[32];	///< usages pressed since report
+static unsigned char UHidReleased[32];	///< usages released since report
+static int UHidPending;			///< changes not yet sent
+
+///
+///	Open uhid keyboard.
+///
+///	@param name	name of the uhid device
+///	@param nkro	true NKRO reports, false boot protocol reports
+///
+///	@returns uhid file descriptor, -1 if failure.
+///
+int OpenUHid(const char *name, int nkro)
+{
+    int i;
+    int fd;
+    struct uhid_event ev;
+
+    //	reverse usage table, first usage of keycode wins
+    //	only usages of the reports: keys below 0xE0 and the modifiers,
+    //	keys of higher usages (media keys, ...) stay on uinput
+    for (i = 0xE7; i >= 4; --i) {
+	if (UHidKeyboard[i]) {
+	    UHidUsage[UHidKeyboard[i]] = i;
+	}
+    }
+    UHidNkro = nkro;
+
+    if ((fd = open("/dev/uhid", O_RDWR | O_NONBLOCK | O_CLOEXEC)) < 0) {
+	perror("open(/dev/uhid)");
+	return fd;
+    }
+
+    memset(&ev, 0, sizeof(ev));
+    ev.type = UHID_CREATE2;
+    strncpy((char *)ev.u.create2.name, name,
+	sizeof(ev.u.create2.name) - 1);
+    snprintf((char *)ev.u.create2.phys, sizeof(ev.u.create2.phys),
+	"aohkd-%04x:%04x", 0x414C, 0x4F48);
+    ev.u.create2.bus = BUS_USB;
+    ev.u.create2.vendor = 0x414C;
+    ev.u.create2.product = 0x4F48;
+    ev.u.create2.version = 0x0001;
+    if (nkro) {
+	ev.u.create2.rd_size = sizeof(UHidNkroDescriptor);
+	memcpy(ev.u.create2.rd_data, UHidNkroDescriptor,
+	    sizeof(UHidNkroDescriptor));
+    } else {
+	ev.u.create2.rd_size = sizeof(UHidBootDescriptor);
+	memcpy(ev.u.create2.rd_data, UHidBootDescriptor,
+	    sizeof(UHidBootDescriptor));
+    }
+    if (write(fd, &ev, sizeof(ev)) < 0) {
+	perror("write(UHID_CREATE2)");
+	close(fd);
+	return -1;
+    }
+
+    return fd;
+}
+
+///
+///	Answer requests of the kernel.
+///
+///	Reports can't be read back, LED output is ignored.
+///
+///	@param fd	uhid file descriptor
+///
+static void UHidRequests(int fd)
+{
+    struct uhid_event ev;
+    struct uhid_event reply;
+
+    while (read(fd, &ev, sizeof(ev)) > 0) {
+	memset(&reply, 0, sizeof(reply));
+	switch (ev.type) {
+	    case UHID_GET_REPORT:
+		reply.type = UHID_GET_REPORT_REPLY;
+		reply.u.get_report_reply.id = ev.u.get_report.id;
+		reply.u.get_report_reply.err = 5;	// EIO
+		break;
+	    case UHID_SET_REPORT:
+		reply.type = UHID_SET_REPORT_REPLY;
+		reply.u.set_report_reply.id = ev.u.set_report.id;
+		break;
+	    default:			// start, open, close, output
+		continue;
+	}
+	if (write(fd, &reply, sizeof(reply)) < 0) {
+	    perror("write(uhid reply)");
+	}
+    }
+}
+
+///
+///	Send keyboard report of the pressed keys.
+///
+///	@param fd	uhid file descriptor
+///
+///	@returns -1 if failure
+///
+int UHidSync(int fd)
+{
+    struct uhid_event ev;
+    unsigned char *report;
+    int i;
+    int n;
+
+    UHidRequests(fd);
+    if (!UHidPending) {
+	return 0;
+    }
+    UHidPending = 0;
+    memset(UHidPressed, 0, sizeof(UHidPressed));
+    memset(UHidReleased, 0, sizeof(UHidReleased));
+
+    ev.type = UHID_INPUT2;
+    report = ev.u.input2.data;
+    report[0] = UHidDown[0xE0 / 8];	// modifiers
+    if (UHidNkro) {
+	memcpy(report + 1, UHidDown, 0xE0 / 8);
+	n = 1 + 0xE0 / 8;
+    } else {
+	memset(report + 1, 0, 7);
+	n = 2;
+	for (i = 4; i < 0xE0; ++i) {
+	    if (UHidDown[i / 8] & (1 << (i % 8))) {
+		if (n == 8) {		// too many keys
+		    memset(report + 2, 0x01, 6);	// ErrorRollOver
+		    break;
+		}
+		report[n++] = i;
+	    }
+	}
+	n = 8;
+    }
+    ev.u.input2.size = n;
+
+    return write(fd, &ev, offsetof(struct uhid_event, u.input2.data) + n);
+}
+
+///
+///	Queue key press or release.
+///
+///	If the change undoes a change not yet sent, the queued report is
+///	sent first.
+///
+///	@param fd	uhid file descriptor
+///	@param code	scancode
+///	@param pressed	1 pressed, 0 released, 2 repeated (ignored, the
+///			kernel repeats hid keyboards itself)
+///
+///	@returns true if the key was queued, false if the key has no HID
+///	usage.
+///
+int UHidKey(int fd, int code, int pressed)
+{
+    int usage;
+    int bit;
+    int i;
+
+    if (code < 0 || code > 255 || !(usage = UHidUsage[code])) {
+	return 0;
+    }
+    if (pressed == 2) {
+	return 1;
+    }
+    i = usage / 8;
+    bit = 1 << (usage % 8);
+    if (pressed) {
+	if (UHidReleased[i] & bit) {
+	    UHidSync(fd);
+	}
+	UHidDown[i] |= bit;
+	UHidPressed[i] |= bit;
+    } else {
+	if (UHidPressed[i] & bit) {
+	    UHidSync(fd);
+	}
+	UHidDown[i] &= ~bit;
+	UHidReleased[i] |= bit;
+    }
+    UHidPending = 1;
+
+    return 1;
+}
+
+///
+///	Close uhid keyboard
+///
+///	@param fd	uhid file descriptor
+///
+void CloseUHid(int fd)
+{
+    struct uhid_event ev;
+
+    memset(&ev, 0, sizeof(ev));
+    ev.type = UHID_DESTROY;
+    if (write(fd, &ev, sizeof(ev)) < 0) {
+	perror("write(UHID_DESTROY)");
+    }
+    close(fd);
+}
@@ -0,0 +1,34 @@
+///
+///	@file uhid.h	@brief	linux uhid modul header file
+///
+///	Copyright (c) 2007,2009 by Lutz Sammer.	 All Rights Reserved.
+///
+///	Contributor(s):
+///
+///	This file is part of ALE one-hand keyboard
+///
+///	This program is free software; you can redistribute it and/or modify
+///	it under the terms of the GNU General Public License as published by
+///	the Free Software Foundation; only version 2 of the License.
+///
+///	This program is distributed in the hope that it will be useful,
+///	but WITHOUT ANY WARRANTY; without even the implied warranty of
+///	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+///	GNU General Public License for more details.
+///
+///	$Id$
+////////////////////////////////////////////////////////////////////////////
+
+/// @addtogroup uhid
+/// @{
+
+//----------------------------------------------------------------------------
+//	Prototypes
+//----------------------------------------------------------------------------
+
+extern int OpenUHid(const char *, int);	///< open uhid keyboard
+extern int UHidKey(int, int, int);	///< queue key press/release
+extern int UHidSync(int);		///< send queued report
+extern void CloseUHid(int);		///< close uhid keyboard
+
+/// @}
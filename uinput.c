@@ -36,6 +36,7 @@
 #include <unistd.h>
 
 #include "uinput.h"
+#include "probe.h"
 
 ///
 ///	Open uinput device
@@ -106,14 +107,15 @@ int OpenUInput(const char *name)
     ioctl(fd, UI_SET_EVBIT, EV_KEY);
 
     //	set key events we can generate (in this case, all)
-    for (i = 1; i < /*KEY_MAX */ 255; i++) {
+    //	joystick, gamepad and digitizer buttons would let udev classify
+    //	us as joystick or tablet, keep them out.
+    for (i = 1; i <= KEY_MAX; i++) {
+	if (i >= BTN_JOYSTICK && i < BTN_WHEEL) {
+	    continue;
+	}
 	ioctl(fd, UI_SET_KEYBIT, i);
     }
 
-    ioctl(fd, UI_SET_KEYBIT, BTN_LEFT);
-    ioctl(fd, UI_SET_KEYBIT, BTN_RIGHT);
-    ioctl(fd, UI_SET_KEYBIT, BTN_MIDDLE);
-
     //	write down information for creating a new device
     if (write(fd, &device, sizeof(struct uinput_user_dev)) < 0) {
 	perror("write");
@@ -149,6 +151,8 @@ int UInputKeydown(int fd, int code)
 {
     struct input_event event[2];
 
+    AOHK_PROBE3(uinput, EV_KEY, code, 1);
+
     memset(&event, 0, sizeof(event));
 
     event[0].type = EV_KEY;
@@ -174,6 +178,8 @@ int UInputKeyup(int fd, int code)
 {
     struct input_event event[2];
 
+    AOHK_PROBE3(uinput, EV_KEY, code, 0);
+
     memset(&event, 0, sizeof(event));
 
     event[0].type = EV_KEY;
@@ -185,6 +191,33 @@ int UInputKeyup(int fd, int code)
     return write(fd, event, sizeof(event));
 }
 
+///
+///	Send key repeat event
+///
+///	@param fd	uinput file descriptor
+///	@param code	scancode
+///
+///	@returns -1 if failure
+///
+///	@see /usr/include/linux/input.h for possible scancodes.
+///
+int UInputKeyrepeat(int fd, int code)
+{
+    struct input_event event[2];
+
+    AOHK_PROBE3(uinput, EV_KEY, code, 2);
+
+    memset(&event, 0, sizeof(event));
+
+    event[0].type = EV_KEY;
+    event[0].code = code;
+    event[0].value = 2;
+    event[1].type = EV_SYN;
+    event[1].code = SYN_REPORT;
+
+    return write(fd, event, sizeof(event));
+}
+
 ///
 ///	Send absolute x event
 ///
@@ -269,6 +302,44 @@ int UInputRelY(int fd, int y)
     return write(fd, &event, sizeof(event));
 }
 
+///
+///	Send relative motion event
+///
+///	Both axes and the syn are written at once, the motion is reported
+///	as one step.
+///
+///	@param fd	uinput file descriptor
+///	@param x	relative x motion
+///	@param y	relative y motion
+///
+///	@returns -1 if failure
+///
+int UInputRel(int fd, int x, int y)
+{
+    struct input_event event[3];
+    int n;
+
+    AOHK_PROBE3(uinput, EV_REL, x, y);
+
+    memset(&event, 0, sizeof(event));
+
+    n = 0;
+    if (x) {
+	event[n].type = EV_REL;
+	event[n].code = REL_X;
+	event[n++].value = x;
+    }
+    if (y) {
+	event[n].type = EV_REL;
+	event[n].code = REL_Y;
+	event[n++].value = y;
+    }
+    event[n].type = EV_SYN;
+    event[n++].code = SYN_REPORT;
+
+    return write(fd, event, n * sizeof(*event));
+}
+
 ///
 ///	Send syn event
 ///
@@ -32,10 +32,12 @@
 extern int OpenUInput(const char *);	///< open uinput
 extern int UInputKeydown(int, int);	///< send key down event
 extern int UInputKeyup(int, int);	///< send key up event
+extern int UInputKeyrepeat(int, int);	///< send key repeat event
 extern int UInputAbsX(int, int);	///< send tablet x event
 extern int UInputAbsY(int, int);	///< send tablet y event
 extern int UInputRelX(int, int);	///< send mouse x event
 extern int UInputRelY(int, int);	///< send mouse y event
+extern int UInputRel(int, int, int);	///< send mouse motion event
 extern int UInputSyn(int);		///< send syn report event
 extern void CloseUInput(int);		///< close uinput
 